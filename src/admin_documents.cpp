@@ -0,0 +1,103 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "admin_documents.hpp"
+#include "utils.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <sstream>
+
+namespace elliptics {
+
+namespace {
+
+// Documents which are less than the size are not worth compressing
+const size_t min_gzip_size = 1024;
+
+} // namespace
+
+admin_documents_t::admin_documents_t()
+	: version(0)
+{
+}
+
+void
+admin_documents_t::update() {
+	lock_guard_t lock_guard(mutex);
+
+	version += 1;
+	documents.clear();
+}
+
+admin_documents_t::document_ptr_t
+admin_documents_t::get(const std::string &name, const render_function_t &render_function) {
+	size_t current_version = 0;
+
+	{
+		lock_guard_t lock_guard(mutex);
+
+		auto it = documents.find(name);
+
+		if (it != documents.end()) {
+			HANDY_COUNTER_INCREMENT("mds.admin_documents.hit");
+			return it->second;
+		}
+
+		current_version = version;
+	}
+
+	// Rendering asks mastermind, it is not done under the lock to not block other documents
+	HANDY_COUNTER_INCREMENT("mds.admin_documents.render");
+	auto document = make_document(current_version, render_function());
+
+	lock_guard_t lock_guard(mutex);
+
+	// The document which was rendered before the update is not stored
+	if (current_version == version) {
+		// The concurrent request could store the same document first
+		document = documents.emplace(name, document).first->second;
+	}
+
+	return document;
+}
+
+admin_documents_t::document_ptr_t
+admin_documents_t::make_document(size_t version, const std::string &body) {
+	auto document = std::make_shared<document_t>();
+
+	std::ostringstream oss;
+	oss << '\"' << std::hex << std::hash<std::string>()(body) << '\"';
+
+	document->version = version;
+	document->etag = oss.str();
+
+	document->body = ioremap::elliptics::data_pointer::copy(body.data(), body.size());
+
+	if (body.size() >= min_gzip_size) {
+		document->gzipped_etag = document->etag.substr(0, document->etag.size() - 1) + "-gzip\"";
+		document->gzipped_body = gzip_compress(document->body, 6);
+	}
+
+	return document;
+}
+
+} // namespace elliptics
+
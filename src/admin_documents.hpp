@@ -0,0 +1,78 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef MDS_PROXY__SRC__ADMIN_DOCUMENTS__HPP
+#define MDS_PROXY__SRC__ADMIN_DOCUMENTS__HPP
+
+#include <elliptics/utils.hpp>
+
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <string>
+
+namespace elliptics {
+
+// Keeps rendered admin documents (/cache, /statistics) until the next update of
+// the mastermind cache. A document is rendered by the first request of the version and
+// is shared by the following requests as an immutable buffer, so a scrape is a pointer copy.
+// ETags depend only on the content, hence collectors get 304 across versions
+// while the content does not change.
+class admin_documents_t {
+public:
+	struct document_t {
+		size_t version;
+		std::string etag;
+		ioremap::elliptics::data_pointer body;
+		// Small bodies are not compressed, gzipped_body is empty then
+		std::string gzipped_etag;
+		ioremap::elliptics::data_pointer gzipped_body;
+	};
+
+	typedef std::shared_ptr<const document_t> document_ptr_t;
+	typedef std::function<std::string ()> render_function_t;
+
+	admin_documents_t();
+
+	// Starts the new version, documents are rendered again by the next requests
+	void
+	update();
+
+	// The document is rendered by render_function if there is no document of the current version
+	document_ptr_t
+	get(const std::string &name, const render_function_t &render_function);
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::lock_guard<mutex_t> lock_guard_t;
+
+	static document_ptr_t
+	make_document(size_t version, const std::string &body);
+
+	mutex_t mutex;
+	size_t version;
+	std::unordered_map<std::string, document_ptr_t> documents;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__ADMIN_DOCUMENTS__HPP */
+
@@ -0,0 +1,126 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "bandwidth_limiter.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace elliptics {
+
+bandwidth_limiter_t::bandwidth_limiter_t(size_t rate_, size_t max_request)
+	: rate(std::max<size_t>(rate_, 1))
+	, bucket_size(std::max<double>(rate, max_request))
+	, tokens(bucket_size)
+	, last_refill(clock_t::now())
+	, work_is_done(false)
+{
+	background = std::thread(std::bind(&bandwidth_limiter_t::background_loop, this));
+}
+
+bandwidth_limiter_t::~bandwidth_limiter_t() {
+	stop();
+}
+
+void
+bandwidth_limiter_t::stop() {
+	{
+		lock_guard_t lock_guard(waiters_mutex);
+
+		work_is_done = true;
+		background_cv.notify_one();
+	}
+
+	if (background.joinable()) {
+		background.join();
+	}
+}
+
+void
+bandwidth_limiter_t::acquire(size_t bytes, callback_t callback) {
+	lock_guard_t lock_guard(waiters_mutex);
+
+	if (work_is_done) {
+		lock_guard.unlock();
+		callback(false);
+		return;
+	}
+
+	waiter_t waiter;
+	waiter.bytes = std::min<size_t>(bytes, bucket_size);
+	waiter.callback = std::move(callback);
+
+	waiters.emplace_back(std::move(waiter));
+	background_cv.notify_one();
+}
+
+void
+bandwidth_limiter_t::background_loop() {
+	lock_guard_t lock_guard(waiters_mutex);
+
+	while (!work_is_done) {
+		{
+			auto now = clock_t::now();
+			auto elapsed = std::chrono::duration<double>(now - last_refill).count();
+
+			last_refill = now;
+			tokens = std::min(bucket_size, tokens + elapsed * rate);
+		}
+
+		std::vector<callback_t> ready;
+
+		while (!waiters.empty() && tokens >= waiters.front().bytes) {
+			tokens -= waiters.front().bytes;
+			ready.emplace_back(std::move(waiters.front().callback));
+			waiters.pop_front();
+		}
+
+		if (ready.empty()) {
+			auto timeout = std::chrono::milliseconds(1000);
+
+			if (!waiters.empty()) {
+				auto lack = waiters.front().bytes - tokens;
+				timeout = std::chrono::milliseconds(static_cast<int64_t>(1000 * lack / rate) + 1);
+			}
+
+			background_cv.wait_for(lock_guard, timeout);
+			continue;
+		}
+
+		lock_guard.unlock();
+
+		for (auto it = ready.begin(), end = ready.end(); it != end; ++it) {
+			(*it)(true);
+		}
+
+		lock_guard.lock();
+	}
+
+	auto aborted = std::move(waiters);
+	waiters.clear();
+
+	lock_guard.unlock();
+
+	for (auto it = aborted.begin(), end = aborted.end(); it != end; ++it) {
+		it->callback(false);
+	}
+}
+
+} // namespace elliptics
+
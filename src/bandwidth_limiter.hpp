@@ -0,0 +1,82 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__BANDWIDTH_LIMITER__HPP
+#define MDS_PROXY__SRC__BANDWIDTH_LIMITER__HPP
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+
+namespace elliptics {
+
+// Token bucket which paces background transfers.
+// Callbacks are called from the limiter's thread in the order of acquiring
+// when the requested number of bytes is available.
+class bandwidth_limiter_t {
+public:
+	// The callback is called with false if the limiter is stopped
+	typedef std::function<void (bool)> callback_t;
+
+	// The bucket is never less than max_request, otherwise such request would wait forever
+	bandwidth_limiter_t(size_t rate_, size_t max_request);
+
+	~bandwidth_limiter_t();
+
+	void
+	acquire(size_t bytes, callback_t callback);
+
+	// Callbacks which are still waiting and all subsequent ones are called with false
+	void
+	stop();
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+	typedef std::chrono::steady_clock clock_t;
+
+	struct waiter_t {
+		size_t bytes;
+		callback_t callback;
+	};
+
+	void
+	background_loop();
+
+	double rate;
+	double bucket_size;
+	double tokens;
+	clock_t::time_point last_refill;
+
+	mutex_t waiters_mutex;
+	std::deque<waiter_t> waiters;
+
+	std::thread background;
+	std::condition_variable background_cv;
+
+	bool work_is_done;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__BANDWIDTH_LIMITER__HPP */
+
@@ -97,14 +97,15 @@ elliptics::buffered_writer_t::append(const char *data, size_t size) {
 void
 elliptics::buffered_writer_t::write(const ioremap::elliptics::session &session, size_t commit_coef
 		, size_t success_copies_num, size_t limit_of_middle_chunk_attempts
-		, double scale_retry_timeout, callback_t next) {
+		, double scale_retry_timeout, storage_flow_t flow, callback_t next) {
 	lock_guard_t lock_guard(state_mutex);
 
 	switch (state) {
 	case state_tag::appending:
 		state = state_tag::writing;
 		write_impl(lock_guard, session, commit_coef, success_copies_num
-				, limit_of_middle_chunk_attempts, scale_retry_timeout, std::move(next));
+				, limit_of_middle_chunk_attempts, scale_retry_timeout
+				, std::move(flow), std::move(next));
 		break;
 	case state_tag::interrupted:
 		buffers.clear();
@@ -227,11 +228,11 @@ void
 elliptics::buffered_writer_t::write_impl(lock_guard_t &lock_guard
 		, const ioremap::elliptics::session &session
 		, size_t commit_coef, size_t success_copies_num, size_t limit_of_middle_chunk_attempts
-		, double scale_retry_timeout, callback_t next) {
+		, double scale_retry_timeout, storage_flow_t flow, callback_t next) {
 	writer = std::make_shared<writer_t>(
 			ioremap::swarm::logger(logger(), blackhole::log::attributes_t()), session, get_key()
 			, total_size, 0, commit_coef, success_copies_num
-			, limit_of_middle_chunk_attempts, scale_retry_timeout);
+			, limit_of_middle_chunk_attempts, scale_retry_timeout, std::move(flow));
 
 	write_chunk(lock_guard, std::move(next));
 }
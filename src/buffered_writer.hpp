@@ -61,7 +61,7 @@ public:
 	void
 	write(const ioremap::elliptics::session &session, size_t commit_coef
 			, size_t success_copies_num, size_t limit_of_middle_chunk_attempts
-			, double scale_retry_timeout, callback_t next);
+			, double scale_retry_timeout, storage_flow_t flow, callback_t next);
 
 	void
 	interrupt();
@@ -111,7 +111,7 @@ private:
 	write_impl(lock_guard_t &lock_guard
 			, const ioremap::elliptics::session &session, size_t commit_coef
 			, size_t success_copies_num, size_t limit_of_middle_chunk_attempts
-			, double scale_retry_timeout, callback_t next);
+			, double scale_retry_timeout, storage_flow_t flow, callback_t next);
 
 	void
 	write_chunk(lock_guard_t &lock_guard, callback_t next);
@@ -0,0 +1,427 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "bulk_delete.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <vector>
+
+namespace elliptics {
+
+req_bulk_delete::req_bulk_delete()
+	: in_flight_limit(1)
+	, queued_keys(0)
+	, in_flight(0)
+	, lines_in_flight(0)
+	, body_is_read(false)
+	, chunk_is_requested(false)
+	, is_finished(false)
+	, client_error(false)
+	, removed_count(0)
+	, failed_count(0)
+	, malformed_count(0)
+{
+}
+
+void
+req_bulk_delete::on_request(const ioremap::thevoid::http_request &http_request) {
+	MDS_LOG_INFO("Bulk delete: handle request: %s", http_request.url().path().c_str());
+
+	try {
+		ns_state = server()->get_namespace_state(http_request.url().path(), "/bulk-delete");
+	} catch (const std::exception &ex) {
+		MDS_LOG_INFO("Bulk delete: request = \"%s\", err = \"%s\""
+				, http_request.url().path().c_str(), ex.what());
+		reply()->send_error(ioremap::swarm::http_response::bad_request);
+		return;
+	}
+
+	if (!server()->check_basic_auth(ns_state.name()
+				, ns_settings(ns_state).auth_key_for_write
+				, http_request.headers().get("Authorization"))) {
+		auto token = server()->get_auth_token(http_request.headers().get("Authorization"));
+		MDS_LOG_INFO("invalid token \"%s\"", token.empty() ? "<none>" : token.c_str());
+
+		ioremap::thevoid::http_response reply;
+		ioremap::swarm::http_headers headers;
+
+		reply.set_code(401);
+		headers.add("WWW-Authenticate", std::string("Basic realm=\"") + ns_state.name() + "\"");
+		headers.set_content_length(0);
+		headers.set_keep_alive(false);
+		reply.set_headers(headers);
+		send_reply(std::move(reply));
+		return;
+	}
+
+	{
+		const auto &content_length = http_request.headers().content_length();
+
+		if (!content_length || *content_length == 0) {
+			MDS_LOG_INFO("Bulk delete: Content-Length must be set and be greater than zero");
+			reply()->send_error(ioremap::swarm::http_response::bad_request);
+			return;
+		}
+	}
+
+	{
+		// The method runs in thevoid's io-loop, therefore proxy's dtor cannot run in this moment
+		// Hence session can be safely used without any check
+		auto session = server()->get_session();
+
+		if (!session || session->state_num() < server()->die_limit()) {
+			MDS_LOG_ERROR("Bulk delete: too low number of existing states");
+			reply()->send_error(ioremap::swarm::http_response::service_unavailable);
+			return;
+		}
+	}
+
+	in_flight_limit = std::max<size_t>(server()->bulk_delete.in_flight_limit, 1);
+	set_chunk_size(server()->bulk_delete.chunk_size);
+
+	ioremap::thevoid::http_response reply;
+	ioremap::swarm::http_headers headers;
+
+	reply.set_code(200);
+	headers.set_content_type("text/plain");
+	// The size of response is unknown until all keys are processed,
+	// the end of response is marked by closing of the connection.
+	headers.set_keep_alive(false);
+	reply.set_headers(headers);
+
+	send_headers(std::move(reply)
+			, std::function<void (const boost::system::error_code &)>());
+
+	{
+		lock_guard_t lock_guard(state_mutex);
+		chunk_is_requested = true;
+	}
+
+	try_next_chunk();
+}
+
+void
+req_bulk_delete::on_chunk(const boost::asio::const_buffer &buffer, unsigned int flags) {
+	const char *buffer_data = boost::asio::buffer_cast<const char *>(buffer);
+	const size_t buffer_size = boost::asio::buffer_size(buffer);
+
+	std::vector<std::string> malformed_lines;
+
+	{
+		lock_guard_t lock_guard(state_mutex);
+
+		chunk_is_requested = false;
+
+		incomplete_line.append(buffer_data, buffer_size);
+
+		std::string::size_type pos = 0;
+
+		for (auto end = incomplete_line.find('\n'); end != std::string::npos
+				; pos = end + 1, end = incomplete_line.find('\n', pos)) {
+			auto line = incomplete_line.substr(pos, end - pos);
+
+			if (!enqueue_line(line)) {
+				malformed_lines.emplace_back(std::move(line));
+			}
+		}
+
+		incomplete_line.erase(0, pos);
+
+		if (flags & last_chunk) {
+			body_is_read = true;
+
+			if (!enqueue_line(incomplete_line)) {
+				malformed_lines.emplace_back(std::move(incomplete_line));
+			}
+
+			incomplete_line.clear();
+		}
+	}
+
+	for (auto it = malformed_lines.begin(), end = malformed_lines.end(); it != end; ++it) {
+		send_line(400, *it);
+	}
+
+	dispatch();
+}
+
+void
+req_bulk_delete::on_error(const boost::system::error_code &error_code) {
+	MDS_LOG_ERROR("Bulk delete: error during reading request: %s", error_code.message().c_str());
+
+	{
+		lock_guard_t lock_guard(state_mutex);
+
+		client_error = true;
+		body_is_read = true;
+		queues.clear();
+		queued_keys = 0;
+	}
+
+	try_to_finish();
+}
+
+bool
+req_bulk_delete::enqueue_line(std::string line) {
+	if (!line.empty() && line[line.size() - 1] == '\r') {
+		line.resize(line.size() - 1);
+	}
+
+	if (line.empty()) {
+		// Empty lines are allowed as separators
+		return true;
+	}
+
+	key_info_t key_info;
+	std::string filename;
+
+	if (ns_settings(ns_state).static_couple.empty()) {
+		auto pos = line.find('/');
+
+		if (pos == std::string::npos || pos + 1 == line.size()) {
+			return false;
+		}
+
+		int group = 0;
+
+		try {
+			group = boost::lexical_cast<int>(line.substr(0, pos));
+		} catch (...) {
+			return false;
+		}
+
+		if (group <= 0) {
+			return false;
+		}
+
+		// A couple unknown to mastermind makes the line invalid as in prepare_session
+		try {
+			key_info.couple = server()->get_groups(ns_state, group);
+		} catch (const std::exception &ex) {
+			MDS_LOG_INFO("Bulk delete: cannot determine groups: line=%s; error=%s"
+					, line.c_str(), ex.what());
+			return false;
+		}
+
+		filename = line.substr(pos + 1);
+	} else {
+		key_info.couple = ns_settings(ns_state).static_couple;
+		filename = line;
+	}
+
+	if (key_info.couple.empty()) {
+		return false;
+	}
+
+	key_info.key = ns_state.name() + '.' + filename;
+	key_info.line = std::move(line);
+
+	auto couple_id = *std::min_element(key_info.couple.begin(), key_info.couple.end());
+	queues[couple_id].emplace_back(std::move(key_info));
+	queued_keys += 1;
+
+	return true;
+}
+
+void
+req_bulk_delete::dispatch() {
+	auto self = shared_from_this();
+
+	while (true) {
+		lock_guard_t lock_guard(state_mutex);
+
+		if (client_error || queued_keys == 0 || in_flight >= in_flight_limit) {
+			break;
+		}
+
+		// Drain couples one by one to keep removes of the same couple together
+		auto queue_it = queues.begin();
+		auto key_info = std::move(queue_it->second.front());
+		queue_it->second.pop_front();
+
+		auto couple_id = queue_it->first;
+
+		if (queue_it->second.empty()) {
+			queues.erase(queue_it);
+		}
+
+		queued_keys -= 1;
+		in_flight += 1;
+
+		auto session_it = sessions.find(couple_id);
+
+		if (session_it == sessions.end()) {
+			auto session = server()->remove_session(request(), key_info.couple);
+
+			if (!session) {
+				lock_guard.unlock();
+				MDS_LOG_ERROR("Bulk delete: remove-session is uninitialized");
+				on_removed(key_info, util::expected_from_exception<std::runtime_error>(
+							"remove-session is uninitialized"));
+				continue;
+			}
+
+			session_it = sessions.insert(std::make_pair(couple_id, *session)).first;
+		}
+
+		auto session = session_it->second;
+
+		lock_guard.unlock();
+
+		server()->key_is_removing(key_info.couple, key_info.key);
+
+		auto next = [this, self, key_info] (util::expected<remove_result_t> result) {
+			on_removed(key_info, std::move(result));
+		};
+
+		elliptics::remove(make_shared_logger(logger()), std::move(session), key_info.key
+				, server()->storage_flow(ns_state), std::move(next));
+	}
+
+	bool read_more = false;
+
+	{
+		lock_guard_t lock_guard(state_mutex);
+
+		// Backpressure: the body is read only if there is not enough queued work
+		if (!client_error && !body_is_read && !chunk_is_requested
+				&& queued_keys < in_flight_limit) {
+			chunk_is_requested = true;
+			read_more = true;
+		}
+	}
+
+	if (read_more) {
+		try_next_chunk();
+		return;
+	}
+
+	try_to_finish();
+}
+
+void
+req_bulk_delete::on_removed(const key_info_t &key_info, util::expected<remove_result_t> result) {
+	server()->key_is_removed(key_info.couple, key_info.key);
+
+	int status = 200;
+
+	try {
+		const auto &remove_result = result.get();
+
+		if (remove_result.is_failed()) {
+			status = 500;
+		} else if (remove_result.key_was_not_found()) {
+			MDS_LOG_INFO("Bulk delete: key was not found, treat it as removed: %s"
+					, key_info.key.c_str());
+		}
+	} catch (const std::exception &ex) {
+		MDS_LOG_ERROR("Bulk delete: remove error: key=%s; error=%s"
+				, key_info.key.c_str(), ex.what());
+		status = 500;
+	}
+
+	{
+		lock_guard_t lock_guard(state_mutex);
+
+		in_flight -= 1;
+
+		if (status == 200) {
+			removed_count += 1;
+		} else {
+			failed_count += 1;
+		}
+	}
+
+	send_line(status, key_info.line);
+	dispatch();
+}
+
+void
+req_bulk_delete::send_line(int status, const std::string &line) {
+	{
+		lock_guard_t lock_guard(state_mutex);
+
+		if (client_error) {
+			return;
+		}
+
+		if (status == 400) {
+			malformed_count += 1;
+		}
+
+		lines_in_flight += 1;
+	}
+
+	auto data = boost::lexical_cast<std::string>(status) + '\t' + line + '\n';
+
+	send_data(std::move(data)
+			, std::bind(&req_bulk_delete::on_line_sent, shared_from_this()
+				, std::placeholders::_1));
+}
+
+void
+req_bulk_delete::on_line_sent(const boost::system::error_code &error_code) {
+	{
+		lock_guard_t lock_guard(state_mutex);
+
+		lines_in_flight -= 1;
+
+		if (error_code && !client_error) {
+			MDS_LOG_ERROR("Bulk delete: cannot send result: %s", error_code.message().c_str());
+			client_error = true;
+			body_is_read = true;
+			queues.clear();
+			queued_keys = 0;
+		}
+	}
+
+	try_to_finish();
+}
+
+void
+req_bulk_delete::try_to_finish() {
+	{
+		lock_guard_t lock_guard(state_mutex);
+
+		if (is_finished || !body_is_read || queued_keys != 0
+				|| in_flight != 0 || lines_in_flight != 0) {
+			return;
+		}
+
+		is_finished = true;
+	}
+
+	MDS_LOG_INFO("Bulk delete: finished: removed=%llu; failed=%llu; malformed=%llu"
+			, static_cast<unsigned long long>(removed_count)
+			, static_cast<unsigned long long>(failed_count)
+			, static_cast<unsigned long long>(malformed_count));
+
+	if (client_error) {
+		close(boost::system::errc::make_error_code(
+					boost::system::errc::operation_canceled));
+		return;
+	}
+
+	close(boost::system::error_code());
+}
+
+} // namespace elliptics
+
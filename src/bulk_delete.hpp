@@ -0,0 +1,115 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__BULK_DELETE__HPP
+#define MDS_PROXY__SRC__BULK_DELETE__HPP
+
+#include "proxy.hpp"
+#include "remove.hpp"
+#include "expected.hpp"
+
+#include <thevoid/stream.hpp>
+
+#include <libmastermind/mastermind.hpp>
+
+#include <map>
+#include <list>
+#include <string>
+#include <mutex>
+
+namespace elliptics {
+
+// Request body is a list of keys separated by '\n'. Every key has the same form as a path
+// of the delete handler without the handler prefix: "<couple-id>/<filename>" or just
+// "<filename>" for namespaces with static couple.
+// Response is streamed line by line as removes are finished: "<status>\t<key>\n".
+// The key which was not found in storage is treated as successfully removed.
+struct req_bulk_delete
+	: public ioremap::thevoid::buffered_request_stream<proxy>
+	, public std::enable_shared_from_this<req_bulk_delete>
+{
+	req_bulk_delete();
+
+	void
+	on_request(const ioremap::thevoid::http_request &http_request);
+
+	void
+	on_chunk(const boost::asio::const_buffer &buffer, unsigned int flags);
+
+	void
+	on_error(const boost::system::error_code &error_code);
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+
+	struct key_info_t {
+		std::string line;
+		std::string key;
+		couple_t couple;
+	};
+
+	bool
+	enqueue_line(std::string line);
+
+	void
+	dispatch();
+
+	void
+	on_removed(const key_info_t &key_info, util::expected<remove_result_t> result);
+
+	void
+	send_line(int status, const std::string &line);
+
+	void
+	on_line_sent(const boost::system::error_code &error_code);
+
+	void
+	try_to_finish();
+
+	mastermind::namespace_state_t ns_state;
+
+	size_t in_flight_limit;
+
+	mutex_t state_mutex;
+
+	std::string incomplete_line;
+
+	// Keys are grouped by couple to use one session per couple and to send removes
+	// to the same storage nodes back to back.
+	std::map<int, std::list<key_info_t>> queues;
+	std::map<int, ioremap::elliptics::session> sessions;
+	size_t queued_keys;
+	size_t in_flight;
+	size_t lines_in_flight;
+
+	bool body_is_read;
+	bool chunk_is_requested;
+	bool is_finished;
+	bool client_error;
+
+	size_t removed_count;
+	size_t failed_count;
+	size_t malformed_count;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__BULK_DELETE__HPP */
+
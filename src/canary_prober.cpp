@@ -0,0 +1,309 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "canary_prober.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <ctime>
+
+namespace elliptics {
+
+canary_prober_t::canary_prober_t(ioremap::swarm::logger bh_logger_, config_t config_
+		, couples_function_t couples_function_
+		, session_function_t read_session_function_
+		, session_function_t write_session_function_
+		, std::shared_ptr<groups_health_t> groups_health_
+		, storage_flow_t flow_)
+	: bh_logger(std::move(bh_logger_))
+	, config(std::move(config_))
+	, couples_function(std::move(couples_function_))
+	, read_session_function(std::move(read_session_function_))
+	, write_session_function(std::move(write_session_function_))
+	, groups_health(std::move(groups_health_))
+	, flow(std::move(flow_))
+	, next_couple(0)
+	, in_flight(0)
+	, work_is_done(false)
+{
+	MDS_LOG_INFO("starting background thread");
+	background_prober = std::thread(std::bind(&canary_prober_t::background_loop, this));
+}
+
+canary_prober_t::~canary_prober_t() {
+	MDS_LOG_INFO("stopping canary prober");
+
+	{
+		lock_guard_t lock_guard(mutex);
+		work_is_done = true;
+		background_prober_cv.notify_one();
+	}
+
+	background_prober.join();
+
+	lock_guard_t lock_guard(mutex);
+
+	while (in_flight != 0) {
+		in_flight_cv.wait(lock_guard);
+	}
+
+	MDS_LOG_INFO("canary prober is stopped");
+}
+
+ioremap::swarm::logger &
+canary_prober_t::logger() {
+	return bh_logger;
+}
+
+std::string
+canary_prober_t::operation_name(operation_tag operation) {
+	switch (operation) {
+	case operation_tag::write:
+		return "write";
+	case operation_tag::lookup:
+		return "lookup";
+	case operation_tag::read:
+		return "read";
+	}
+
+	return "unknown";
+}
+
+void
+canary_prober_t::background_loop() {
+	auto period = std::chrono::microseconds(static_cast<int64_t>(1000000 / config.rate));
+
+	lock_guard_t lock_guard(mutex);
+
+	while (!work_is_done) {
+		background_prober_cv.wait_for(lock_guard, period);
+
+		if (work_is_done) {
+			break;
+		}
+
+		lock_guard.unlock();
+
+		try {
+			probe_next_couple();
+		} catch (const std::exception &ex) {
+			MDS_LOG_ERROR("cannot probe couple: %s", ex.what());
+		}
+
+		lock_guard.lock();
+	}
+}
+
+void
+canary_prober_t::probe_next_couple() {
+	if (next_couple >= couples.size()) {
+		couples = couples_function();
+		next_couple = 0;
+
+		HANDY_GAUGE_SET("mds.canary.couples", couples.size());
+
+		if (couples.empty()) {
+			return;
+		}
+	}
+
+	const auto &couple = couples[next_couple++];
+
+	{
+		lock_guard_t lock_guard(mutex);
+
+		if (in_flight >= config.in_flight_limit) {
+			lock_guard.unlock();
+
+			MDS_LOG_INFO("couple is skipped: too many groups are being probed");
+			HANDY_COUNTER_INCREMENT("mds.canary.skipped");
+			return;
+		}
+
+		in_flight += couple.size();
+		HANDY_GAUGE_SET("mds.canary.in_flight", in_flight);
+	}
+
+	for (auto it = couple.begin(), end = couple.end(); it != end; ++it) {
+		probe_group(*it);
+	}
+}
+
+void
+canary_prober_t::probe_group(group_t group) {
+	if (config.write) {
+		write(group);
+		return;
+	}
+
+	lookup(group);
+}
+
+void
+canary_prober_t::write(group_t group) {
+	// The payload is the time of the probe to see the last successful write in the group
+	auto payload = std::to_string(std::time(nullptr));
+	auto key = config.key;
+
+	auto command = [key, payload] (ioremap::elliptics::session &session
+			, reply_handler_t handler) {
+		auto future = session.write_data(key, ioremap::elliptics::data_pointer::copy(payload), 0);
+
+		future.connect([handler] (const ioremap::elliptics::sync_write_result &
+					, const ioremap::elliptics::error_info &error_info) {
+				handler(error_info);
+			});
+	};
+
+	issue(group, operation_tag::write, write_session_function, std::move(command)
+			, std::bind(&canary_prober_t::lookup, this, group));
+}
+
+void
+canary_prober_t::lookup(group_t group) {
+	auto key = config.key;
+
+	auto command = [key] (ioremap::elliptics::session &session, reply_handler_t handler) {
+		auto future = session.lookup(key);
+
+		future.connect([handler] (const ioremap::elliptics::sync_lookup_result &
+					, const ioremap::elliptics::error_info &error_info) {
+				handler(error_info);
+			});
+	};
+
+	issue(group, operation_tag::lookup, read_session_function, std::move(command)
+			, std::bind(&canary_prober_t::read, this, group));
+}
+
+void
+canary_prober_t::read(group_t group) {
+	auto key = config.key;
+
+	auto command = [key] (ioremap::elliptics::session &session, reply_handler_t handler) {
+		auto future = session.read_data(key, 0, 0);
+
+		future.connect([handler] (const ioremap::elliptics::sync_read_result &
+					, const ioremap::elliptics::error_info &error_info) {
+				handler(error_info);
+			});
+	};
+
+	issue(group, operation_tag::read, read_session_function, std::move(command), nullptr);
+}
+
+void
+canary_prober_t::issue(group_t group, operation_tag operation
+		, const session_function_t &session_function
+		, command_t command, std::function<void ()> next) {
+	auto session = session_function();
+
+	if (!session) {
+		finish(group);
+		return;
+	}
+
+	session->set_groups({group});
+
+	flow.schedule([this, group, operation, session, command, next] (
+				storage_scheduler_t::slot_ptr_t slot) mutable {
+		auto permit = flow.acquire({group});
+
+		// The group is already loaded up to its limit, the probe would only add to the load
+		if (permit->groups().empty()) {
+			HANDY_COUNTER_INCREMENT(("mds.canary.%d.busy", group));
+			finish(group);
+			return;
+		}
+
+		util::timer_t timer;
+
+		auto callback = [this, group, operation, timer, next] (
+				const ioremap::elliptics::error_info &error_info) {
+			if (report(group, operation, timer, error_info) && next) {
+				next();
+				return;
+			}
+
+			finish(group);
+		};
+
+		command(*session, hold_slot(std::move(slot)
+					, hold_slot(std::move(permit), std::move(callback))));
+	});
+}
+
+bool
+canary_prober_t::report(group_t group, operation_tag operation, util::timer_t timer
+		, const ioremap::elliptics::error_info &error_info) {
+	auto latency = timer.get_us();
+	auto name = operation_name(operation);
+	// The key is missing until the first write, but the group did answer
+	bool is_successful = !error_info || error_info.code() == -ENOENT;
+	// A read-only or a full group rejects writes but serves reads as usual,
+	// therefore the rejection neither downranks the group nor stops probing of reads
+	bool is_rejected = operation == operation_tag::write && error_info
+		&& (error_info.code() == -EROFS || error_info.code() == -ENOSPC);
+
+	if (groups_health) {
+		groups_health->report(group, is_successful || is_rejected
+				, std::chrono::microseconds(latency));
+	}
+
+	HANDY_GAUGE_SET(("mds.canary.%d.%s.latency_us", group, name.c_str()), latency);
+	HANDY_GAUGE_SET(("mds.canary.%d.%s.available", group, name.c_str()), is_successful ? 1 : 0);
+
+	if (is_rejected) {
+		HANDY_COUNTER_INCREMENT(("mds.canary.%d.%s.rejected", group, name.c_str()));
+
+		MDS_LOG_INFO("canary %s is rejected: group=%d; spent-time=%lluus; error=%s"
+				, name.c_str(), group, static_cast<unsigned long long>(latency)
+				, error_info.message().c_str());
+
+		return true;
+	}
+
+	if (!is_successful) {
+		HANDY_COUNTER_INCREMENT(("mds.canary.%d.%s.failed", group, name.c_str()));
+
+		MDS_LOG_ERROR("canary %s is failed: group=%d; spent-time=%lluus; error=%s"
+				, name.c_str(), group, static_cast<unsigned long long>(latency)
+				, error_info.message().c_str());
+	}
+
+	return is_successful;
+}
+
+void
+canary_prober_t::finish(group_t group) {
+	(void) group;
+
+	lock_guard_t lock_guard(mutex);
+
+	in_flight -= 1;
+	HANDY_GAUGE_SET("mds.canary.in_flight", in_flight);
+
+	in_flight_cv.notify_all();
+}
+
+} // namespace elliptics
+
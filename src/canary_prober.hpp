@@ -0,0 +1,146 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__CANARY_PROBER__HPP
+#define MDS_PROXY__SRC__CANARY_PROBER__HPP
+
+#include "loggers.hpp"
+#include "utils.hpp"
+#include "timer.hpp"
+#include "groups_health.hpp"
+#include "storage_scheduler.hpp"
+
+#include <elliptics/session.hpp>
+
+#include <boost/optional.hpp>
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <string>
+
+namespace elliptics {
+
+// Probes every couple known to mastermind in background with the reserved canary key.
+// Couples are probed one by one every 1/rate seconds, thus the load is spread evenly and
+// a round over all couples takes couples/rate seconds; the list of couples is refreshed
+// before every round. Every group of the couple is probed independently: the key is written
+// (if writes are enabled), looked up and read. Replies are reported to groups_health_t the way
+// replies of user requests are, hence groups are ranked even if users do not touch them.
+// A write rejected by a read-only or a full group is counted apart and does not affect the rank.
+class canary_prober_t {
+public:
+	struct config_t {
+		// Couples per second
+		double rate;
+		std::string key;
+		bool write;
+		// Couples are skipped while that many groups are being probed
+		size_t in_flight_limit;
+	};
+
+	typedef std::function<boost::optional<ioremap::elliptics::session> ()> session_function_t;
+	typedef std::function<std::vector<groups_t> ()> couples_function_t;
+
+	canary_prober_t(ioremap::swarm::logger bh_logger_, config_t config_
+			, couples_function_t couples_function_
+			, session_function_t read_session_function_
+			, session_function_t write_session_function_
+			, std::shared_ptr<groups_health_t> groups_health_
+			, storage_flow_t flow_);
+	~canary_prober_t();
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+
+	enum class operation_tag {
+		  write
+		, lookup
+		, read
+	};
+
+	typedef std::function<void (const ioremap::elliptics::error_info &)> reply_handler_t;
+	typedef std::function<void (ioremap::elliptics::session &, reply_handler_t)> command_t;
+
+	ioremap::swarm::logger &
+	logger();
+
+	static std::string
+	operation_name(operation_tag operation);
+
+	void
+	background_loop();
+
+	void
+	probe_next_couple();
+
+	void
+	probe_group(group_t group);
+
+	void
+	write(group_t group);
+
+	void
+	lookup(group_t group);
+
+	void
+	read(group_t group);
+
+	// Issues the command to the group through the flow, next is called if the reply
+	// is good enough to continue probing of the group
+	void
+	issue(group_t group, operation_tag operation, const session_function_t &session_function
+			, command_t command, std::function<void ()> next);
+
+	bool
+	report(group_t group, operation_tag operation, util::timer_t timer
+			, const ioremap::elliptics::error_info &error_info);
+
+	void
+	finish(group_t group);
+
+	ioremap::swarm::logger bh_logger;
+
+	config_t config;
+	couples_function_t couples_function;
+	session_function_t read_session_function;
+	session_function_t write_session_function;
+	std::shared_ptr<groups_health_t> groups_health;
+	storage_flow_t flow;
+
+	std::vector<groups_t> couples;
+	size_t next_couple;
+
+	mutex_t mutex;
+	size_t in_flight;
+	std::condition_variable in_flight_cv;
+
+	std::thread background_prober;
+	std::condition_variable background_prober_cv;
+	bool work_is_done;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__CANARY_PROBER__HPP */
+
@@ -0,0 +1,298 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "csum_migrator.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <sstream>
+#include <algorithm>
+#include <tuple>
+
+namespace elliptics {
+
+csum_migrator_t::csum_migrator_t(ioremap::swarm::logger bh_logger_, config_t config_
+		, session_function_t read_session_function_
+		, session_function_t write_session_function_
+		, storage_flow_t flow_)
+	: bh_logger(std::move(bh_logger_))
+	, config(std::move(config_))
+	, read_session_function(std::move(read_session_function_))
+	, write_session_function(std::move(write_session_function_))
+	, flow(std::move(flow_))
+	, limiter(std::make_shared<bandwidth_limiter_t>(config.rate, config.copier.chunk_size))
+	, in_flight(0)
+	, legacy_bytes(0)
+	, work_is_done(false)
+{
+}
+
+csum_migrator_t::~csum_migrator_t() {
+	MDS_LOG_INFO("stopping csum migrator");
+
+	lock_guard_t lock_guard(queue_mutex);
+
+	work_is_done = true;
+
+	for (auto it = queue.begin(), end = queue.end(); it != end; ++it) {
+		legacy_bytes -= (*it)->size;
+	}
+
+	queue.clear();
+
+	lock_guard.unlock();
+
+	// Copiers which wait for bandwidth are finished with failure
+	limiter->stop();
+
+	lock_guard.lock();
+
+	while (in_flight != 0) {
+		in_flight_cv.wait(lock_guard);
+	}
+
+	MDS_LOG_INFO("csum migrator is stopped");
+}
+
+bool
+csum_migrator_t::enqueue(couple_t couple, std::string key, size_t size, dnet_time timestamp) {
+	if (size == 0 || size < config.min_size) {
+		return false;
+	}
+
+	auto index = index_key(couple, key);
+
+	lock_guard_t lock_guard(queue_mutex);
+
+	if (work_is_done || queued_keys.count(index) != 0) {
+		return false;
+	}
+
+	if (queue.size() >= config.queue_size) {
+		lock_guard.unlock();
+
+		MDS_LOG_INFO("cannot queue record for migration: queue is full: key=%s", key.c_str());
+		HANDY_COUNTER_INCREMENT("mds.csum_migration.dropped");
+		return false;
+	}
+
+	auto migration = std::make_shared<migration_t>();
+	migration->couple = std::move(couple);
+	migration->key = std::move(key);
+	migration->size = size;
+	migration->timestamp = timestamp;
+
+	queued_keys.insert(std::move(index));
+	legacy_bytes += size;
+
+	MDS_LOG_INFO("record is queued for migration: key=%s; size=%llu"
+			, migration->key.c_str(), static_cast<unsigned long long>(size));
+
+	if (in_flight >= config.in_flight_limit) {
+		queue.emplace_back(std::move(migration));
+		update_stats();
+		return true;
+	}
+
+	in_flight += 1;
+	update_stats();
+
+	lock_guard.unlock();
+
+	start(std::move(migration));
+	return true;
+}
+
+size_t
+csum_migrator_t::remaining_bytes() const {
+	lock_guard_t lock_guard(queue_mutex);
+	return legacy_bytes;
+}
+
+ioremap::swarm::logger &
+csum_migrator_t::logger() {
+	return bh_logger;
+}
+
+std::string
+csum_migrator_t::index_key(const couple_t &couple, const std::string &key) {
+	std::ostringstream oss;
+	oss << *std::min_element(couple.begin(), couple.end()) << '/' << key;
+	return oss.str();
+}
+
+void
+csum_migrator_t::start(migration_ptr_t migration) {
+	auto session = read_session_function();
+
+	if (!session) {
+		finish(std::move(migration), result_tag::failed, "read-session is uninitialized");
+		return;
+	}
+
+	session->set_groups(migration->couple);
+	session->set_filter(ioremap::elliptics::filters::all);
+
+	flow.schedule([this, session, migration] (storage_scheduler_t::slot_ptr_t slot) mutable {
+		auto future = session->parallel_lookup(migration->key);
+
+		future.connect(hold_slot(std::move(slot), std::bind(&csum_migrator_t::on_lookup, this, migration
+						, std::placeholders::_1, std::placeholders::_2)));
+	});
+}
+
+void
+csum_migrator_t::on_lookup(migration_ptr_t migration
+		, const ioremap::elliptics::sync_lookup_result &entries
+		, const ioremap::elliptics::error_info &error_info) {
+	if (error_info && entries.empty()) {
+		finish(std::move(migration), result_tag::failed, error_info.message());
+		return;
+	}
+
+	size_t chunked_records = 0;
+	int source_group = 0;
+
+	for (auto it = entries.begin(), end = entries.end(); it != end; ++it) {
+		const int group_id = it->command()->id.group_id;
+
+		// Partially available record is left for the time all its replicas are alive
+		if (it->status() != 0) {
+			finish(std::move(migration), result_tag::skipped
+					, "record is unavailable in group " + std::to_string(group_id));
+			return;
+		}
+
+		const auto *file_info = it->file_info();
+		const auto &mtime = file_info->mtime;
+
+		if (std::make_tuple(mtime.tsec, mtime.tnsec)
+				!= std::make_tuple(migration->timestamp.tsec, migration->timestamp.tnsec)
+				|| file_info->size != migration->size) {
+			finish(std::move(migration), result_tag::skipped, "record was updated");
+			return;
+		}
+
+		if (file_info->record_flags & DNET_RECORD_FLAGS_CHUNKED_CSUM) {
+			chunked_records += 1;
+		}
+
+		if (source_group == 0) {
+			source_group = group_id;
+		}
+	}
+
+	if (entries.size() != migration->couple.size()) {
+		finish(std::move(migration), result_tag::skipped, "not all groups answered");
+		return;
+	}
+
+	if (chunked_records == entries.size()) {
+		finish(std::move(migration), result_tag::skipped, "record already has chunked csum");
+		return;
+	}
+
+	auto read_session = read_session_function();
+	auto write_session = write_session_function();
+
+	if (!read_session || !write_session) {
+		finish(std::move(migration), result_tag::failed, "session is uninitialized");
+		return;
+	}
+
+	auto copier = std::make_shared<record_copier_t>(
+			ioremap::swarm::logger(logger(), blackhole::log::attributes_t())
+			, config.copier, limiter
+			, *read_session, source_group
+			, *write_session, migration->couple
+			, migration->key, migration->size, migration->timestamp, false
+			, flow);
+
+	copier->start(std::bind(&csum_migrator_t::on_copied, this, migration
+				, std::placeholders::_1, std::placeholders::_2));
+}
+
+void
+csum_migrator_t::on_copied(migration_ptr_t migration, record_copier_t::result_tag result
+		, const std::string &description) {
+	switch (result) {
+	case record_copier_t::result_tag::copied:
+		HANDY_COUNTER_INCREMENT("mds.csum_migration.migrated_bytes", migration->size);
+		finish(std::move(migration), result_tag::migrated, description);
+		break;
+	case record_copier_t::result_tag::updated:
+		finish(std::move(migration), result_tag::skipped, description);
+		break;
+	case record_copier_t::result_tag::failed:
+		finish(std::move(migration), result_tag::failed, description);
+		break;
+	}
+}
+
+void
+csum_migrator_t::finish(migration_ptr_t migration, result_tag result
+		, const std::string &description) {
+	switch (result) {
+	case result_tag::migrated:
+		MDS_LOG_INFO("record is migrated: key=%s; size=%llu"
+				, migration->key.c_str(), static_cast<unsigned long long>(migration->size));
+		HANDY_COUNTER_INCREMENT("mds.csum_migration.migrated");
+		break;
+	case result_tag::skipped:
+		MDS_LOG_INFO("record migration is skipped: key=%s; reason=%s"
+				, migration->key.c_str(), description.c_str());
+		HANDY_COUNTER_INCREMENT("mds.csum_migration.skipped");
+		break;
+	case result_tag::failed:
+		MDS_LOG_ERROR("record migration is failed: key=%s; error=%s"
+				, migration->key.c_str(), description.c_str());
+		HANDY_COUNTER_INCREMENT("mds.csum_migration.failed");
+		break;
+	}
+
+	lock_guard_t lock_guard(queue_mutex);
+
+	queued_keys.erase(index_key(migration->couple, migration->key));
+	legacy_bytes -= migration->size;
+
+	if (work_is_done || queue.empty()) {
+		in_flight -= 1;
+		update_stats();
+		in_flight_cv.notify_all();
+		return;
+	}
+
+	auto next = std::move(queue.front());
+	queue.pop_front();
+	update_stats();
+
+	lock_guard.unlock();
+
+	start(std::move(next));
+}
+
+void
+csum_migrator_t::update_stats() {
+	HANDY_GAUGE_SET("mds.csum_migration.queue", queue.size());
+	HANDY_GAUGE_SET("mds.csum_migration.in_flight", in_flight);
+	HANDY_GAUGE_SET("mds.csum_migration.remaining_bytes", legacy_bytes);
+}
+
+} // namespace elliptics
+
@@ -0,0 +1,138 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__CSUM_MIGRATOR__HPP
+#define MDS_PROXY__SRC__CSUM_MIGRATOR__HPP
+
+#include "loggers.hpp"
+#include "utils.hpp"
+#include "record_copier.hpp"
+#include "bandwidth_limiter.hpp"
+
+#include <elliptics/session.hpp>
+
+#include <boost/optional.hpp>
+
+#include <deque>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <string>
+
+namespace elliptics {
+
+// Rewrites records which were written without chunked checksums.
+// Such records are checksummed as a whole on the first read, that makes time-to-first-byte
+// of big files unacceptable. Records are found by GET handler and are rewritten in background
+// by record_copier_t from one replica into all groups of the couple.
+// Reads are paced by the bandwidth limiter to limit the load on storage.
+class csum_migrator_t {
+public:
+	struct config_t {
+		size_t queue_size;
+		size_t min_size;
+		size_t rate;
+		size_t in_flight_limit;
+		record_copier_t::config_t copier;
+	};
+
+	typedef std::function<boost::optional<ioremap::elliptics::session> ()> session_function_t;
+
+	csum_migrator_t(ioremap::swarm::logger bh_logger_, config_t config_
+			, session_function_t read_session_function_
+			, session_function_t write_session_function_
+			, storage_flow_t flow_ = storage_flow_t());
+	~csum_migrator_t();
+
+	// Returns true if the record is queued for migration.
+	// The record is ignored if it is too small, if it is already queued or if the queue is full.
+	bool
+	enqueue(couple_t couple, std::string key, size_t size, dnet_time timestamp);
+
+	size_t
+	remaining_bytes() const;
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+
+	enum class result_tag {
+		  migrated
+		, skipped
+		, failed
+	};
+
+	struct migration_t {
+		couple_t couple;
+		std::string key;
+		size_t size;
+		dnet_time timestamp;
+	};
+
+	typedef std::shared_ptr<migration_t> migration_ptr_t;
+
+	ioremap::swarm::logger &
+	logger();
+
+	static std::string
+	index_key(const couple_t &couple, const std::string &key);
+
+	void
+	start(migration_ptr_t migration);
+
+	void
+	on_lookup(migration_ptr_t migration, const ioremap::elliptics::sync_lookup_result &entries
+			, const ioremap::elliptics::error_info &error_info);
+
+	void
+	on_copied(migration_ptr_t migration, record_copier_t::result_tag result
+			, const std::string &description);
+
+	void
+	finish(migration_ptr_t migration, result_tag result, const std::string &description);
+
+	void
+	update_stats();
+
+	ioremap::swarm::logger bh_logger;
+
+	config_t config;
+	session_function_t read_session_function;
+	session_function_t write_session_function;
+	storage_flow_t flow;
+
+	std::shared_ptr<bandwidth_limiter_t> limiter;
+
+	mutable mutex_t queue_mutex;
+	std::deque<migration_ptr_t> queue;
+	std::unordered_set<std::string> queued_keys;
+	size_t in_flight;
+	size_t legacy_bytes;
+
+	std::condition_variable in_flight_cv;
+
+	bool work_is_done;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__CSUM_MIGRATOR__HPP */
+
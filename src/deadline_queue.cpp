@@ -0,0 +1,96 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "deadline_queue.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <vector>
+
+namespace elliptics {
+
+deadline_queue_t::deadline_queue_t()
+	: work_is_done(false)
+{
+	background = std::thread(std::bind(&deadline_queue_t::background_loop, this));
+}
+
+deadline_queue_t::~deadline_queue_t() {
+	{
+		lock_guard_t lock_guard(mutex);
+		work_is_done = true;
+		background_cv.notify_one();
+	}
+
+	background.join();
+}
+
+void
+deadline_queue_t::add(clock_t::duration timeout, callback_t callback) {
+	auto deadline = clock_t::now() + timeout;
+
+	lock_guard_t lock_guard(mutex);
+
+	bool is_earliest = callbacks.empty() || deadline < callbacks.begin()->first;
+
+	callbacks.insert(std::make_pair(deadline, std::move(callback)));
+	HANDY_GAUGE_SET("mds.deadline_queue.size", callbacks.size());
+
+	if (is_earliest) {
+		background_cv.notify_one();
+	}
+}
+
+void
+deadline_queue_t::background_loop() {
+	lock_guard_t lock_guard(mutex);
+
+	while (!work_is_done) {
+		if (callbacks.empty()) {
+			background_cv.wait(lock_guard);
+			continue;
+		}
+
+		auto now = clock_t::now();
+
+		if (now < callbacks.begin()->first) {
+			background_cv.wait_until(lock_guard, callbacks.begin()->first);
+			continue;
+		}
+
+		std::vector<callback_t> expired;
+
+		for (auto it = callbacks.begin(); it != callbacks.end() && it->first <= now; ) {
+			expired.emplace_back(std::move(it->second));
+			it = callbacks.erase(it);
+		}
+
+		HANDY_GAUGE_SET("mds.deadline_queue.size", callbacks.size());
+
+		lock_guard.unlock();
+
+		for (auto it = expired.begin(), end = expired.end(); it != end; ++it) {
+			(*it)();
+		}
+
+		lock_guard.lock();
+	}
+}
+
+} // namespace elliptics
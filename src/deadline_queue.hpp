@@ -0,0 +1,64 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__DEADLINE_QUEUE__HPP
+#define MDS_PROXY__SRC__DEADLINE_QUEUE__HPP
+
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+
+namespace elliptics {
+
+// Calls callbacks at their deadlines from the background thread.
+// Callbacks are called one by one, hence they must be short and must not block.
+// Callbacks which are not called yet are dropped by the destructor.
+class deadline_queue_t {
+public:
+	typedef std::chrono::steady_clock clock_t;
+	typedef std::function<void ()> callback_t;
+
+	deadline_queue_t();
+	~deadline_queue_t();
+
+	void
+	add(clock_t::duration timeout, callback_t callback);
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+
+	void
+	background_loop();
+
+	mutex_t mutex;
+	std::multimap<clock_t::time_point, callback_t> callbacks;
+
+	std::thread background;
+	std::condition_variable background_cv;
+
+	bool work_is_done;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__DEADLINE_QUEUE__HPP */
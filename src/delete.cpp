@@ -39,6 +39,7 @@ void req_delete::on_request(const ioremap::thevoid::http_request &req, const boo
 			session->set_trace_bit(req.trace_bit());
 			session->set_trace_id(req.request_id());
 			key = std::get<1>(prep_session);
+			storage_flow = server()->storage_flow(ns_state);
 		} catch (const std::exception &ex) {
 			MDS_LOG_INFO("Delete: request = \"%s\", err = \"%s\"", url_str.c_str(), ex.what());
 			send_reply(400);
@@ -66,6 +67,29 @@ void req_delete::on_request(const ioremap::thevoid::http_request &req, const boo
 			throw std::runtime_error("Too low number of existing states");
 		}
 
+		server()->key_is_removing(session->get_groups(), key.remote());
+
+		if (req.url().query().has_item("async") && server()->delete_journal) {
+			MDS_LOG_INFO("Delete %s: journal delete to apply it asynchronously"
+					, url_str.c_str());
+
+			auto self = shared_from_this();
+			auto next = [this, self] (bool is_journaled) {
+				if (!is_journaled) {
+					MDS_LOG_ERROR("Delete request=\"%s\": cannot journal delete"
+							, url_str.c_str());
+					send_reply(500);
+					return;
+				}
+
+				send_reply(202);
+			};
+
+			server()->delete_journal->append(session->get_groups(), key.remote()
+					, std::move(next));
+			return;
+		}
+
 		session->set_timeout(server()->timeout.lookup);
 		session->set_filter(ioremap::elliptics::filters::positive);
 
@@ -73,9 +97,15 @@ void req_delete::on_request(const ioremap::thevoid::http_request &req, const boo
 			session->set_cflags(session->get_cflags() | DNET_FLAGS_NOLOCK);
 		}
 
-		auto alr = session->quorum_lookup(key);
-		alr.connect(wrap(std::bind(&req_delete::on_lookup,
-					shared_from_this(), std::placeholders::_1, std::placeholders::_2)));
+		auto self = shared_from_this();
+
+		storage_flow.schedule([this, self] (storage_scheduler_t::slot_ptr_t slot) {
+			auto alr = session->quorum_lookup(key);
+
+			// The slot is held until the key is looked up
+			alr.connect(hold_slot(std::move(slot), wrap(std::bind(&req_delete::on_lookup,
+						shared_from_this(), std::placeholders::_1, std::placeholders::_2))));
+		});
 	} catch (const std::exception &ex) {
 		MDS_LOG_ERROR("Delete request=\"%s\" error: %s"
 				, url_str.c_str(), ex.what());
@@ -107,10 +137,13 @@ void req_delete::on_lookup(const ioremap::elliptics::sync_lookup_result &slr, co
 			, url_str.c_str(), static_cast<int>(total_size));
 
 	auto next = std::bind(&req_delete::on_finished, shared_from_this(), std::placeholders::_1);
-	elliptics::remove(make_shared_logger(logger()), *session, key.remote(), std::move(next));
+	elliptics::remove(make_shared_logger(logger()), *session, key.remote(), storage_flow
+			, std::move(next));
 }
 
 void req_delete::on_finished(util::expected<remove_result_t> result) {
+	server()->key_is_removed(session->get_groups(), key.remote());
+
 	try {
 		auto remove_result = result.get();
 
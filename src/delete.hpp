@@ -37,6 +37,7 @@ private:
 	std::string url_str;
 	ioremap::elliptics::key key;
 	boost::optional<ioremap::elliptics::session> session;
+	storage_flow_t storage_flow;
 	size_t total_size;
 };
 
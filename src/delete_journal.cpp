@@ -0,0 +1,696 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "delete_journal.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdio>
+
+namespace elliptics {
+
+delete_journal_t::hold_t::hold_t(std::weak_ptr<delete_journal_t> journal_
+		, std::string record_key_, uint64_t end_id_)
+	: journal(std::move(journal_))
+	, record_key(std::move(record_key_))
+	, end_id(end_id_)
+{
+}
+
+delete_journal_t::hold_t::~hold_t() {
+	if (auto journal_ = journal.lock()) {
+		journal_->release(record_key);
+	}
+}
+
+delete_journal_t::delete_journal_t(ioremap::swarm::logger bh_logger_, config_t config_
+		, remove_function_t remove_function_)
+	: bh_logger(std::move(bh_logger_))
+	, config(std::move(config_))
+	, remove_function(std::move(remove_function_))
+	, journal_fd(-1)
+	, next_id(1)
+	, durable_id(1)
+	, in_flight(0)
+	, finished_since_compaction(0)
+	, work_is_done(false)
+{
+	replay();
+
+	// The journal is rewritten on start to drop records which were already applied
+	compact();
+
+	if (journal_fd < 0 && !(sync_directory() && open_journal())) {
+		throw std::runtime_error("cannot open delete journal: " + config.path);
+	}
+
+	MDS_LOG_INFO("starting background threads: pending deletes=%llu"
+			, static_cast<unsigned long long>(records.size()));
+
+	flusher = std::thread(std::bind(&delete_journal_t::flusher_loop, this));
+	worker = std::thread(std::bind(&delete_journal_t::worker_loop, this));
+}
+
+delete_journal_t::~delete_journal_t() {
+	MDS_LOG_INFO("stopping delete journal");
+
+	{
+		lock_guard_t lock_guard(records_mutex);
+
+		work_is_done = true;
+		flusher_cv.notify_one();
+		worker_cv.notify_one();
+	}
+
+	MDS_LOG_INFO("joining background threads");
+
+	if (worker.joinable()) {
+		worker.join();
+	}
+
+	if (flusher.joinable()) {
+		flusher.join();
+	}
+
+	if (journal_fd >= 0) {
+		::close(journal_fd);
+	}
+}
+
+void
+delete_journal_t::append(couple_t couple, std::string key, callback_t callback) {
+	std::sort(couple.begin(), couple.end());
+
+	lock_guard_t lock_guard(records_mutex);
+
+	if (work_is_done) {
+		lock_guard.unlock();
+		callback(false);
+		return;
+	}
+
+	auto index_key_ = index_key(couple, key);
+
+	{
+		auto it = records_index.find(index_key_);
+
+		// The new record replaces the previous one for the same key
+		if (it != records_index.end()) {
+			finish_record(it->second);
+		}
+	}
+
+	auto id = next_id++;
+
+	record_t record;
+	record.couple = std::move(couple);
+	record.key = std::move(key);
+	record.attempts = 0;
+	record.next_attempt = clock_t::now();
+	record.in_flight = false;
+
+	write_buffer += serialize_record(id, record);
+	write_callbacks.emplace_back(std::move(callback));
+
+	records.insert(std::make_pair(id, std::move(record)));
+	records_index[index_key_] = id;
+}
+
+bool
+delete_journal_t::is_pending(const couple_t &couple, const std::string &key) const {
+	auto sorted_couple = couple;
+	std::sort(sorted_couple.begin(), sorted_couple.end());
+
+	lock_guard_t lock_guard(records_mutex);
+
+	return records_index.count(index_key(sorted_couple, key)) != 0;
+}
+
+void
+delete_journal_t::hold(couple_t couple, const std::string &key, hold_callback_t callback) {
+	std::sort(couple.begin(), couple.end());
+
+	auto record_key = index_key(couple, key);
+
+	lock_guard_t lock_guard(records_mutex);
+
+	held_keys[record_key] += 1;
+
+	auto hold = std::make_shared<hold_t>(shared_from_this(), record_key, next_id);
+
+	{
+		auto it = removes_in_flight.find(record_key);
+
+		if (it != removes_in_flight.end()) {
+			MDS_LOG_INFO("wait for pending delete is applied: key=%s", key.c_str());
+			it->second.waiters.emplace_back([callback, hold] { callback(hold); });
+			return;
+		}
+	}
+
+	lock_guard.unlock();
+
+	callback(std::move(hold));
+}
+
+void
+delete_journal_t::cancel(const hold_ptr_t &hold, callback_t callback) {
+	lock_guard_t lock_guard(records_mutex);
+
+	auto it = records_index.find(hold->record_key);
+
+	// Deletes accepted after the upload was started are not cancelled
+	if (it == records_index.end() || hold->end_id <= it->second) {
+		lock_guard.unlock();
+		callback(true);
+		return;
+	}
+
+	if (work_is_done) {
+		lock_guard.unlock();
+		callback(false);
+		return;
+	}
+
+	MDS_LOG_INFO("cancel pending delete: id=%llu"
+			, static_cast<unsigned long long>(it->second));
+
+	// The delete must not be replayed after restart, thus the upload is reported
+	// only after the cancel record is synced
+	finish_record(it->second);
+	write_callbacks.emplace_back(std::move(callback));
+}
+
+size_t
+delete_journal_t::pending_count() const {
+	lock_guard_t lock_guard(records_mutex);
+
+	return records.size();
+}
+
+ioremap::swarm::logger &
+delete_journal_t::logger() {
+	return bh_logger;
+}
+
+std::string
+delete_journal_t::index_key(const couple_t &couple, const std::string &key) {
+	std::ostringstream oss;
+
+	for (auto it = couple.begin(), end = couple.end(); it != end; ++it) {
+		oss << *it << ',';
+	}
+
+	oss << '\t' << key;
+
+	return oss.str();
+}
+
+std::string
+delete_journal_t::serialize_record(uint64_t id, const record_t &record) {
+	std::ostringstream oss;
+
+	oss << '+' << id << '\t';
+
+	for (auto begin = record.couple.begin(), it = begin, end = record.couple.end()
+			; it != end; ++it) {
+		if (it != begin) {
+			oss << ',';
+		}
+
+		oss << *it;
+	}
+
+	oss << '\t' << record.key << '\n';
+
+	return oss.str();
+}
+
+void
+delete_journal_t::replay() {
+	std::ifstream input(config.path.c_str());
+
+	if (!input) {
+		MDS_LOG_INFO("delete journal does not exist, start with empty one: %s"
+				, config.path.c_str());
+		return;
+	}
+
+	size_t bad_records = 0;
+	std::string line;
+
+	while (std::getline(input, line)) {
+		if (line.empty()) {
+			continue;
+		}
+
+		try {
+			if (line[0] == '-') {
+				records.erase(boost::lexical_cast<uint64_t>(line.substr(1)));
+				continue;
+			}
+
+			if (line[0] != '+') {
+				throw std::runtime_error("unknown record type");
+			}
+
+			auto id_end = line.find('\t');
+			auto couple_end = line.find('\t', id_end + 1);
+
+			if (id_end == std::string::npos || couple_end == std::string::npos) {
+				throw std::runtime_error("record is truncated");
+			}
+
+			auto id = boost::lexical_cast<uint64_t>(line.substr(1, id_end - 1));
+
+			record_t record;
+			record.key = line.substr(couple_end + 1);
+			record.attempts = 0;
+			record.next_attempt = clock_t::now();
+			record.in_flight = false;
+
+			{
+				std::istringstream iss(line.substr(id_end + 1, couple_end - id_end - 1));
+				std::string group;
+
+				while (std::getline(iss, group, ',')) {
+					record.couple.emplace_back(boost::lexical_cast<int>(group));
+				}
+			}
+
+			if (record.couple.empty() || record.key.empty()) {
+				throw std::runtime_error("record has no couple or key");
+			}
+
+			std::sort(record.couple.begin(), record.couple.end());
+
+			next_id = std::max(next_id, id + 1);
+			records[id] = std::move(record);
+		} catch (const std::exception &ex) {
+			// The last record can be truncated if the process was killed during write
+			bad_records += 1;
+			MDS_LOG_ERROR("cannot parse delete journal record \"%s\": %s"
+					, line.c_str(), ex.what());
+		}
+	}
+
+	for (auto it = records.begin(), end = records.end(); it != end; ++it) {
+		records_index[index_key(it->second.couple, it->second.key)] = it->first;
+	}
+
+	durable_id = next_id;
+
+	MDS_LOG_INFO("delete journal is replayed: pending deletes=%llu; bad records=%llu"
+			, static_cast<unsigned long long>(records.size())
+			, static_cast<unsigned long long>(bad_records));
+}
+
+bool
+delete_journal_t::open_journal() {
+	int fd = ::open(config.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+	if (fd < 0) {
+		int err = errno;
+		MDS_LOG_ERROR("cannot open delete journal %s: %s", config.path.c_str(), strerror(err));
+		return false;
+	}
+
+	if (journal_fd >= 0) {
+		::close(journal_fd);
+	}
+
+	journal_fd = fd;
+	return true;
+}
+
+bool
+delete_journal_t::write_journal(int fd, const std::string &data) {
+	const char *ptr = data.data();
+	size_t size = data.size();
+
+	while (size != 0) {
+		auto written = ::write(fd, ptr, size);
+
+		if (written < 0) {
+			int err = errno;
+
+			if (err == EINTR) {
+				continue;
+			}
+
+			MDS_LOG_ERROR("cannot write delete journal: %s", strerror(err));
+			return false;
+		}
+
+		ptr += written;
+		size -= written;
+	}
+
+	if (::fdatasync(fd) != 0) {
+		int err = errno;
+		MDS_LOG_ERROR("cannot sync delete journal: %s", strerror(err));
+		return false;
+	}
+
+	return true;
+}
+
+bool
+delete_journal_t::sync_directory() {
+	auto pos = config.path.rfind('/');
+	auto path = pos == std::string::npos ? std::string(".")
+		: pos == 0 ? std::string("/") : config.path.substr(0, pos);
+
+	int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (fd < 0) {
+		int err = errno;
+		MDS_LOG_ERROR("cannot open delete journal directory %s: %s", path.c_str(), strerror(err));
+		return false;
+	}
+
+	if (::fsync(fd) != 0) {
+		int err = errno;
+		MDS_LOG_ERROR("cannot sync delete journal directory %s: %s", path.c_str(), strerror(err));
+		::close(fd);
+		return false;
+	}
+
+	::close(fd);
+	return true;
+}
+
+void
+delete_journal_t::compact() {
+	std::string data;
+
+	{
+		lock_guard_t lock_guard(records_mutex);
+
+		// Records which are not durable yet are in write_buffer
+		// and will be appended to the new file
+		for (auto it = records.begin(), end = records.lower_bound(durable_id); it != end; ++it) {
+			data += serialize_record(it->first, it->second);
+		}
+
+		finished_since_compaction = 0;
+	}
+
+	auto tmp_path = config.path + ".tmp";
+
+	int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (fd < 0) {
+		int err = errno;
+		MDS_LOG_ERROR("cannot compact delete journal: cannot open %s: %s"
+				, tmp_path.c_str(), strerror(err));
+		return;
+	}
+
+	if (!write_journal(fd, data)) {
+		::close(fd);
+		::unlink(tmp_path.c_str());
+		return;
+	}
+
+	::close(fd);
+
+	if (::rename(tmp_path.c_str(), config.path.c_str()) != 0) {
+		int err = errno;
+		MDS_LOG_ERROR("cannot compact delete journal: cannot rename %s: %s"
+				, tmp_path.c_str(), strerror(err));
+		::unlink(tmp_path.c_str());
+		return;
+	}
+
+	// The old file is unlinked: appends to it would be lost, hence batches fail
+	// until the next compaction succeeds
+	if (!sync_directory() || !open_journal()) {
+		if (journal_fd >= 0) {
+			::close(journal_fd);
+			journal_fd = -1;
+		}
+
+		return;
+	}
+
+	MDS_LOG_INFO("delete journal is compacted: size=%llu"
+			, static_cast<unsigned long long>(data.size()));
+}
+
+void
+delete_journal_t::finish_record(uint64_t id) {
+	auto it = records.find(id);
+
+	if (it == records.end()) {
+		return;
+	}
+
+	{
+		auto index_it = records_index.find(index_key(it->second.couple, it->second.key));
+
+		if (index_it != records_index.end() && index_it->second == id) {
+			records_index.erase(index_it);
+		}
+	}
+
+	records.erase(it);
+
+	write_buffer += '-' + boost::lexical_cast<std::string>(id) + '\n';
+	finished_since_compaction += 1;
+}
+
+void
+delete_journal_t::release(const std::string &record_key) {
+	lock_guard_t lock_guard(records_mutex);
+
+	auto it = held_keys.find(record_key);
+
+	if (it == held_keys.end()) {
+		return;
+	}
+
+	if (--it->second == 0) {
+		held_keys.erase(it);
+		worker_cv.notify_one();
+	}
+}
+
+void
+delete_journal_t::on_removed(uint64_t id, const std::string &record_key
+		, util::expected<remove_result_t> result) {
+	bool is_applied = false;
+
+	try {
+		is_applied = result.get().is_successful();
+	} catch (const std::exception &ex) {
+		MDS_LOG_ERROR("cannot apply delete: id=%llu; error=%s"
+				, static_cast<unsigned long long>(id), ex.what());
+	}
+
+	std::vector<std::function<void ()>> waiters;
+
+	{
+		lock_guard_t lock_guard(records_mutex);
+
+		in_flight -= 1;
+		worker_cv.notify_one();
+
+		auto it = removes_in_flight.find(record_key);
+
+		if (it != removes_in_flight.end() && --it->second.count == 0) {
+			waiters.swap(it->second.waiters);
+			removes_in_flight.erase(it);
+		}
+
+		process_remove_result(id, is_applied);
+	}
+
+	// Uploads of the key wait for the remove is finished
+	for (auto it = waiters.begin(), end = waiters.end(); it != end; ++it) {
+		(*it)();
+	}
+}
+
+void
+delete_journal_t::process_remove_result(uint64_t id, bool is_applied) {
+	auto it = records.find(id);
+
+	// The record was cancelled or replaced while remove was in flight
+	if (it == records.end()) {
+		return;
+	}
+
+	auto &record = it->second;
+	record.in_flight = false;
+
+	if (is_applied) {
+		MDS_LOG_INFO("delete is applied: key=%s; attempts=%llu", record.key.c_str()
+				, static_cast<unsigned long long>(record.attempts + 1));
+		finish_record(id);
+		return;
+	}
+
+	record.attempts += 1;
+
+	auto timeout = std::chrono::milliseconds(config.retry_min_timeout);
+	auto max_timeout = std::chrono::milliseconds(config.retry_max_timeout);
+
+	for (size_t index = 1; index < record.attempts && timeout < max_timeout; ++index) {
+		timeout *= 2;
+	}
+
+	timeout = std::min(timeout, max_timeout);
+	record.next_attempt = clock_t::now() + timeout;
+
+	MDS_LOG_INFO("delete will be retried: key=%s; attempts=%llu; timeout=%lldms"
+			, record.key.c_str(), static_cast<unsigned long long>(record.attempts)
+			, static_cast<long long>(timeout.count()));
+}
+
+void
+delete_journal_t::flusher_loop() {
+	lock_guard_t lock_guard(records_mutex);
+
+	do {
+		if (!work_is_done) {
+			flusher_cv.wait_for(lock_guard, std::chrono::milliseconds(config.fsync_period));
+		}
+
+		if (write_buffer.empty()) {
+			continue;
+		}
+
+		std::string data;
+		std::vector<callback_t> callbacks;
+
+		data.swap(write_buffer);
+		callbacks.swap(write_callbacks);
+
+		auto batch_end_id = next_id;
+
+		lock_guard.unlock();
+
+		bool is_written = journal_fd >= 0 && write_journal(journal_fd, data);
+
+		lock_guard.lock();
+
+		if (is_written) {
+			durable_id = batch_end_id;
+			worker_cv.notify_one();
+		} else {
+			// Deletes of the batch were not accepted, they must not be applied
+			for (auto it = records.lower_bound(durable_id)
+					; it != records.end() && it->first < batch_end_id; ) {
+				auto index_it = records_index.find(index_key(it->second.couple, it->second.key));
+
+				if (index_it != records_index.end() && index_it->second == it->first) {
+					records_index.erase(index_it);
+				}
+
+				it = records.erase(it);
+			}
+
+			durable_id = batch_end_id;
+		}
+
+		bool need_compaction = finished_since_compaction >= config.compaction_threshold;
+
+		lock_guard.unlock();
+
+		for (auto it = callbacks.begin(), end = callbacks.end(); it != end; ++it) {
+			(*it)(is_written);
+		}
+
+		if (need_compaction || journal_fd < 0) {
+			compact();
+		}
+
+		lock_guard.lock();
+	} while (!work_is_done || !write_buffer.empty());
+}
+
+void
+delete_journal_t::worker_loop() {
+	lock_guard_t lock_guard(records_mutex);
+
+	while (!work_is_done) {
+		std::vector<std::pair<uint64_t, record_t>> batch;
+
+		{
+			auto now = clock_t::now();
+
+			for (auto it = records.begin(), end = records.lower_bound(durable_id)
+					; it != end && in_flight < config.in_flight_limit; ++it) {
+				auto &record = it->second;
+
+				if (record.in_flight || now < record.next_attempt) {
+					continue;
+				}
+
+				auto record_key = index_key(record.couple, record.key);
+
+				// The key is being uploaded again, the delete waits for the upload result
+				if (held_keys.count(record_key) != 0) {
+					continue;
+				}
+
+				record.in_flight = true;
+				in_flight += 1;
+				removes_in_flight[record_key].count += 1;
+				batch.emplace_back(*it);
+			}
+		}
+
+		if (batch.empty()) {
+			worker_cv.wait_for(lock_guard, std::chrono::milliseconds(config.retry_min_timeout));
+			continue;
+		}
+
+		lock_guard.unlock();
+
+		for (auto it = batch.begin(), end = batch.end(); it != end; ++it) {
+			auto id = it->first;
+			auto record_key = index_key(it->second.couple, it->second.key);
+			auto next = [this, id, record_key] (util::expected<remove_result_t> result) {
+				on_removed(id, record_key, std::move(result));
+			};
+
+			remove_function(it->second.couple, it->second.key, std::move(next));
+		}
+
+		lock_guard.lock();
+	}
+
+	// Callbacks of removes which are in flight refer to this object
+	while (in_flight != 0) {
+		worker_cv.wait(lock_guard);
+	}
+}
+
+} // namespace elliptics
+
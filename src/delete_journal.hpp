@@ -0,0 +1,209 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__DELETE_JOURNAL__HPP
+#define MDS_PROXY__SRC__DELETE_JOURNAL__HPP
+
+#include "loggers.hpp"
+#include "remove.hpp"
+#include "expected.hpp"
+#include "utils.hpp"
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <string>
+
+namespace elliptics {
+
+// The journal of deletes which are accepted but are not applied yet.
+// Every delete is appended to the local file and is reported as accepted only after
+// the file is synced. Syncs are batched: all deletes appended during fsync-period
+// are covered by one fdatasync.
+// The file consists of two kinds of records:
+//     +<id>\t<group>,<group>,...\t<key>\n -- delete is accepted
+//     -<id>\n -- delete is applied or cancelled
+// The background worker applies removes with exponential backoff and the file is
+// compacted when the number of applied records reaches compaction-threshold.
+// An upload of the key holds its pending delete: the delete is not applied while the key
+// is written and is cancelled only after the upload is committed.
+class delete_journal_t : public std::enable_shared_from_this<delete_journal_t> {
+public:
+	struct config_t {
+		std::string path;
+		int fsync_period;
+		int retry_min_timeout;
+		int retry_max_timeout;
+		size_t in_flight_limit;
+		size_t compaction_threshold;
+	};
+
+	typedef std::function<void (bool)> callback_t;
+
+	// The pending delete of the key is not applied while the hold is alive
+	struct hold_t {
+		hold_t(std::weak_ptr<delete_journal_t> journal_, std::string record_key_
+				, uint64_t end_id_);
+		~hold_t();
+
+		std::weak_ptr<delete_journal_t> journal;
+		std::string record_key;
+		// Deletes with lesser ids were accepted before the upload was started
+		uint64_t end_id;
+	};
+
+	typedef std::shared_ptr<hold_t> hold_ptr_t;
+	typedef std::function<void (hold_ptr_t)> hold_callback_t;
+
+	typedef std::function<void (const couple_t &, const std::string &
+			, util::expected<remove_result_t>::callback_t)> remove_function_t;
+
+	delete_journal_t(ioremap::swarm::logger bh_logger_, config_t config_
+			, remove_function_t remove_function_);
+	~delete_journal_t();
+
+	// The callback is called with true after the record is synced to the disk
+	// and with false if the record cannot be written.
+	void
+	append(couple_t couple, std::string key, callback_t callback);
+
+	// Returns true if the delete of the key is accepted but is not applied yet.
+	bool
+	is_pending(const couple_t &couple, const std::string &key) const;
+
+	// Holds the pending delete of the key before the key is uploaded again.
+	// The callback is called after the remove of the key which is in flight is finished,
+	// so the remove cannot overwrite the upload.
+	void
+	hold(couple_t couple, const std::string &key, hold_callback_t callback);
+
+	// Cancels the held delete after the upload is committed. The callback is called with true
+	// after the cancel record is synced to the disk and with false if it cannot be written.
+	void
+	cancel(const hold_ptr_t &hold, callback_t callback);
+
+	size_t
+	pending_count() const;
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+	typedef std::chrono::steady_clock clock_t;
+
+	struct record_t {
+		couple_t couple;
+		std::string key;
+
+		size_t attempts;
+		clock_t::time_point next_attempt;
+
+		bool in_flight;
+	};
+
+	ioremap::swarm::logger &
+	logger();
+
+	static std::string
+	index_key(const couple_t &couple, const std::string &key);
+
+	static std::string
+	serialize_record(uint64_t id, const record_t &record);
+
+	void
+	replay();
+
+	bool
+	open_journal();
+
+	bool
+	write_journal(int fd, const std::string &data);
+
+	// Makes the rename of the journal durable
+	bool
+	sync_directory();
+
+	void
+	compact();
+
+	void
+	finish_record(uint64_t id);
+
+	void
+	release(const std::string &record_key);
+
+	void
+	on_removed(uint64_t id, const std::string &record_key
+			, util::expected<remove_result_t> result);
+
+	void
+	process_remove_result(uint64_t id, bool is_applied);
+
+	void
+	flusher_loop();
+
+	void
+	worker_loop();
+
+	ioremap::swarm::logger bh_logger;
+
+	config_t config;
+	remove_function_t remove_function;
+
+	int journal_fd;
+
+	mutable mutex_t records_mutex;
+	std::map<uint64_t, record_t> records;
+	std::unordered_map<std::string, uint64_t> records_index;
+	uint64_t next_id;
+	// Records with lesser ids are synced to the disk and can be applied
+	uint64_t durable_id;
+	size_t in_flight;
+	size_t finished_since_compaction;
+
+	struct removes_in_flight_t {
+		size_t count;
+		std::vector<std::function<void ()>> waiters;
+	};
+
+	// Keys which are uploaded and their number of holds
+	std::unordered_map<std::string, size_t> held_keys;
+	std::unordered_map<std::string, removes_in_flight_t> removes_in_flight;
+
+	std::string write_buffer;
+	std::vector<callback_t> write_callbacks;
+
+	std::thread flusher;
+	std::condition_variable flusher_cv;
+
+	std::thread worker;
+	std::condition_variable worker_cv;
+
+	bool work_is_done;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__DELETE_JOURNAL__HPP */
+
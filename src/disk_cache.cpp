@@ -0,0 +1,732 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "disk_cache.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <zlib.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+#include <random>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+namespace elliptics {
+
+namespace {
+
+const uint64_t superblock_magic = 0x4d44532d44534b31ULL;
+const uint64_t record_magic = 0x4d44532d52454331ULL;
+
+// Records are aligned to blocks, the first block is the superblock
+const uint64_t block_size = 4096;
+
+const size_t max_invalidations = 65536;
+
+struct superblock_t {
+	uint64_t magic;
+	uint64_t size;
+	uint32_t salt;
+	uint32_t checksum;
+};
+
+struct record_header_t {
+	uint64_t magic;
+	uint64_t sequence;
+	// Seconds since epoch, 0 means the record is a tombstone
+	uint64_t valid_until;
+	uint64_t tsec;
+	uint64_t tnsec;
+	uint32_t id_size;
+	uint32_t data_size;
+	// Checksum of the id and the data
+	uint32_t data_checksum;
+	// Checksum of the header with this field set to 0
+	uint32_t header_checksum;
+};
+
+uint64_t
+aligned(uint64_t size) {
+	return (size + block_size - 1) / block_size * block_size;
+}
+
+uint32_t
+checksum(uint32_t salt, const void *data, size_t size) {
+	auto crc = crc32(0L, reinterpret_cast<const Bytef *>(&salt), sizeof(salt));
+	return crc32(crc, reinterpret_cast<const Bytef *>(data), size);
+}
+
+uint32_t
+header_checksum(uint32_t salt, record_header_t header) {
+	header.header_checksum = 0;
+	return checksum(salt, &header, sizeof(header));
+}
+
+uint32_t
+superblock_checksum(superblock_t superblock) {
+	superblock.checksum = 0;
+	return checksum(0, &superblock, sizeof(superblock));
+}
+
+} // namespace
+
+disk_cache_t::disk_cache_t(ioremap::swarm::logger bh_logger_, config_t config_)
+	: bh_logger(std::move(bh_logger_))
+	, config(std::move(config_))
+	, fd(-1)
+	, salt(0)
+	, head(block_size)
+	, next_sequence(1)
+	, data_size(0)
+	, pending_writes(0)
+	, last_version(0)
+	, forgotten_version(0)
+	, work_is_done(false)
+{
+	config.size = config.size / block_size * block_size;
+
+	if (config.size < 2 * block_size) {
+		config.size = 0;
+	}
+
+	if (!is_enabled()) {
+		return;
+	}
+
+	config.threads = std::max<size_t>(config.threads, 1);
+
+	open_file();
+
+	MDS_LOG_INFO("disk cache is opened: path=%s; objects=%llu; size=%llu"
+			, config.path.c_str(), static_cast<unsigned long long>(entries.size())
+			, static_cast<unsigned long long>(data_size));
+	update_stats();
+
+	limiter = std::make_shared<bandwidth_limiter_t>(config.write_rate
+			, aligned(sizeof(record_header_t) + config.max_object_size + block_size));
+
+	for (size_t index = 0; index != config.threads; ++index) {
+		threads.emplace_back(std::bind(&disk_cache_t::background_loop, this));
+	}
+}
+
+disk_cache_t::~disk_cache_t() {
+	if (!is_enabled()) {
+		return;
+	}
+
+	MDS_LOG_INFO("stopping disk cache");
+
+	// Pending writes are dropped
+	limiter->stop();
+
+	{
+		lock_guard_t lock_guard(tasks_mutex);
+
+		work_is_done = true;
+		tasks_cv.notify_all();
+	}
+
+	for (auto it = threads.begin(), end = threads.end(); it != end; ++it) {
+		it->join();
+	}
+
+	close(fd);
+
+	MDS_LOG_INFO("disk cache is stopped");
+}
+
+bool
+disk_cache_t::is_enabled() const {
+	return config.size != 0;
+}
+
+const disk_cache_t::config_t &
+disk_cache_t::get_config() const {
+	return config;
+}
+
+bool
+disk_cache_t::get(const couple_t &couple, const std::string &key, callback_t callback) {
+	if (!is_enabled() || couple.empty()) {
+		return false;
+	}
+
+	auto id = make_id(couple, key);
+
+	lock_guard_t lock_guard(mutex);
+
+	auto it = entries.find(id);
+
+	if (it == entries.end() || !it->second.is_written) {
+		HANDY_COUNTER_INCREMENT("mds.disk_cache.miss");
+		return false;
+	}
+
+	if (it->second.valid_until <= clock_t::now()) {
+		erase(it);
+		update_stats();
+		HANDY_COUNTER_INCREMENT("mds.disk_cache.miss");
+		return false;
+	}
+
+	auto entry = it->second;
+
+	lock_guard.unlock();
+
+	enqueue(std::bind(&disk_cache_t::read_record, this, std::move(id), entry, std::move(callback)));
+	return true;
+}
+
+disk_cache_t::version_t
+disk_cache_t::version() {
+	lock_guard_t lock_guard(mutex);
+
+	return last_version;
+}
+
+void
+disk_cache_t::set(const couple_t &couple, const std::string &key
+		, const ioremap::elliptics::data_pointer &data, const dnet_time &timestamp
+		, version_t version_) {
+	if (!is_enabled() || couple.empty() || data.size() > config.max_object_size) {
+		return;
+	}
+
+	auto id = make_id(couple, key);
+	auto record_size = aligned(sizeof(record_header_t) + id.size() + data.size());
+
+	if (record_size > config.size - block_size) {
+		return;
+	}
+
+	{
+		lock_guard_t lock_guard(mutex);
+
+		if (is_invalidated(id, version_)) {
+			lock_guard.unlock();
+			HANDY_COUNTER_INCREMENT("mds.disk_cache.stale");
+			return;
+		}
+
+		auto it = entries.find(id);
+
+		// The same or a newer object is already cached
+		if (it != entries.end() && std::make_tuple(timestamp.tsec, timestamp.tnsec)
+				<= std::make_tuple(it->second.timestamp.tsec, it->second.timestamp.tnsec)) {
+			return;
+		}
+
+		if (pending_writes >= config.write_queue_size) {
+			lock_guard.unlock();
+			HANDY_COUNTER_INCREMENT("mds.disk_cache.dropped");
+			return;
+		}
+
+		pending_writes += 1;
+	}
+
+	auto record = ioremap::elliptics::data_pointer::allocate(record_size);
+	memset(record.data(), 0, record_size);
+
+	auto header = static_cast<record_header_t *>(record.data());
+	header->magic = record_magic;
+	header->valid_until = clock_t::to_time_t(clock_t::now() + std::chrono::seconds(config.ttl));
+	header->tsec = timestamp.tsec;
+	header->tnsec = timestamp.tnsec;
+	header->id_size = id.size();
+	header->data_size = data.size();
+
+	auto payload = static_cast<char *>(record.data()) + sizeof(record_header_t);
+	memcpy(payload, id.data(), id.size());
+	memcpy(payload + id.size(), data.data(), data.size());
+	header->data_checksum = checksum(salt, payload, id.size() + data.size());
+
+	limiter->acquire(record_size, [this, id, record, version_] (bool acquired) {
+			if (acquired) {
+				write_record(id, record, version_);
+			}
+
+			lock_guard_t lock_guard(mutex);
+			pending_writes -= 1;
+		});
+}
+
+void
+disk_cache_t::invalidate(const couple_t &couple, const std::string &key) {
+	if (!is_enabled() || couple.empty()) {
+		return;
+	}
+
+	auto id = make_id(couple, key);
+
+	version_t version_ = 0;
+
+	{
+		lock_guard_t lock_guard(mutex);
+
+		if (invalidations.size() >= max_invalidations) {
+			invalidations.clear();
+			forgotten_version = last_version;
+		}
+
+		// Writes of the key which are still queued are dropped
+		version_ = ++last_version;
+		invalidations[id] = version_;
+
+		auto it = entries.find(id);
+
+		if (it == entries.end()) {
+			return;
+		}
+
+		erase(it);
+		update_stats();
+	}
+
+	// The tombstone keeps the record from being restored by the index rebuild
+	auto record_size = aligned(sizeof(record_header_t) + id.size());
+	auto record = ioremap::elliptics::data_pointer::allocate(record_size);
+	memset(record.data(), 0, record_size);
+
+	auto header = static_cast<record_header_t *>(record.data());
+	header->magic = record_magic;
+	header->valid_until = 0;
+	header->id_size = id.size();
+
+	auto payload = static_cast<char *>(record.data()) + sizeof(record_header_t);
+	memcpy(payload, id.data(), id.size());
+	header->data_checksum = checksum(salt, payload, id.size());
+
+	enqueue(std::bind(&disk_cache_t::write_record, this, std::move(id), std::move(record)
+				, version_));
+}
+
+ioremap::swarm::logger &
+disk_cache_t::logger() {
+	return bh_logger;
+}
+
+std::string
+disk_cache_t::make_id(const couple_t &couple, const std::string &key) {
+	return std::to_string(*std::min_element(couple.begin(), couple.end())) + '/' + key;
+}
+
+void
+disk_cache_t::open_file() {
+	fd = open(config.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+	if (fd == -1) {
+		throw std::runtime_error("cannot open disk cache " + config.path + ": "
+				+ strerror(errno));
+	}
+
+	superblock_t superblock;
+
+	if (pread(fd, &superblock, sizeof(superblock), 0) == sizeof(superblock)
+			&& superblock.magic == superblock_magic
+			&& superblock.size == config.size
+			&& superblock.checksum == superblock_checksum(superblock)) {
+		salt = superblock.salt;
+		rebuild_index();
+		return;
+	}
+
+	// The new salt invalidates all records which may be left in the file
+	MDS_LOG_INFO("disk cache is initialized: path=%s", config.path.c_str());
+
+	if (ftruncate(fd, config.size) == -1) {
+		throw std::runtime_error("cannot resize disk cache " + config.path + ": "
+				+ strerror(errno));
+	}
+
+	std::random_device random_device;
+
+	memset(&superblock, 0, sizeof(superblock));
+	superblock.magic = superblock_magic;
+	superblock.size = config.size;
+	superblock.salt = random_device();
+	superblock.checksum = superblock_checksum(superblock);
+
+	if (pwrite(fd, &superblock, sizeof(superblock), 0) != sizeof(superblock)
+			|| fdatasync(fd) == -1) {
+		throw std::runtime_error("cannot write disk cache superblock " + config.path + ": "
+				+ strerror(errno));
+	}
+
+	salt = superblock.salt;
+}
+
+void
+disk_cache_t::rebuild_index() {
+	auto now = clock_t::now();
+	auto started = std::chrono::steady_clock::now();
+
+	// Scan goes in the order of offsets, hence tombstones can be met after the records they remove
+	std::unordered_map<std::string, uint64_t> tombstones;
+
+	uint64_t offset = block_size;
+
+	while (offset + block_size <= config.size) {
+		record_header_t header;
+
+		if (pread(fd, &header, sizeof(header), offset) != sizeof(header)) {
+			break;
+		}
+
+		auto record_size = aligned(sizeof(header)
+				+ static_cast<uint64_t>(header.id_size) + header.data_size);
+
+		if (header.magic != record_magic
+				|| header.header_checksum != header_checksum(salt, header)
+				|| offset + record_size > config.size) {
+			offset += block_size;
+			continue;
+		}
+
+		std::string id(header.id_size, '\0');
+
+		if (pread(fd, &id[0], id.size(), offset + sizeof(header))
+				!= static_cast<ssize_t>(id.size())) {
+			offset += block_size;
+			continue;
+		}
+
+		auto record_offset = offset;
+		offset += record_size;
+
+		if (header.sequence >= next_sequence) {
+			next_sequence = header.sequence + 1;
+			head = offset;
+		}
+
+		auto it = entries.find(id);
+
+		if (header.valid_until == 0) {
+			auto &sequence = tombstones[id];
+			sequence = std::max(sequence, header.sequence);
+
+			if (it != entries.end() && it->second.sequence < header.sequence) {
+				erase(it);
+			}
+
+			continue;
+		}
+
+		auto tit = tombstones.find(id);
+
+		if (tit != tombstones.end() && tit->second > header.sequence) {
+			continue;
+		}
+
+		if (it != entries.end()) {
+			if (it->second.sequence > header.sequence) {
+				continue;
+			}
+
+			erase(it);
+		}
+
+		auto valid_until = clock_t::from_time_t(header.valid_until);
+
+		if (valid_until <= now) {
+			continue;
+		}
+
+		entry_t entry;
+		entry.offset = record_offset;
+		entry.size = record_size;
+		entry.sequence = header.sequence;
+		entry.valid_until = valid_until;
+		entry.timestamp.tsec = header.tsec;
+		entry.timestamp.tnsec = header.tnsec;
+		entry.is_written = true;
+
+		offsets[record_offset] = id;
+		data_size += record_size;
+		entries.insert(std::make_pair(std::move(id), entry));
+	}
+
+	if (head + block_size > config.size) {
+		head = block_size;
+	}
+
+	auto spent_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - started).count();
+
+	MDS_LOG_INFO("disk cache index is rebuilt: objects=%llu; spent-time=%lldms"
+			, static_cast<unsigned long long>(entries.size()), static_cast<long long>(spent_time));
+}
+
+bool
+disk_cache_t::is_invalidated(const std::string &id, version_t version_) const {
+	if (version_ < forgotten_version) {
+		return true;
+	}
+
+	auto it = invalidations.find(id);
+
+	return it != invalidations.end() && version_ < it->second;
+}
+
+void
+disk_cache_t::write_record(std::string id, ioremap::elliptics::data_pointer record
+		, version_t version_) {
+	auto header = static_cast<record_header_t *>(record.data());
+	uint64_t offset = 0;
+	std::pair<uint64_t, uint64_t> tail;
+
+	{
+		lock_guard_t lock_guard(mutex);
+
+		// The key was invalidated while the write was queued
+		if (header->valid_until != 0 && is_invalidated(id, version_)) {
+			lock_guard.unlock();
+			HANDY_COUNTER_INCREMENT("mds.disk_cache.stale");
+			return;
+		}
+
+		offset = allocate(record.size(), tail);
+
+		header->sequence = next_sequence++;
+		header->header_checksum = header_checksum(salt, *header);
+
+		if (header->valid_until != 0) {
+			auto it = entries.find(id);
+
+			if (it != entries.end()) {
+				erase(it);
+			}
+
+			entry_t entry;
+			entry.offset = offset;
+			entry.size = record.size();
+			entry.sequence = header->sequence;
+			entry.valid_until = clock_t::from_time_t(header->valid_until);
+			entry.timestamp.tsec = header->tsec;
+			entry.timestamp.tnsec = header->tnsec;
+			entry.is_written = false;
+
+			offsets[offset] = id;
+			data_size += record.size();
+			entries.insert(std::make_pair(id, entry));
+		}
+	}
+
+	if (tail.second != 0) {
+		std::vector<char> zeros(tail.second, 0);
+
+		if (pwrite(fd, zeros.data(), zeros.size(), tail.first)
+				!= static_cast<ssize_t>(zeros.size())) {
+			MDS_LOG_ERROR("cannot wipe the tail of disk cache: offset=%llu; size=%llu; error=%s"
+					, static_cast<unsigned long long>(tail.first)
+					, static_cast<unsigned long long>(tail.second), strerror(errno));
+			HANDY_COUNTER_INCREMENT("mds.disk_cache.write_failed");
+		}
+	}
+
+	auto written = pwrite(fd, record.data(), record.size(), offset);
+	auto error = errno;
+
+	lock_guard_t lock_guard(mutex);
+
+	auto it = entries.find(id);
+	bool is_current = it != entries.end() && it->second.sequence == header->sequence;
+
+	if (written != static_cast<ssize_t>(record.size())) {
+		if (is_current) {
+			erase(it);
+		}
+
+		update_stats();
+		lock_guard.unlock();
+
+		MDS_LOG_ERROR("cannot write to disk cache: id=%s; error=%s"
+				, id.c_str(), written == -1 ? strerror(error) : "short write");
+		HANDY_COUNTER_INCREMENT("mds.disk_cache.write_failed");
+		return;
+	}
+
+	if (is_current) {
+		it->second.is_written = true;
+	}
+
+	update_stats();
+	lock_guard.unlock();
+
+	HANDY_COUNTER_INCREMENT("mds.disk_cache.written");
+	HANDY_COUNTER_INCREMENT("mds.disk_cache.written_bytes", record.size());
+}
+
+void
+disk_cache_t::read_record(std::string id, entry_t entry, callback_t callback) {
+	auto record = ioremap::elliptics::data_pointer::allocate(entry.size);
+	auto read = pread(fd, record.data(), entry.size, entry.offset);
+
+	object_ptr_t object;
+
+	// The record might be overwritten after the index was looked up
+	if (read == static_cast<ssize_t>(entry.size)) {
+		const auto &header = *static_cast<const record_header_t *>(record.data());
+		auto payload = static_cast<const char *>(record.data()) + sizeof(record_header_t);
+		auto payload_size = static_cast<uint64_t>(header.id_size) + header.data_size;
+
+		if (header.magic == record_magic && header.sequence == entry.sequence
+				&& header.header_checksum == header_checksum(salt, header)
+				&& header.id_size == id.size()
+				&& sizeof(record_header_t) + payload_size <= entry.size
+				&& memcmp(payload, id.data(), id.size()) == 0
+				&& header.data_checksum == checksum(salt, payload, payload_size)) {
+			auto result = std::make_shared<object_t>();
+			result->data = record.slice(sizeof(record_header_t) + id.size(), header.data_size);
+			result->timestamp = entry.timestamp;
+			object = std::move(result);
+		}
+	}
+
+	if (object) {
+		HANDY_COUNTER_INCREMENT("mds.disk_cache.hit");
+	} else {
+		MDS_LOG_ERROR("cannot read record from disk cache: id=%s", id.c_str());
+		HANDY_COUNTER_INCREMENT("mds.disk_cache.corrupted");
+
+		lock_guard_t lock_guard(mutex);
+
+		auto it = entries.find(id);
+
+		if (it != entries.end() && it->second.sequence == entry.sequence) {
+			erase(it);
+			update_stats();
+		}
+	}
+
+	callback(std::move(object));
+}
+
+uint64_t
+disk_cache_t::allocate(uint64_t size, std::pair<uint64_t, uint64_t> &tail) {
+	tail = std::make_pair(head, 0);
+
+	// Records of the tail are older than the records which are written from the beginning.
+	// The tail is wiped to keep the log FIFO: otherwise a tombstone could be overwritten
+	// by the next pass before the record it removes, and the index rebuild would restore it
+	if (head + size > config.size) {
+		tail.second = config.size - head;
+
+		for (auto it = offsets.lower_bound(head); it != offsets.end(); ) {
+			auto next = std::next(it);
+			auto eit = entries.find(it->second);
+
+			if (eit != entries.end()) {
+				erase(eit);
+			} else {
+				offsets.erase(it);
+			}
+
+			it = next;
+		}
+
+		head = block_size;
+	}
+
+	auto begin = head;
+	auto end = head + size;
+
+	auto it = offsets.lower_bound(begin);
+
+	// The preceding record may overlap the beginning
+	if (it != offsets.begin()) {
+		auto prev = std::prev(it);
+		auto eit = entries.find(prev->second);
+
+		if (eit != entries.end() && eit->second.offset + eit->second.size > begin) {
+			erase(eit);
+		}
+	}
+
+	while (it != offsets.end() && it->first < end) {
+		auto next = std::next(it);
+		auto eit = entries.find(it->second);
+
+		if (eit != entries.end()) {
+			erase(eit);
+		} else {
+			offsets.erase(it);
+		}
+
+		it = next;
+	}
+
+	head = end;
+	return begin;
+}
+
+void
+disk_cache_t::erase(entries_t::iterator it) {
+	offsets.erase(it->second.offset);
+	data_size -= it->second.size;
+	entries.erase(it);
+}
+
+void
+disk_cache_t::enqueue(std::function<void ()> task) {
+	lock_guard_t lock_guard(tasks_mutex);
+
+	tasks.emplace_back(std::move(task));
+	tasks_cv.notify_one();
+}
+
+void
+disk_cache_t::background_loop() {
+	lock_guard_t lock_guard(tasks_mutex);
+
+	// Queued tasks are run before stop, callers wait for them
+	while (!work_is_done || !tasks.empty()) {
+		if (tasks.empty()) {
+			tasks_cv.wait(lock_guard);
+			continue;
+		}
+
+		auto task = std::move(tasks.front());
+		tasks.pop_front();
+
+		lock_guard.unlock();
+		task();
+		lock_guard.lock();
+	}
+}
+
+void
+disk_cache_t::update_stats() {
+	HANDY_GAUGE_SET("mds.disk_cache.objects", entries.size());
+	HANDY_GAUGE_SET("mds.disk_cache.size", data_size);
+	HANDY_GAUGE_SET("mds.disk_cache.pending_writes", pending_writes);
+}
+
+} // namespace elliptics
@@ -0,0 +1,202 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef MDS_PROXY__SRC__DISK_CACHE__HPP
+#define MDS_PROXY__SRC__DISK_CACHE__HPP
+
+#include "loggers.hpp"
+#include "utils.hpp"
+#include "hot_object_cache.hpp"
+#include "bandwidth_limiter.hpp"
+
+#include <elliptics/session.hpp>
+
+#include <unordered_map>
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <string>
+
+namespace elliptics {
+
+// Second-level cache of hot objects on local disk, the tier below hot_object_cache_t.
+// The cache file is a circular log of records (header, id, data) aligned to blocks,
+// the index of live records is kept in memory. A new record overwrites the oldest ones,
+// hence eviction is FIFO and writes are sequential. Invalidation appends a tombstone.
+// The index is rebuilt at startup by scanning record headers only, the data is verified
+// by checksum when it is read. Checksums are seeded by the random salt of the file,
+// therefore cached user data cannot be taken for a record.
+// Reads and tombstones are run by the cache's threads, the callers are never blocked.
+// Writes of objects are paced by write-rate to save the drive's endurance, they are run
+// by the thread of bandwidth_limiter_t and are dropped if too many of them are pending.
+// A write is dropped as well if the key was invalidated after the object was read.
+class disk_cache_t {
+public:
+	struct config_t {
+		std::string path;
+		// Size of the cache file, bytes
+		size_t size;
+		// Objects which are larger are never cached, bytes
+		size_t max_object_size;
+		// Lifetime of an object, seconds
+		int ttl;
+		// The decayed number of requests of the key (see hot_keys_t) to write it to disk
+		double admission_threshold;
+		// Bytes per second
+		size_t write_rate;
+		size_t write_queue_size;
+		size_t threads;
+	};
+
+	typedef hot_object_cache_t::object_t object_t;
+	typedef hot_object_cache_t::object_ptr_t object_ptr_t;
+
+	// The object is null if it cannot be read
+	typedef std::function<void (object_ptr_t)> callback_t;
+
+	// Is taken before the object is read and is passed to set
+	typedef uint64_t version_t;
+
+	// Throws std::runtime_error if the cache file cannot be opened
+	disk_cache_t(ioremap::swarm::logger bh_logger_, config_t config_);
+	~disk_cache_t();
+
+	bool
+	is_enabled() const;
+
+	const config_t &
+	get_config() const;
+
+	// Returns false if the object is not cached, otherwise the object is read
+	// and the callback is called from the cache's thread
+	bool
+	get(const couple_t &couple, const std::string &key, callback_t callback);
+
+	version_t
+	version();
+
+	void
+	set(const couple_t &couple, const std::string &key
+			, const ioremap::elliptics::data_pointer &data, const dnet_time &timestamp
+			, version_t version_);
+
+	void
+	invalidate(const couple_t &couple, const std::string &key);
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+	typedef std::chrono::system_clock clock_t;
+
+	struct entry_t {
+		uint64_t offset;
+		uint64_t size;
+		uint64_t sequence;
+		clock_t::time_point valid_until;
+		dnet_time timestamp;
+		// The record is being written and cannot be read yet
+		bool is_written;
+	};
+
+	typedef std::unordered_map<std::string, entry_t> entries_t;
+
+	ioremap::swarm::logger &
+	logger();
+
+	static std::string
+	make_id(const couple_t &couple, const std::string &key);
+
+	void
+	open_file();
+
+	void
+	rebuild_index();
+
+	// The record buffer contains the header followed by the id and the data,
+	// the sequence and the header checksum are filled in by the method.
+	// The object record is dropped if the key was invalidated after the version
+	void
+	write_record(std::string id, ioremap::elliptics::data_pointer record, version_t version_);
+
+	// The mutex must be locked
+	bool
+	is_invalidated(const std::string &id, version_t version_) const;
+
+	void
+	read_record(std::string id, entry_t entry, callback_t callback);
+
+	// Returns the offset of the record, the records which are overwritten are dropped.
+	// On wrap the tail of the file is dropped too and its range is returned in tail,
+	// the tail must be wiped before the record is written
+	uint64_t
+	allocate(uint64_t size, std::pair<uint64_t, uint64_t> &tail);
+
+	void
+	erase(entries_t::iterator it);
+
+	void
+	enqueue(std::function<void ()> task);
+
+	void
+	background_loop();
+
+	void
+	update_stats();
+
+	ioremap::swarm::logger bh_logger;
+	config_t config;
+
+	int fd;
+	uint32_t salt;
+
+	mutex_t mutex;
+	entries_t entries;
+	// Offsets of records of the index, used to drop overwritten records
+	std::map<uint64_t, std::string> offsets;
+	uint64_t head;
+	uint64_t next_sequence;
+	size_t data_size;
+	size_t pending_writes;
+
+	// Versions of the last invalidations of keys. Invalidations are forgotten when there are
+	// too many of them, objects read before that are dropped
+	std::unordered_map<std::string, version_t> invalidations;
+	version_t last_version;
+	version_t forgotten_version;
+
+	std::shared_ptr<bandwidth_limiter_t> limiter;
+
+	mutex_t tasks_mutex;
+	std::deque<std::function<void ()>> tasks;
+	std::condition_variable tasks_cv;
+	std::vector<std::thread> threads;
+	bool work_is_done;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__DISK_CACHE__HPP */
+
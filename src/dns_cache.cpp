@@ -0,0 +1,308 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "dns_cache.hpp"
+#include "timer.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <netdb.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace elliptics {
+
+dns_cache_t::dns_cache_t(ioremap::swarm::logger bh_logger_, config_t config_)
+	: bh_logger(std::move(bh_logger_))
+	, config(std::move(config_))
+	, work_is_done(false)
+{
+	config.refresh_period = std::max(config.refresh_period, 1);
+
+	MDS_LOG_INFO("starting background thread");
+	background_resolver = std::thread(std::bind(&dns_cache_t::background_loop, this));
+}
+
+dns_cache_t::~dns_cache_t() {
+	MDS_LOG_INFO("stopping dns cache");
+
+	{
+		lock_guard_t lock_guard(mutex);
+
+		work_is_done = true;
+		background_resolver_cv.notify_one();
+	}
+
+	MDS_LOG_INFO("joining background thread");
+	background_resolver.join();
+}
+
+std::string
+dns_cache_t::get_hostname(const dnet_addr &addr) {
+	address_t address;
+	memset(&address, 0, sizeof(address));
+	address.size = std::min<socklen_t>(addr.addr_len, sizeof(address.storage));
+	memcpy(&address.storage, addr.addr, address.size);
+
+	auto numeric = numeric_host(address);
+
+	lock_guard_t lock_guard(mutex);
+
+	{
+		auto it = entries.find(numeric);
+
+		if (it != entries.end()) {
+			auto &entry = it->second;
+
+			if (entry.valid_until <= clock_t::now()) {
+				HANDY_COUNTER_INCREMENT("mds.dns_cache.stale");
+
+				if (!entry.refresh_is_queued) {
+					entry.refresh_is_queued = true;
+					queued_refreshes.emplace_back(numeric);
+					background_resolver_cv.notify_one();
+				}
+			} else {
+				HANDY_COUNTER_INCREMENT("mds.dns_cache.hit");
+			}
+
+			return entry.hostname;
+		}
+	}
+
+	// The stale entry keeps concurrent misses of the address from queueing it again
+	entry_t entry;
+	entry.address = address;
+	entry.hostname = numeric;
+	entry.is_resolved = false;
+	entry.valid_until = clock_t::now();
+	entry.refresh_is_queued = true;
+
+	entries[numeric] = std::move(entry);
+	queued_refreshes.emplace_back(numeric);
+	background_resolver_cv.notify_one();
+	update_stats();
+
+	lock_guard.unlock();
+
+	HANDY_COUNTER_INCREMENT("mds.dns_cache.miss");
+	MDS_LOG_INFO("address is not in dns cache, it is resolved in background: address=%s"
+			, numeric.c_str());
+
+	return numeric;
+}
+
+void
+dns_cache_t::prefetch(const std::vector<std::string> &remotes) {
+	lock_guard_t lock_guard(mutex);
+
+	queued_remotes.insert(remotes.begin(), remotes.end());
+	background_resolver_cv.notify_one();
+}
+
+ioremap::swarm::logger &
+dns_cache_t::logger() {
+	return bh_logger;
+}
+
+std::string
+dns_cache_t::numeric_host(const address_t &address) {
+	char host[NI_MAXHOST];
+	memset(host, 0, sizeof(host));
+
+	auto res = getnameinfo(reinterpret_cast<const sockaddr *>(&address.storage), address.size
+			, host, sizeof(host), NULL, 0, NI_NUMERICHOST);
+
+	if (res != 0) {
+		throw std::runtime_error(std::string("bad storage address: ") + gai_strerror(res));
+	}
+
+	return host;
+}
+
+std::pair<std::string, bool>
+dns_cache_t::resolve(const address_t &address, const std::string &numeric) {
+	char host[NI_MAXHOST];
+	memset(host, 0, sizeof(host));
+
+	util::timer_t timer;
+	auto res = getnameinfo(reinterpret_cast<const sockaddr *>(&address.storage), address.size
+			, host, sizeof(host), NULL, 0, NI_NAMEREQD);
+	auto spent_time = timer.get_us();
+
+	HANDY_GAUGE_SET("mds.dns_cache.resolve_time_us", spent_time);
+
+	if (res != 0) {
+		MDS_LOG_ERROR("cannot resolve address: address=%s; error=%s; spent-time=%lldus"
+				, numeric.c_str(), gai_strerror(res), static_cast<long long>(spent_time));
+		HANDY_COUNTER_INCREMENT("mds.dns_cache.failed");
+		return std::make_pair(numeric, false);
+	}
+
+	MDS_LOG_INFO("address is resolved: address=%s; host=%s; spent-time=%lldus"
+			, numeric.c_str(), host, static_cast<long long>(spent_time));
+	return std::make_pair(std::string(host), true);
+}
+
+void
+dns_cache_t::store(const std::string &numeric, const address_t &address
+		, const std::pair<std::string, bool> &result) {
+	entry_t entry;
+	entry.address = address;
+	entry.hostname = result.first;
+	entry.is_resolved = result.second;
+	entry.valid_until = clock_t::now() + std::chrono::seconds(
+			result.second ? config.positive_ttl : config.negative_ttl);
+	entry.refresh_is_queued = false;
+
+	lock_guard_t lock_guard(mutex);
+
+	auto it = entries.find(numeric);
+
+	// The name which was resolved before is kept while the resolver fails
+	if (it != entries.end() && it->second.is_resolved && !entry.is_resolved) {
+		entry.hostname = it->second.hostname;
+	}
+
+	entries[numeric] = std::move(entry);
+	update_stats();
+}
+
+void
+dns_cache_t::resolve_remote(const std::string &remote) {
+	// host:port:family, host may be an IPv6 address which contains colons
+	auto family_pos = remote.rfind(':');
+	auto port_pos = family_pos == std::string::npos || family_pos == 0
+		? std::string::npos : remote.rfind(':', family_pos - 1);
+
+	if (port_pos == std::string::npos) {
+		MDS_LOG_ERROR("cannot parse elliptics remote: remote=%s", remote.c_str());
+		return;
+	}
+
+	auto host = remote.substr(0, port_pos);
+	auto port = remote.substr(port_pos + 1, family_pos - port_pos - 1);
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = std::atoi(remote.c_str() + family_pos + 1);
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo *result = nullptr;
+	auto res = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+
+	if (res != 0) {
+		MDS_LOG_ERROR("cannot resolve elliptics remote: remote=%s; error=%s"
+				, remote.c_str(), gai_strerror(res));
+		return;
+	}
+
+	for (auto it = result; it; it = it->ai_next) {
+		address_t address;
+		memset(&address, 0, sizeof(address));
+		address.size = std::min<socklen_t>(it->ai_addrlen, sizeof(address.storage));
+		memcpy(&address.storage, it->ai_addr, address.size);
+
+		try {
+			auto numeric = numeric_host(address);
+
+			{
+				lock_guard_t lock_guard(mutex);
+
+				auto eit = entries.find(numeric);
+
+				// The background refresh takes care of known addresses
+				if (eit != entries.end()) {
+					continue;
+				}
+			}
+
+			store(numeric, address, resolve(address, numeric));
+		} catch (const std::exception &ex) {
+			MDS_LOG_ERROR("cannot cache elliptics remote: remote=%s; error=%s"
+					, remote.c_str(), ex.what());
+		}
+	}
+
+	freeaddrinfo(result);
+}
+
+void
+dns_cache_t::background_loop() {
+	lock_guard_t lock_guard(mutex);
+
+	while (!work_is_done) {
+		if (queued_remotes.empty() && queued_refreshes.empty()) {
+			background_resolver_cv.wait_for(lock_guard, std::chrono::seconds(config.refresh_period));
+		}
+
+		if (work_is_done) {
+			break;
+		}
+
+		std::unordered_set<std::string> remotes;
+		remotes.swap(queued_remotes);
+
+		// Entries which expire before the next iteration are refreshed in advance
+		// to answer requests with fresh names
+		auto deadline = clock_t::now() + std::chrono::seconds(config.refresh_period);
+
+		for (auto it = entries.begin(), end = entries.end(); it != end; ++it) {
+			if (!it->second.refresh_is_queued && it->second.valid_until <= deadline) {
+				it->second.refresh_is_queued = true;
+				queued_refreshes.emplace_back(it->first);
+			}
+		}
+
+		std::vector<std::pair<std::string, address_t>> refreshes;
+
+		for (auto it = queued_refreshes.begin(), end = queued_refreshes.end(); it != end; ++it) {
+			auto eit = entries.find(*it);
+
+			if (eit != entries.end()) {
+				refreshes.emplace_back(*it, eit->second.address);
+			}
+		}
+
+		queued_refreshes.clear();
+
+		lock_guard.unlock();
+
+		for (auto it = remotes.begin(), end = remotes.end(); it != end; ++it) {
+			resolve_remote(*it);
+		}
+
+		for (auto it = refreshes.begin(), end = refreshes.end(); it != end; ++it) {
+			store(it->first, it->second, resolve(it->second, it->first));
+		}
+
+		lock_guard.lock();
+	}
+}
+
+void
+dns_cache_t::update_stats() {
+	HANDY_GAUGE_SET("mds.dns_cache.entries", entries.size());
+}
+
+} // namespace elliptics
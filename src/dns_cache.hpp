@@ -0,0 +1,128 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef MDS_PROXY__SRC__DNS_CACHE__HPP
+#define MDS_PROXY__SRC__DNS_CACHE__HPP
+
+#include "loggers.hpp"
+
+#include <elliptics/interface.h>
+
+#include <sys/socket.h>
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <string>
+
+namespace elliptics {
+
+// Caches hostnames of storage nodes to build redirect and download-info urls.
+// getnameinfo blocks, hence it is called by the background thread: known addresses
+// are answered from the cache even if the entry is stale, the entry is refreshed
+// in background. Addresses which cannot be resolved are answered by their numeric form
+// (as getnameinfo does) and are cached for the shorter negative ttl.
+// Addresses of elliptics remotes are resolved in advance. An address which was never seen
+// is answered by its numeric form until the background thread resolves it, the caller
+// is never blocked by the resolver.
+class dns_cache_t {
+public:
+	struct config_t {
+		// seconds
+		int positive_ttl;
+		int negative_ttl;
+		// Period of the background refresh, seconds
+		int refresh_period;
+	};
+
+	dns_cache_t(ioremap::swarm::logger bh_logger_, config_t config_);
+	~dns_cache_t();
+
+	std::string
+	get_hostname(const dnet_addr &addr);
+
+	// Remotes are in elliptics format host:port:family
+	void
+	prefetch(const std::vector<std::string> &remotes);
+
+private:
+	typedef std::chrono::steady_clock clock_t;
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+
+	struct address_t {
+		sockaddr_storage storage;
+		socklen_t size;
+	};
+
+	struct entry_t {
+		address_t address;
+		std::string hostname;
+		clock_t::time_point valid_until;
+		bool is_resolved;
+		bool refresh_is_queued;
+	};
+
+	ioremap::swarm::logger &
+	logger();
+
+	// Throws std::runtime_error if the address is malformed
+	static std::string
+	numeric_host(const address_t &address);
+
+	// Returns the hostname and true, or the numeric host and false if the name is unknown
+	std::pair<std::string, bool>
+	resolve(const address_t &address, const std::string &numeric);
+
+	void
+	store(const std::string &numeric, const address_t &address
+			, const std::pair<std::string, bool> &result);
+
+	void
+	resolve_remote(const std::string &remote);
+
+	void
+	background_loop();
+
+	void
+	update_stats();
+
+	ioremap::swarm::logger bh_logger;
+
+	config_t config;
+
+	mutex_t mutex;
+	std::unordered_map<std::string, entry_t> entries;
+	std::unordered_set<std::string> queued_remotes;
+	std::vector<std::string> queued_refreshes;
+
+	std::thread background_resolver;
+	std::condition_variable background_resolver_cv;
+	bool work_is_done;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__DNS_CACHE__HPP */
+
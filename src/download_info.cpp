@@ -20,6 +20,8 @@
 #include "download_info.hpp"
 #include "error.hpp"
 
+#include <handystats/measuring_points.hpp>
+
 const std::string elliptics::download_info_1_t::handler_name = "downloadinfo";
 const std::string elliptics::download_info_2_t::handler_name = "download-info";
 
@@ -54,6 +56,10 @@ elliptics::download_info_t::on_request(const ioremap::thevoid::http_request &req
 		// in this moment. Hence session can be safely used without any check.
 		std::tie(session, key) = prepare_session(ns_state);
 
+		if (server()->delete_is_pending(session->get_groups(), key->remote())) {
+			throw http_error(404, "key is deleted, delete is not applied yet");
+		}
+
 		if (ns_settings(ns_state).check_for_update) {
 			session->set_cflags(session->get_cflags() | DNET_FLAGS_NOLOCK);
 		}
@@ -66,6 +72,19 @@ elliptics::download_info_t::on_request(const ioremap::thevoid::http_request &req
 		}
 
 		if (req.method() == "GET") {
+			signature_cache_storage_key = signature_cache_t::make_storage_key(
+					session->get_groups(), key->remote());
+			signature_cache_variant_key = signature_cache_t::make_variant_key(x_regional_host
+					, expiration_time.get_value_or(ns_settings(ns_state).redirect_expire_time));
+			signature_cache_version = server()->signature_cache->version();
+
+			if (auto cached = server()->signature_cache->get(signature_cache_storage_key
+						, signature_cache_variant_key)) {
+				MDS_LOG_INFO("Download info: use cached signature");
+				send_response(std::make_tuple(cached->host, cached->path, cached->ts, cached->sign));
+				return;
+			}
+
 			process_get(*session, *key);
 		} else {
 			throw http_error(405, "Method " + req.method() + " is not allowed");
@@ -104,6 +123,15 @@ elliptics::download_info_t::on_finished(const ioremap::elliptics::sync_lookup_re
 		auto res = server()->generate_signature_for_elliptics_file(slr, x_regional_host
 				, ns_state, expiration_time);
 
+		for (auto it = slr.begin(), end = slr.end(); it != end; ++it) {
+			if (it->error()) {
+				continue;
+			}
+
+			cache_signature(res, it->file_info()->size);
+			break;
+		}
+
 		send_response(std::move(res));
 	} catch (const http_error &ex) {
 		std::ostringstream oss;
@@ -194,13 +222,107 @@ elliptics::download_info_t::prepare_session(const mastermind::namespace_state_t
 void
 elliptics::download_info_t::process_get(ioremap::elliptics::session session
 		, const ioremap::elliptics::key key) {
-	MDS_LOG_DEBUG("Download info: looking up");
-	auto alr = session.quorum_lookup(key);
+	if (ns_settings(ns_state).download_info_checks_consistency) {
+		MDS_LOG_DEBUG("Download info: looking up");
+		auto self = shared_from_this();
+
+		server()->storage_flow(ns_state).schedule([this, self, session, key] (
+					storage_scheduler_t::slot_ptr_t slot) mutable {
+			auto alr = session.quorum_lookup(key);
+
+			// The slot is held until the key is looked up
+			alr.connect(hold_slot(std::move(slot), wrap(std::bind(&download_info_t::on_finished
+							, self, std::placeholders::_1, std::placeholders::_2))));
+		});
+		return;
+	}
 
-	alr.connect(wrap(std::bind(&download_info_t::on_finished, shared_from_this()
+	// Only one good location is needed to sign the url, hence the first good reply is used
+	// and the latency is set by the fastest group instead of the slowest one of a quorum.
+	// The healthiest group is preferred, clients are redirected to it unless it is late
+	session.set_groups(server()->groups_health->rank(session.get_groups()));
+
+	MDS_LOG_DEBUG("Download info: looking up groups in parallel");
+	parallel_lookuper = make_parallel_lookuper(
+			ioremap::swarm::logger(logger(), blackhole::log::attributes_t())
+			, session, key, server()->lookup_preference(), server()->groups_health
+			, server()->storage_flow(ns_state));
+
+	find_first_good_reply();
+}
+
+void
+elliptics::download_info_t::find_first_good_reply() {
+	if (!parallel_lookuper->results_left()) {
+		on_finished(ioremap::elliptics::sync_lookup_result()
+				, lookup_error.get_value_or(
+					ioremap::elliptics::error_info(-ENOENT, "there is no good lookup result")));
+		return;
+	}
+
+	auto future = parallel_lookuper->next_lookup_result();
+
+	future.connect(wrap(std::bind(&download_info_t::on_lookup_result, shared_from_this()
 					, std::placeholders::_1, std::placeholders::_2)));
 }
 
+void
+elliptics::download_info_t::on_lookup_result(const ioremap::elliptics::sync_lookup_result &slr
+		, const ioremap::elliptics::error_info &error) {
+	for (auto it = slr.begin(), end = slr.end(); it != end; ++it) {
+		if (it->error()) {
+			continue;
+		}
+
+		const int group_id = it->command()->id.group_id;
+
+		std::tuple<std::string, std::string, std::string, std::string> res;
+
+		try {
+			res = server()->generate_signature_for_elliptics_file(
+					ioremap::elliptics::sync_lookup_result{*it}, x_regional_host
+					, ns_state, expiration_time);
+		} catch (const std::exception &ex) {
+			MDS_LOG_ERROR("Download info: cannot use lookup result: group=%d; error=%s"
+					, group_id, ex.what());
+			HANDY_COUNTER_INCREMENT("mds.download_info.unusable_reply");
+			lookup_error = ioremap::elliptics::error_info(-EIO, ex.what());
+			continue;
+		}
+
+		MDS_LOG_INFO("Download info: url is signed by lookup result: group=%d", group_id);
+		parallel_lookuper->stop();
+
+		cache_signature(res, it->file_info()->size);
+		send_response(std::move(res));
+		return;
+	}
+
+	// Errors which say nothing about existence of the key take precedence over -ENOENT
+	if (error && (!lookup_error || lookup_error->code() == -ENOENT)) {
+		lookup_error = error;
+	}
+
+	find_first_good_reply();
+}
+
+void
+elliptics::download_info_t::cache_signature(
+		const std::tuple<std::string, std::string, std::string, std::string> &res
+		, size_t size) {
+	signature_cache_t::value_t value;
+	value.host = std::get<0>(res);
+	value.path = std::get<1>(res);
+	value.ts = std::get<2>(res);
+	value.sign = std::get<3>(res);
+	value.size = size;
+
+	server()->signature_cache->set(signature_cache_storage_key
+			, signature_cache_variant_key, std::move(value)
+			, expiration_time.get_value_or(ns_settings(ns_state).redirect_expire_time)
+			, signature_cache_version);
+}
+
 void
 elliptics::download_info_t::send_response(
 		std::tuple<std::string, std::string, std::string, std::string> res) {
@@ -21,6 +21,7 @@
 #define MDS_PROXY__SRC__DOWNLOAD_INFO__HPP
 
 #include "proxy.hpp"
+#include "lookuper.hpp"
 
 #include <thevoid/stream.hpp>
 
@@ -44,6 +45,10 @@ public:
 	on_finished(const ioremap::elliptics::sync_lookup_result &slr
 			, const ioremap::elliptics::error_info &error);
 
+	void
+	on_lookup_result(const ioremap::elliptics::sync_lookup_result &slr
+			, const ioremap::elliptics::error_info &error);
+
 private:
 	mastermind::namespace_state_t
 	get_namespace_state(const std::string &path, const std::string &handler);
@@ -60,6 +65,14 @@ private:
 	void
 	process_get(ioremap::elliptics::session session, const ioremap::elliptics::key key);
 
+	// Replies are taken in the order of arrival until one of them can be signed
+	void
+	find_first_good_reply();
+
+	void
+	cache_signature(const std::tuple<std::string, std::string, std::string, std::string> &res
+			, size_t size);
+
 	void
 	send_response(std::tuple<std::string, std::string, std::string, std::string> res);
 
@@ -79,6 +92,13 @@ private:
 	std::string x_regional_host;
 	std::string handler_name;
 	boost::optional<std::chrono::seconds> expiration_time;
+
+	std::string signature_cache_storage_key;
+	std::string signature_cache_variant_key;
+	signature_cache_t::version_t signature_cache_version;
+
+	parallel_lookuper_ptr_t parallel_lookuper;
+	boost::optional<ioremap::elliptics::error_info> lookup_error;
 };
 
 class download_info_1_t : public download_info_t {
@@ -0,0 +1,467 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "download_info_batch.hpp"
+#include "signature_cache.hpp"
+#include "error.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <sstream>
+
+const std::string elliptics::download_info_batch_t::handler_name = "download-info-batch";
+
+elliptics::download_info_batch_t::download_info_batch_t()
+	: next_item(0)
+	, is_dispatching(false)
+	, in_flight(0)
+	, in_flight_limit(1)
+	, finished_items(0)
+	, sent_entries(0)
+{}
+
+void
+elliptics::download_info_batch_t::on_request(const ioremap::thevoid::http_request &req
+		, const boost::asio::const_buffer &buffer) {
+	MDS_LOG_INFO("Download info batch: handle request: %s", req.url().path().c_str());
+
+	try {
+		try {
+			ns_state = server()->get_namespace_state(req.url().path(), '/' + handler_name);
+		} catch (const std::exception &ex) {
+			throw http_error(400, ex.what());
+		}
+
+		if (req.method() != "POST") {
+			throw http_error(405, "Method " + req.method() + " is not allowed");
+		}
+
+		if (ns_settings(ns_state).sign_token.empty()) {
+			throw http_error(403, "cannot generate download-info without signature-token");
+		}
+
+		check_query_args();
+
+		if (const auto &xrh = req.headers().get("X-Regional-Host")) {
+			x_regional_host = *xrh;
+		}
+
+		parse_keys(buffer);
+
+		if (items.size() > server()->download_info_batch.max_keys) {
+			throw http_error(400, "too many keys: "
+					+ boost::lexical_cast<std::string>(items.size()));
+		}
+
+		// The method runs in thevoid's io-loop, therefore proxy's dtor cannot run
+		// in this moment. Hence session can be safely used without any check.
+		lookup_session = server()->lookup_session(req, {});
+
+		if (!lookup_session) {
+			throw http_error(500, "lookup-session is uninitialized");
+		}
+
+		lookup_session->set_filter(ioremap::elliptics::filters::all);
+
+		if (ns_settings(ns_state).check_for_update) {
+			lookup_session->set_cflags(lookup_session->get_cflags() | DNET_FLAGS_NOLOCK);
+		}
+
+		signer.reset(new signer_t(ns_settings(ns_state).sign_token));
+	} catch (const http_error &ex) {
+		std::ostringstream oss;
+		oss
+			<< "http_error: http_status = " << ex.http_status()
+			<< " ; description = " << ex.what();
+		auto msg = oss.str();
+
+		if (ex.is_server_error()) {
+			MDS_LOG_ERROR("%s", msg.c_str());
+		} else {
+			MDS_LOG_INFO("%s", msg.c_str());
+		}
+
+		send_reply(ex.http_status());
+		return;
+	} catch (const std::exception &ex) {
+		MDS_LOG_ERROR("uncaughted exception: http_status = 500 ; description = %s", ex.what());
+		send_reply(500);
+		return;
+	}
+
+	in_flight_limit = std::max<size_t>(server()->download_info_batch.in_flight_limit, 1);
+
+	ioremap::thevoid::http_response reply;
+	ioremap::swarm::http_headers headers;
+
+	reply.set_code(200);
+	headers.set_content_type(format == "json" ? "application/json" : "text/xml");
+	// The size of response is unknown until all keys are processed,
+	// the end of response is marked by closing of the connection.
+	headers.set_keep_alive(false);
+	reply.set_headers(headers);
+
+	std::string header;
+
+	if (format == "json") {
+		header = "[";
+	} else {
+		header = "<?xml version=\"1.0\" encoding=\"utf-8\"?><download-info-list>";
+	}
+
+	send_headers(std::move(reply)
+			, std::function<void (const boost::system::error_code &)>());
+	send_data(std::move(header), std::function<void (const boost::system::error_code &)>());
+
+	if (items.empty()) {
+		item_is_finished();
+		return;
+	}
+
+	dispatch();
+}
+
+void
+elliptics::download_info_batch_t::check_query_args() {
+	const auto &query = request().url().query();
+
+	format = get_arg<std::string>(query, "format", "xml");
+
+	if (format != "xml" && format != "json") {
+		throw http_error(400, "unknown format=" + format);
+	}
+
+	if (query.has_item("expiration-time")) {
+		if (!ns_settings(ns_state).custom_expiration_time) {
+			throw http_error(403, "using of expiration-time is prohibited");
+		}
+
+		auto expiration_time_str = *query.item_value("expiration-time");
+
+		try {
+			expiration_time = std::chrono::seconds(
+					boost::lexical_cast<size_t>(expiration_time_str));
+		} catch (const std::exception &ex) {
+			throw http_error(400, std::string("cannot parse expiration-time: ") + ex.what());
+		}
+	}
+}
+
+void
+elliptics::download_info_batch_t::parse_keys(const boost::asio::const_buffer &buffer) {
+	std::string body(boost::asio::buffer_cast<const char *>(buffer)
+			, boost::asio::buffer_size(buffer));
+
+	std::istringstream iss(body);
+	std::string line;
+
+	while (std::getline(iss, line)) {
+		if (!line.empty() && line[line.size() - 1] == '\r') {
+			line.resize(line.size() - 1);
+		}
+
+		if (line.empty()) {
+			continue;
+		}
+
+		item_t item;
+		std::string filename;
+
+		if (ns_settings(ns_state).static_couple.empty()) {
+			auto pos = line.find('/');
+			int group = 0;
+
+			if (pos != std::string::npos && pos + 1 != line.size()) {
+				try {
+					group = boost::lexical_cast<int>(line.substr(0, pos));
+				} catch (...) {
+				}
+			}
+
+			if (group <= 0) {
+				throw http_error(400, "cannot determine groups: key=" + line);
+			}
+
+			try {
+				item.couple = server()->get_groups(ns_state, group);
+			} catch (const std::exception &ex) {
+				throw http_error(400, "cannot determine groups: key=" + line + ": " + ex.what());
+			}
+
+			if (item.couple.empty()) {
+				throw http_error(400, "cannot determine groups: key=" + line);
+			}
+
+			filename = line.substr(pos + 1);
+		} else {
+			item.couple = ns_settings(ns_state).static_couple;
+			filename = line;
+		}
+
+		item.key = ns_state.name() + '.' + filename;
+		item.line = std::move(line);
+
+		items.emplace_back(std::move(item));
+	}
+}
+
+void
+elliptics::download_info_batch_t::dispatch() {
+	{
+		lock_guard_t lock_guard(state_mutex);
+
+		// The running loop takes the next item after the finished one
+		if (is_dispatching) {
+			return;
+		}
+
+		is_dispatching = true;
+	}
+
+	while (true) {
+		lock_guard_t lock_guard(state_mutex);
+
+		if (in_flight >= in_flight_limit || next_item == items.size()) {
+			is_dispatching = false;
+			break;
+		}
+
+		const auto &item = items[next_item];
+
+		next_item += 1;
+		in_flight += 1;
+
+		lock_guard.unlock();
+
+		process_item(item);
+	}
+}
+
+void
+elliptics::download_info_batch_t::process_item(const item_t &item) {
+	if (server()->delete_is_pending(item.couple, item.key)) {
+		send_entry(make_error(item.line, 404, "key is deleted, delete is not applied yet"));
+		item_is_finished();
+		return;
+	}
+
+	auto storage_key = signature_cache_t::make_storage_key(item.couple, item.key);
+	auto variant_key = signature_cache_t::make_variant_key(x_regional_host
+			, expiration_time.get_value_or(ns_settings(ns_state).redirect_expire_time));
+
+	// The signature made after the key was invalidated is not cached
+	auto signature_version = server()->signature_cache->version();
+
+	if (auto cached = server()->signature_cache->get(storage_key, variant_key)) {
+		file_location_t file_location;
+		file_location.host = cached->host;
+		file_location.path = cached->path;
+
+		send_entry(make_entry(item, file_location, cached->ts, cached->sign));
+		item_is_finished();
+		return;
+	}
+
+	auto session = lookup_session->clone();
+	session.set_groups(item.couple);
+
+	auto self = shared_from_this();
+
+	server()->storage_flow(ns_state).schedule([this, self, session, &item, signature_version] (
+				storage_scheduler_t::slot_ptr_t slot) mutable {
+		auto permit = server()->storage_flow(ns_state).acquire(session.get_groups());
+
+		auto callback = [this, self, &item, signature_version] (
+				const ioremap::elliptics::sync_lookup_result &slr
+				, const ioremap::elliptics::error_info &error) {
+			on_lookup(item, signature_version, slr, error);
+		};
+
+		if (permit->groups().empty()) {
+			callback(ioremap::elliptics::sync_lookup_result()
+					, ioremap::elliptics::error_info(-EBUSY, "bulkheads of groups are full"));
+			return;
+		}
+
+		// Only one location is signed, hence busy groups are just not asked
+		if (!permit->rejected_groups().empty()) {
+			session.set_groups(permit->groups());
+		}
+
+		auto future = session.quorum_lookup(item.key);
+
+		// The slot and places in bulkheads are held until the key is looked up
+		future.connect(hold_slot(std::move(slot), hold_slot(std::move(permit), std::move(callback))));
+	});
+}
+
+void
+elliptics::download_info_batch_t::on_lookup(const item_t &item
+		, signature_cache_t::version_t signature_version
+		, const ioremap::elliptics::sync_lookup_result &slr
+		, const ioremap::elliptics::error_info &error) {
+	std::string entry;
+
+	try {
+		if (error) {
+			auto http_status = (error.code() == -ENOENT ? 404 : 500);
+
+			if (error.code() == -EBUSY) {
+				http_status = 503;
+			}
+
+			throw http_error(http_status, error.message());
+		}
+
+		auto file_location = server()->get_file_location(slr, ns_state, x_regional_host);
+		auto ts = make_signature_ts(expiration_time, ns_state);
+		auto message = make_signature_message(file_location, ts);
+
+		std::string sign;
+
+		{
+			lock_guard_t lock_guard(state_mutex);
+			sign = signer->sign(message);
+		}
+
+		entry = make_entry(item, file_location, ts, sign);
+
+		auto signature_expiration_time
+			= expiration_time.get_value_or(ns_settings(ns_state).redirect_expire_time);
+
+		for (auto it = slr.begin(), end = slr.end(); it != end; ++it) {
+			if (it->error()) {
+				continue;
+			}
+
+			signature_cache_t::value_t value;
+			value.host = file_location.host;
+			value.path = file_location.path;
+			value.ts = ts;
+			value.sign = sign;
+			value.size = it->file_info()->size;
+
+			server()->signature_cache->set(signature_cache_t::make_storage_key(item.couple, item.key)
+					, signature_cache_t::make_variant_key(x_regional_host, signature_expiration_time)
+					, std::move(value), signature_expiration_time, signature_version);
+			break;
+		}
+	} catch (const http_error &ex) {
+		MDS_LOG_INFO("Download info batch: key=%s; http_status=%d; description=%s"
+				, item.line.c_str(), ex.http_status(), ex.what());
+		entry = make_error(item.line, ex.http_status(), ex.what());
+	} catch (const std::exception &ex) {
+		MDS_LOG_ERROR("Download info batch: key=%s; error=%s", item.line.c_str(), ex.what());
+		entry = make_error(item.line, 500, ex.what());
+	}
+
+	send_entry(std::move(entry));
+	item_is_finished();
+}
+
+std::string
+elliptics::download_info_batch_t::make_entry(const item_t &item
+		, const file_location_t &file_location
+		, const std::string &ts, const std::string &sign) {
+	if (format == "json") {
+		auto dynamic = kora::dynamic_t::empty_object;
+		auto &object = dynamic.as_object();
+		object["key"] = item.line;
+		object["host"] = file_location.host;
+		object["path"] = file_location.path;
+		object["ts"] = ts;
+		object["s"] = sign;
+		return kora::to_json(dynamic);
+	}
+
+	std::ostringstream oss;
+	oss << "<download-info key=\"" << encode_for_xml(item.line) << "\">";
+	oss << "<host>" << file_location.host << "</host>";
+	oss << "<path>" << file_location.path << "</path>";
+	oss << "<ts>" << ts << "</ts>";
+	oss << "<region>-1</region>";
+	oss << "<s>" << sign << "</s>";
+	oss << "</download-info>";
+	return oss.str();
+}
+
+std::string
+elliptics::download_info_batch_t::make_error(const std::string &line, int http_status
+		, const std::string &message) {
+	if (format == "json") {
+		auto dynamic = kora::dynamic_t::empty_object;
+		auto &object = dynamic.as_object();
+		object["key"] = line;
+		object["status"] = http_status;
+		object["error"] = message;
+		return kora::to_json(dynamic);
+	}
+
+	std::ostringstream oss;
+	oss << "<error key=\"" << encode_for_xml(line) << "\" status=\"" << http_status << "\">"
+		<< encode_for_xml(message) << "</error>";
+	return oss.str();
+}
+
+void
+elliptics::download_info_batch_t::send_entry(std::string entry) {
+	// Entries are sent under the lock to keep separators in the right order
+	lock_guard_t lock_guard(state_mutex);
+
+	if (format == "json" && sent_entries != 0) {
+		entry.insert(entry.begin(), ',');
+	}
+
+	sent_entries += 1;
+
+	send_data(std::move(entry), std::function<void (const boost::system::error_code &)>());
+}
+
+void
+elliptics::download_info_batch_t::item_is_finished() {
+	bool is_last = false;
+
+	{
+		lock_guard_t lock_guard(state_mutex);
+
+		if (!items.empty()) {
+			in_flight -= 1;
+			finished_items += 1;
+		}
+
+		is_last = (finished_items == items.size());
+	}
+
+	if (!is_last) {
+		dispatch();
+		return;
+	}
+
+	MDS_LOG_INFO("Download info batch: all keys are processed: count=%llu"
+			, static_cast<unsigned long long>(items.size()));
+
+	std::string footer = (format == "json" ? "]" : "</download-info-list>");
+
+	auto self = shared_from_this();
+	send_data(std::move(footer), [this, self] (const boost::system::error_code &error_code) {
+			close(error_code);
+		});
+}
+
@@ -0,0 +1,119 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__DOWNLOAD_INFO_BATCH__HPP
+#define MDS_PROXY__SRC__DOWNLOAD_INFO_BATCH__HPP
+
+#include "proxy.hpp"
+#include "utils.hpp"
+
+#include <thevoid/stream.hpp>
+
+#include <libmastermind/mastermind.hpp>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace elliptics {
+
+// POST /download-info-batch[-ns]/ with the list of keys separated by '\n'.
+// Every key has the same form as a path of download-info handler without the handler
+// prefix: "<couple-id>/<filename>" or just "<filename>" for namespaces with static couple.
+// Lookups run concurrently and every result is sent as soon as it is ready,
+// thus the order of entries in response does not match the order of keys.
+class download_info_batch_t
+	: public ioremap::thevoid::simple_request_stream<proxy>
+	, public std::enable_shared_from_this<download_info_batch_t>
+{
+public:
+	static const std::string handler_name;
+
+	download_info_batch_t();
+
+	void
+	on_request(const ioremap::thevoid::http_request &req
+			, const boost::asio::const_buffer &buffer);
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+
+	struct item_t {
+		std::string line;
+		std::string key;
+		couple_t couple;
+	};
+
+	void
+	check_query_args();
+
+	void
+	parse_keys(const boost::asio::const_buffer &buffer);
+
+	// Items are processed by the loop of the only dispatching thread: the items which
+	// are finished synchronously do not make the stack grow
+	void
+	dispatch();
+
+	void
+	process_item(const item_t &item);
+
+	void
+	on_lookup(const item_t &item, signature_cache_t::version_t signature_version
+			, const ioremap::elliptics::sync_lookup_result &slr
+			, const ioremap::elliptics::error_info &error);
+
+	std::string
+	make_entry(const item_t &item, const file_location_t &file_location
+			, const std::string &ts, const std::string &sign);
+
+	std::string
+	make_error(const std::string &line, int http_status, const std::string &message);
+
+	void
+	send_entry(std::string entry);
+
+	void
+	item_is_finished();
+
+	mastermind::namespace_state_t ns_state;
+	std::string format;
+	std::string x_regional_host;
+	boost::optional<std::chrono::seconds> expiration_time;
+
+	boost::optional<ioremap::elliptics::session> lookup_session;
+
+	mutex_t state_mutex;
+	std::unique_ptr<signer_t> signer;
+
+	std::vector<item_t> items;
+	size_t next_item;
+	bool is_dispatching;
+	size_t in_flight;
+	size_t in_flight_limit;
+	size_t finished_items;
+	size_t sent_entries;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__DOWNLOAD_INFO_BATCH__HPP */
+
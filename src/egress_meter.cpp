@@ -0,0 +1,105 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "egress_meter.hpp"
+
+#include <algorithm>
+
+namespace elliptics {
+
+egress_meter_t::egress_meter_t(config_t config_)
+	: config(std::move(config_))
+	, in_flight(0)
+	, sent(0)
+	, rate_time_point(clock_t::now())
+	, rate_sent(0)
+	, current_rate(0)
+{
+	config.rate_period = std::max(config.rate_period, 1);
+}
+
+void
+egress_meter_t::data_is_queued(uint64_t size) {
+	in_flight += size;
+}
+
+void
+egress_meter_t::data_is_sent(uint64_t size) {
+	in_flight -= size;
+	sent += size;
+}
+
+uint64_t
+egress_meter_t::in_flight_bytes() const {
+	return in_flight.load();
+}
+
+uint64_t
+egress_meter_t::rate() {
+	std::lock_guard<std::mutex> lock_guard(rate_mutex);
+	(void) lock_guard;
+
+	update_rate();
+
+	return current_rate;
+}
+
+double
+egress_meter_t::pressure() {
+	double result = 0;
+
+	if (config.capacity != 0) {
+		result = std::max(result, static_cast<double>(rate()) / config.capacity);
+	}
+
+	if (config.in_flight_limit != 0) {
+		result = std::max(result
+				, static_cast<double>(in_flight_bytes()) / config.in_flight_limit);
+	}
+
+	return std::min(result, 1.);
+}
+
+void
+egress_meter_t::update_rate() {
+	auto now = clock_t::now();
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+			now - rate_time_point).count();
+
+	if (elapsed < config.rate_period * 1000) {
+		return;
+	}
+
+	auto sent_ = sent.load();
+	auto instant_rate = (sent_ - rate_sent) * 1000 / elapsed;
+
+	// The rate is smoothed to not react on single large responses,
+	// but the window is reset after a long idle period
+	if (elapsed > 2 * config.rate_period * 1000) {
+		current_rate = instant_rate;
+	} else {
+		current_rate = (current_rate + instant_rate) / 2;
+	}
+
+	rate_time_point = now;
+	rate_sent = sent_;
+}
+
+} // namespace elliptics
+
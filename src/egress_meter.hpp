@@ -0,0 +1,87 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__EGRESS_METER__HPP
+#define MDS_PROXY__SRC__EGRESS_METER__HPP
+
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+#if __GNUC__ == 4 && __GNUC_MINOR__ >= 6
+#include <atomic>
+#else
+#include <cstdatomic>
+#endif
+
+namespace elliptics {
+
+// Measures the data which is sent to clients by the proxy itself.
+// Pressure is a number in [0, 1]: the largest of egress utilization
+// (rate / capacity) and the share of in-flight-limit which is used by
+// bytes that are passed to sockets but are not sent yet.
+class egress_meter_t {
+public:
+	struct config_t {
+		// bytes per second, 0 means the rate is not taken into account
+		uint64_t capacity;
+		// bytes, 0 means in-flight bytes are not taken into account
+		uint64_t in_flight_limit;
+		// seconds
+		int rate_period;
+	};
+
+	egress_meter_t(config_t config_);
+
+	void
+	data_is_queued(uint64_t size);
+
+	void
+	data_is_sent(uint64_t size);
+
+	uint64_t
+	in_flight_bytes() const;
+
+	uint64_t
+	rate();
+
+	double
+	pressure();
+
+private:
+	typedef std::chrono::steady_clock clock_t;
+
+	void
+	update_rate();
+
+	config_t config;
+
+	std::atomic<uint64_t> in_flight;
+	std::atomic<uint64_t> sent;
+
+	std::mutex rate_mutex;
+	clock_t::time_point rate_time_point;
+	uint64_t rate_sent;
+	uint64_t current_rate;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__EGRESS_METER__HPP */
+
@@ -49,6 +49,19 @@ buffer(const ioremap::elliptics::data_pointer &data_pointer) {
 } // namespace asio
 } // namespace boost
 
+namespace elliptics {
+
+// Encoded variants are different representations, hence they must have different strong ETags
+std::string make_encoded_etag(const std::string &etag, const std::string &encoding) {
+	if (etag.size() < 2 || etag.back() != '\"') {
+		return etag;
+	}
+
+	return etag.substr(0, etag.size() - 1) + '-' + encoding + '\"';
+}
+
+} // namespace elliptics
+
 void
 elliptics::req_get::find_first_group(
 		std::function<void (const ie::lookup_result_entry &)> on_result
@@ -152,6 +165,8 @@ elliptics::req_get::next_other_group_is_found(const ie::sync_lookup_result &entr
 		auto msg = oss.str();
 		MDS_LOG_ERROR("%s", msg.c_str());
 
+		server()->replicas_diverged(couple, key);
+
 		find_other_group(std::move(on_result), std::move(on_error));
 		return;
 	}
@@ -235,6 +250,11 @@ elliptics::req_get::process_group_info(const ie::lookup_result_entry &entry) {
 		m_session->set_groups({static_cast<int>(entry.command()->id.group_id)});
 		set_csum_type(entry);
 
+		// Groups which were checked before the chosen one do not have a good replica
+		if (!bad_groups.empty()) {
+			server()->replicas_diverged(couple, key);
+		}
+
 		uint64_t tsec = entry.file_info()->mtime.tsec;
 
 		// TODO: change declaration of try_to_redirect_request
@@ -243,17 +263,22 @@ elliptics::req_get::process_group_info(const ie::lookup_result_entry &entry) {
 		// without those conditions would have been a status code other than a 2xx (Successful)
 		// or 412 (Precondition Failed). In other words, redirects and failures take precedence
 		// over the evaluation of preconditions in conditional requests.
-		if (try_to_redirect_request({entry}, total_size())) {
+		if (try_to_redirect_request({entry}, requested_size(total_size()))) {
+			// Other groups are needed only to read the data
+			parallel_lookuper_ptr->stop();
 			return;
 		}
 
 		auto res = process_precondition_headers(tsec, total_size());
 
 		if (std::get<0>(res)) {
+			parallel_lookuper_ptr->stop();
 			return;
 		}
 
 		if (request().method() == "HEAD") {
+			parallel_lookuper_ptr->stop();
+
 			prospect_http_response.headers().set_content_length(total_size());
 			send_reply(std::move(prospect_http_response));
 			MDS_REQUEST_REPLY("get", 200, reinterpret_cast<uint64_t>(this->reply().get()));
@@ -277,12 +302,47 @@ elliptics::req_get::set_csum_type(const ie::lookup_result_entry &entry) {
 		MDS_LOG_INFO("record has chuncked csum, proxy will check csums for every chunk");
 	} else {
 		MDS_LOG_INFO("record does not have chuncked csum, proxy will check csum only for first chunk");
+
+		auto group = static_cast<int>(entry.command()->id.group_id);
+
+		// Records from cache groups are not migrated, they will be replaced by cache itself
+		if (std::find(couple.begin(), couple.end(), group) != couple.end()) {
+			const auto *file_info = entry.file_info();
+			server()->record_without_chunked_csum_is_read(couple, key
+					, file_info->size, file_info->mtime);
+		}
 	}
 }
 
 void
 elliptics::req_get::read_chunk(size_t offset, size_t size
-		, std::function<void (const ie::read_result_entry &)> on_result
+		, std::function<void (const ie::data_pointer &)> on_result
+		, std::function<void ()> on_error) {
+	if (memory_object) {
+		on_result(memory_object->data.slice(offset, size));
+		return;
+	}
+
+	// The chunk is reserved until it is sent, retries in other groups reuse the reservation
+	if (chunk_reservation) {
+		read_reserved_chunk(offset, size, std::move(on_result), std::move(on_error));
+		return;
+	}
+
+	auto self = shared_from_this();
+	auto next = [this, self, offset, size, on_result, on_error] (
+			memory_accountant_t::reservation_ptr_t reservation) {
+		chunk_reservation = std::move(reservation);
+		read_reserved_chunk(offset, size, on_result, on_error);
+	};
+
+	server()->memory_accountant->reserve(memory_accountant_t::subsystem_tag::get
+			, size, std::move(next));
+}
+
+void
+elliptics::req_get::read_reserved_chunk(size_t offset, size_t size
+		, std::function<void (const ie::data_pointer &)> on_result
 		, std::function<void ()> on_error) {
 	auto session = get_session();
 
@@ -294,15 +354,31 @@ elliptics::req_get::read_chunk(size_t offset, size_t size
 		MDS_LOG_INFO("%s", msg.c_str());
 	}
 
-	auto future = session.read_data(key, offset, size);
+	auto self = shared_from_this();
 
-	auto callback = std::bind(&req_get::read_chunk_is_finished, shared_from_this()
-			, std::placeholders::_1, std::placeholders::_2
-			, util::timer_t{}
-			, offset, size
-			, std::move(on_result), std::move(on_error));
+	server()->storage_flow(ns_state).schedule([this, self, session, offset, size
+			, on_result, on_error] (storage_scheduler_t::slot_ptr_t slot) mutable {
+		auto permit = server()->storage_flow(ns_state).acquire(session.get_groups());
 
-	future.connect(callback);
+		auto callback = std::bind(&req_get::read_chunk_is_finished, self
+				, std::placeholders::_1, std::placeholders::_2
+				, util::timer_t{}
+				, offset, size
+				, std::move(on_result), std::move(on_error));
+
+		// The chunk is read from another group as if the group failed
+		if (permit->groups().empty()) {
+			callback(ie::sync_read_result()
+					, ie::error_info(-EBUSY, "bulkhead of group is full"));
+			return;
+		}
+
+		auto future = session.read_data(ell_key, offset, size);
+
+		// The slot and the place in the bulkhead are held until the chunk is read
+		future.connect(hold_slot(std::move(slot)
+					, hold_slot(std::move(permit), std::move(callback))));
+	});
 }
 
 void
@@ -311,7 +387,7 @@ elliptics::req_get::read_chunk_is_finished(
 		, const ie::error_info &error_info
 		, util::timer_t timer
 		, size_t offset, size_t size
-		, std::function<void (const ie::read_result_entry &)> on_result
+		, std::function<void (const ie::data_pointer &)> on_result
 		, std::function<void ()> on_error) {
 	std::ostringstream oss;
 	oss << "chunk reading was finished: spent-time=" << timer.str_ms() << "; status=\""
@@ -334,7 +410,7 @@ elliptics::req_get::read_chunk_is_finished(
 	auto msg = oss.str();
 	MDS_LOG_INFO("%s", msg.c_str());
 
-	on_result(entries.front());
+	on_result(entries.front().file());
 }
 
 void
@@ -342,18 +418,44 @@ elliptics::req_get::send_chunk(ie::data_pointer data_pointer
 		, std::function<void ()> on_result
 		, std::function<void ()> on_error) {
 	MDS_LOG_INFO("send chunk");
+
+	auto size = data_pointer.size();
+	server()->egress_meter->data_is_queued(size);
+
+	// Transfers are watched from the first sent chunk
+	if (!transfer) {
+		transfer = server()->transfer_rate_guard->watch(
+				transfer_rate_guard_t::direction_tag::download, shared_from_this()
+				, [this] (const boost::system::error_code &error_code) {
+					reply()->close(error_code);
+				});
+	}
+
+	if (transfer) {
+		transfer->wait_for_client(true);
+	}
+
 	auto callback = std::bind(&req_get::send_chunk_is_finished, shared_from_this()
 			, std::placeholders::_1
-			, util::timer_t{}
+			, util::timer_t{}, size
 			, std::move(on_result), std::move(on_error));
 	send_data(std::move(data_pointer), std::move(callback));
 }
 
 void
 elliptics::req_get::send_chunk_is_finished(const boost::system::error_code &error_code
-		, util::timer_t timer
+		, util::timer_t timer, size_t size
 		, std::function<void ()> on_result
 		, std::function<void ()> on_error) {
+	server()->egress_meter->data_is_sent(size);
+	chunk_reservation.reset();
+
+	if (transfer) {
+		transfer->wait_for_client(false);
+		transfer->bytes_are_transferred(size);
+	}
+	server()->hot_keys->hit(ns_state.name(), couple, key, 0, size);
+
 	some_data_were_sent = true;
 	std::ostringstream oss;
 	oss << "chink was sent: spent-time=" << timer.str_ms() << "; status=\""
@@ -380,51 +482,73 @@ elliptics::req_get::read_and_send_chunk(size_t offset, size_t size
 		, std::function<void ()> on_result
 		, std::function<void ()> on_error) {
 	auto self = shared_from_this();
-	auto next = [this, self, on_result, on_error] (const ie::read_result_entry &entry) {
-		send_chunk(std::move(entry.file()), std::move(on_result), std::move(on_error));
+	auto next = [this, self, on_result, on_error] (const ie::data_pointer &data_pointer) {
+		send_chunk(data_pointer, std::move(on_result), std::move(on_error));
 	};
 
 	read_chunk(offset, size, std::move(next), std::move(on_error));
 }
 
+// The state of the range is kept in the handler: the callbacks are not wrapped
+// into a new closure for every chunk, hence a chunk costs a constant number of allocations
+// instead of copying the whole chain of callbacks
 void
 elliptics::req_get::read_and_send_range(size_t offset, size_t size
 		, std::function<void ()> on_result
 		, std::function<void ()> on_error) {
+	range_state.offset = offset;
+	range_state.size = size;
+	range_state.on_result = std::move(on_result);
+	range_state.on_error = std::move(on_error);
+
+	read_and_send_range_chunk();
+}
+
+void
+elliptics::req_get::read_and_send_range_chunk() {
 	// TODO: m_read_chunk_size should be size_t
-	auto current_size = std::min(static_cast<size_t>(server()->m_read_chunk_size), size);
-	auto next_offset = offset + current_size;
-	auto next_size = size - current_size;
+	auto current_size = std::min(static_cast<size_t>(server()->m_read_chunk_size)
+			, range_state.size);
+	auto offset = range_state.offset;
 
-	auto self = shared_from_this();
-	auto next = [this, self, next_offset, next_size, on_result, on_error] () {
-		if (next_size == 0) {
-			on_result();
-			return;
-		}
+	range_state.offset += current_size;
+	range_state.size -= current_size;
 
-		read_and_send_range(next_offset, next_size, std::move(on_result), std::move(on_error));
-	};
+	read_and_send_chunk(offset, current_size
+			, std::bind(&req_get::range_chunk_is_sent, shared_from_this())
+			, range_state.on_error);
+}
 
-	read_and_send_chunk(offset, current_size, std::move(next), std::move(on_error));
+void
+elliptics::req_get::range_chunk_is_sent() {
+	if (range_state.size != 0) {
+		read_and_send_range_chunk();
+		return;
+	}
+
+	// The callback may start the next range which overwrites the state.
+	// Both callbacks hold the handler, they are reset to break the cycle
+	auto on_result = std::move(range_state.on_result);
+	range_state.on_result = nullptr;
+	range_state.on_error = nullptr;
+
+	on_result();
 }
 
 void
-elliptics::req_get::read_and_send_ranges(ranges_t ranges, std::list<std::string> ranges_headers
-		, std::function<void ()> on_result
-		, std::function<void ()> on_error) {
-	auto self = shared_from_this();
-	auto boundary = ranges_headers.front();
-	ranges_headers.pop_front();
+elliptics::req_get::read_and_send_ranges() {
+	auto boundary = std::move(pending_boundaries.front());
+	pending_boundaries.pop_front();
 
-	if (ranges.empty()) {
-		auto next = [self, on_result, on_error] (const boost::system::error_code &error_code) {
+	if (pending_ranges.empty()) {
+		auto self = shared_from_this();
+		auto next = [this, self] (const boost::system::error_code &error_code) {
 			if (error_code) {
 				on_error();
 				return;
 			}
 
-			on_result();
+			request_is_finished();
 		};
 
 		send_data(std::move(boundary), std::move(next));
@@ -434,15 +558,12 @@ elliptics::req_get::read_and_send_ranges(ranges_t ranges, std::list<std::string>
 	send_data(std::move(boundary)
 			, std::function<void (const boost::system::error_code &)>());
 
-	auto range = ranges.front();
-	ranges.pop_front();
-
-	auto next = [this, self, ranges, ranges_headers, on_result, on_error] () {
-		read_and_send_ranges(std::move(ranges), std::move(ranges_headers)
-				, std::move(on_result), std::move(on_error));
-	};
+	auto range = pending_ranges.front();
+	pending_ranges.pop_front();
 
-	read_and_send_range(range.offset, range.size, std::move(next), std::move(on_error));
+	read_and_send_range(range.offset, range.size
+			, std::bind(&req_get::read_and_send_ranges, shared_from_this())
+			, std::bind(&req_get::on_error, shared_from_this()));
 }
 
 void
@@ -475,16 +596,15 @@ elliptics::req_get::process_ranges(ranges_t ranges, std::list<std::string> bound
 	send_headers(std::move(prospect_http_response)
 			, std::function<void (const boost::system::error_code &)>());
 
-	std::function<void ()> close_callback = std::bind(&req_get::request_is_finished, shared_from_this());
-	std::function<void ()> error_callback = std::bind(&req_get::on_error, shared_from_this());
+	pending_ranges = std::move(ranges);
+	pending_boundaries = std::move(boundaries);
 
-	read_and_send_ranges(std::move(ranges), std::move(boundaries)
-			, std::move(close_callback), std::move(error_callback));
+	read_and_send_ranges();
 }
 
 void
-elliptics::req_get::detect_content_type(const ie::read_result_entry &entry) {
-	const auto &data_pointer = entry.file();
+elliptics::req_get::detect_content_type(const ie::data_pointer &data_pointer) {
+	std::string content_type;
 
 	{
 		util::timer_t timer;
@@ -494,7 +614,7 @@ elliptics::req_get::detect_content_type(const ie::read_result_entry &entry) {
 
 		// Fisrt 10KB of data should be enough to detect content type
 		static size_t MAGIC_SIZE = 10 * 1024;
-		auto content_type = server()->m_magic->type(static_cast<const char *>(data_pointer.data())
+		content_type = server()->m_magic->type(static_cast<const char *>(data_pointer.data())
 				, std::min(data_pointer.size(), MAGIC_SIZE));
 
 		prospect_http_response.headers().set_content_type(content_type);
@@ -506,6 +626,19 @@ elliptics::req_get::detect_content_type(const ie::read_result_entry &entry) {
 		MDS_LOG_INFO("%s", msg.c_str());
 	}
 
+	auto encoded_data = data_pointer;
+
+	if (content_is_compressible(ns_settings(ns_state), content_type, total_size())) {
+		add_vary_accept_encoding(prospect_http_response.headers());
+
+		// Only the whole file which was read by one chunk is compressed
+		if (total_size() == data_pointer.size() && prospect_http_response.code() == 200
+				&& encoding_is_accepted(
+					request().headers().get("Accept-Encoding").get_value_or(""), "gzip")) {
+			encoded_data = gzip_whole_file(data_pointer);
+		}
+	}
+
 	MDS_REQUEST_REPLY("get", prospect_http_response.code(), reinterpret_cast<uint64_t>(this->reply().get()));
 
 	headers_were_sent = true;
@@ -516,21 +649,23 @@ elliptics::req_get::detect_content_type(const ie::read_result_entry &entry) {
 	std::function<void ()> error_callback = std::bind(&req_get::on_error, shared_from_this());
 
 	if (total_size() == data_pointer.size()) {
-		if (!bad_groups.empty()) {
-			if (auto write_session = server()->write_session(request(), bad_groups)) {
-				{
-					std::ostringstream oss;
-					oss << "mds-proxy recovers file! groups=" << bad_groups;
-					const auto &msg = oss.str();
-					MDS_LOG_INFO("%s", msg.c_str());
-				}
+		// Groups without a good replica are repaired by read_repairer_t
+		if (!memory_object && server()->hot_object_cache->is_enabled()
+				&& server()->hot_keys->is_hot(couple, key)) {
+			MDS_LOG_INFO("hot key is promoted into memory: size=%llu"
+					, static_cast<unsigned long long>(data_pointer.size()));
+			server()->hot_object_cache->set(couple, key, data_pointer
+					, lookup_result_entry_opt->file_info()->mtime, memory_version);
+		}
 
-				write_session->set_timestamp(entry.io_attribute()->timestamp);
-				write_session->write_data(key, data_pointer, 0);
-			} else {
-				MDS_LOG_ERROR("oops, file cannot be recovered: write-session is uninitialized");
-				return;
-			}
+		const auto &disk_cache = server()->disk_cache;
+
+		if (!memory_object && disk_cache->is_enabled()
+				&& disk_cache->get_config().admission_threshold > 0
+				&& server()->hot_keys->requests(couple, key)
+					>= disk_cache->get_config().admission_threshold) {
+			disk_cache->set(couple, key, data_pointer
+					, lookup_result_entry_opt->file_info()->mtime, disk_version);
 		}
 
 		next = std::bind(&req_get::request_is_finished, shared_from_this());
@@ -544,7 +679,98 @@ elliptics::req_get::detect_content_type(const ie::read_result_entry &entry) {
 				, offset, size, std::move(close_callback), error_callback);
 	}
 
-	send_chunk(std::move(data_pointer), std::move(next), std::move(error_callback));
+	send_chunk(std::move(encoded_data), std::move(next), std::move(error_callback));
+}
+
+ioremap::elliptics::data_pointer
+elliptics::req_get::gzip_whole_file(const ie::data_pointer &data_pointer) {
+	const auto &mtime = lookup_result_entry_opt
+		? lookup_result_entry_opt->file_info()->mtime : memory_object->timestamp;
+	auto compressed = server()->hot_object_cache->get(couple, key, "gzip");
+
+	if (compressed && std::make_tuple(compressed->timestamp.tsec, compressed->timestamp.tnsec)
+			== std::make_tuple(mtime.tsec, mtime.tnsec)) {
+		HANDY_COUNTER_INCREMENT("mds.get.gzip.variant_hit");
+		HANDY_COUNTER_INCREMENT("mds.get.gzip.original_bytes", data_pointer.size());
+		HANDY_COUNTER_INCREMENT("mds.get.gzip.compressed_bytes", compressed->data.size());
+		set_content_encoding("gzip", compressed->data.size());
+		return compressed->data;
+	}
+
+	ie::data_pointer result;
+
+	try {
+		util::timer_t timer;
+		result = gzip_compress(data_pointer, ns_settings(ns_state).gzip_level);
+		auto spent_time = timer.get_us();
+
+		MDS_LOG_INFO("data was compressed: original-size=%llu; compressed-size=%llu; spent-time=%lldus"
+				, static_cast<unsigned long long>(data_pointer.size())
+				, static_cast<unsigned long long>(result.size())
+				, static_cast<long long>(spent_time));
+		HANDY_COUNTER_INCREMENT("mds.get.gzip.time_us", spent_time);
+	} catch (const std::exception &ex) {
+		MDS_LOG_ERROR("cannot compress data: %s", ex.what());
+		HANDY_COUNTER_INCREMENT("mds.get.gzip.failed");
+		return data_pointer;
+	}
+
+	// Incompressible data is sent as it is, clients gain nothing from decoding it
+	if (result.size() >= data_pointer.size()) {
+		HANDY_COUNTER_INCREMENT("mds.get.gzip.incompressible");
+		return data_pointer;
+	}
+
+	HANDY_COUNTER_INCREMENT("mds.get.gzip.compressed");
+	HANDY_COUNTER_INCREMENT("mds.get.gzip.original_bytes", data_pointer.size());
+	HANDY_COUNTER_INCREMENT("mds.get.gzip.compressed_bytes", result.size());
+
+	if (server()->hot_object_cache->is_enabled() && server()->hot_keys->is_hot(couple, key)) {
+		server()->hot_object_cache->set(couple, key, result, mtime, memory_version, "gzip");
+	}
+
+	set_content_encoding("gzip", result.size());
+	return result;
+}
+
+bool
+elliptics::req_get::gzip_variant_may_be_served(size_t size, bool send_whole_file) {
+	const auto &settings = ns_settings(ns_state);
+	const auto &headers = request().headers();
+
+	// The same conditions as in detect_content_type: only the whole file read by one chunk
+	if (!settings.gzip_is_enabled
+			|| static_cast<int64_t>(size) < settings.gzip_min_size
+			|| static_cast<int64_t>(size) > settings.gzip_max_size
+			|| size > static_cast<size_t>(server()->m_read_chunk_size)
+			|| (headers.get("Range") && !send_whole_file)) {
+		return false;
+	}
+
+	return encoding_is_accepted(headers.get("Accept-Encoding").get_value_or(""), "gzip");
+}
+
+void
+elliptics::req_get::set_content_encoding(const std::string &encoding, size_t size) {
+	auto &headers = prospect_http_response.headers();
+
+	headers.set("Content-Encoding", encoding);
+	headers.set_content_length(size);
+
+	if (auto etag = headers.get("ETag")) {
+		headers.set("ETag", make_encoded_etag(*etag, encoding));
+	}
+}
+
+void
+elliptics::req_get::add_vary_accept_encoding(ioremap::swarm::http_headers &headers) {
+	auto vary = headers.get("Vary");
+
+	if (!vary) {
+		headers.set("Vary", "Accept-Encoding");
+	} else if (vary->find("Accept-Encoding") == std::string::npos) {
+		headers.set("Vary", *vary + ", Accept-Encoding");
+	}
 }
 
 namespace elliptics {
@@ -581,6 +807,11 @@ req_get::on_request(const ioremap::thevoid::http_request &http_request
 		}
 
 		key = std::get<1>(prep_session).remote();
+
+		// The id is computed once, all storage requests and mastermind queries reuse it
+		ell_key = std::get<1>(prep_session);
+		ell_key.transform(*m_session);
+		ell_key.set_id(ell_key.id());
 	} catch (const std::exception &ex) {
 		MDS_LOG_ERROR("Get: \"%s\"", ex.what());
 		send_reply(400);
@@ -647,14 +878,39 @@ req_get::on_request(const ioremap::thevoid::http_request &http_request
 		return;
 	}
 
+	couple = m_session->get_groups();
+	server()->hot_keys->hit(ns_state.name(), couple, key, 1, 0);
+
+	if (server()->delete_is_pending(couple, key)) {
+		MDS_LOG_INFO("Get: key is deleted, delete is not applied yet");
+		send_reply(404);
+		MDS_REQUEST_REPLY("get", 404, reinterpret_cast<uint64_t>(this->reply().get()));
+		return;
+	}
+
+	// The signature made after the key was invalidated is not cached
+	signature_version = server()->signature_cache->version();
+
+	// Hot keys are redirected without lookup while the signature is fresh
+	if (try_to_redirect_from_cache()) {
+		return;
+	}
+
 	m_first_chunk = true;
 	with_chunked_csum = false;
 	headers_were_sent = false;
 	some_data_were_sent = false;
 	has_internal_storage_error = false;
 
+	if (try_to_send_from_memory()) {
+		return;
+	}
 
+	start_lookup();
+}
 
+void
+req_get::start_lookup() {
 	{
 		auto ioflags = m_session->get_ioflags();
 		m_session->set_ioflags(ioflags | DNET_IO_FLAGS_NOCSUM);
@@ -663,6 +919,16 @@ req_get::on_request(const ioremap::thevoid::http_request &http_request
 		auto session = m_session->clone();
 		auto groups = session.get_groups();
 		groups.insert(groups.end(), cached_groups.begin(), cached_groups.end());
+
+		// Reads of a hot key are spread round-robin over all its groups including cache ones
+		// instead of landing on the fastest node
+		bool is_hot = server()->hot_keys->is_hot(couple, key);
+
+		if (is_hot) {
+			auto shift = server()->hot_keys_round_robin++ % groups.size();
+			std::rotate(groups.begin(), groups.begin() + shift, groups.end());
+		}
+
 		session.set_groups(groups);
 
 		{
@@ -672,9 +938,17 @@ req_get::on_request(const ioremap::thevoid::http_request &http_request
 			MDS_LOG_INFO("%s", msg.c_str());
 		}
 
+		// The rotated group is preferred to spread hot keys, but a slow one is not waited for
+		boost::optional<parallel_lookuper_t::preference_t> preference;
+
+		if (is_hot) {
+			preference = server()->lookup_preference();
+		}
+
 		parallel_lookuper_ptr = make_parallel_lookuper(
 				ioremap::swarm::logger(logger(), blackhole::log::attributes_t())
-				, session, key);
+				, session, ell_key, std::move(preference), server()->groups_health
+				, server()->storage_flow(ns_state));
 
 		m_session->set_ioflags(ioflags);
 		m_session->set_filter(ie::filters::positive);
@@ -689,8 +963,6 @@ req_get::on_request(const ioremap::thevoid::http_request &http_request
 
 groups_t
 req_get::get_cached_groups() {
-	auto ell_key = ioremap::elliptics::key{key};
-	m_session->transform(ell_key);
 	auto str_ell_id = std::string{dnet_dump_id_str_full(ell_key.id().id)};
 
 	auto groups = m_session->get_groups();
@@ -779,8 +1051,14 @@ std::tuple<bool, bool> req_get::process_precondition_headers(const time_t timest
 		}
 	}
 
+	auto gzip_etag = make_encoded_etag(etag, "gzip");
+
 	if (auto if_match_header = headers.get("If-Match")) {
-		if (*if_match_header != etag) {
+		bool is_matched = *if_match_header == etag
+			|| (*if_match_header == gzip_etag
+					&& gzip_variant_may_be_served(size, send_whole_file));
+
+		if (!is_matched) {
 			if (if_range) {
 				send_whole_file = true;
 			} else {
@@ -791,9 +1069,15 @@ std::tuple<bool, bool> req_get::process_precondition_headers(const time_t timest
 		}
 	}
 
+	// The compressed variant is revalidated by its own ETag
+	auto not_modified_etag = etag;
+
 	if (auto if_none_match_header = headers.get("If-None-Match")) {
 		has_304_headers = true;
-		if (*if_none_match_header != etag) {
+		if (*if_none_match_header == gzip_etag
+				&& gzip_variant_may_be_served(size, send_whole_file)) {
+			not_modified_etag = *if_none_match_header;
+		} else if (*if_none_match_header != etag) {
 			if_prospect_304 = false;
 		}
 	}
@@ -830,15 +1114,34 @@ std::tuple<bool, bool> req_get::process_precondition_headers(const time_t timest
 #undef MAKE_TIME_TUPLE
 
 	if (has_304_headers && if_prospect_304) {
-		send_reply(304);
+		HANDY_COUNTER_INCREMENT("mds.get.revalidation.not_modified");
+
+		// RFC 7232, Section 4.1: 304 carries the same validators and caching headers as 200
+		ioremap::thevoid::http_response reply;
+		reply.set_code(304);
+		reply.headers().set_last_modified(timestamp);
+		reply.headers().set("ETag", not_modified_etag);
+		reply.headers().set_content_length(0);
+		set_cache_control(reply.headers(), size);
+
+		if (not_modified_etag != etag) {
+			add_vary_accept_encoding(reply.headers());
+		}
+
+		send_reply(std::move(reply));
 		MDS_REQUEST_REPLY("get", 304, reinterpret_cast<uint64_t>(this->reply().get()));
 		return std::make_tuple(true, false);
 	}
 
+	if (has_304_headers) {
+		HANDY_COUNTER_INCREMENT("mds.get.revalidation.full_body");
+	}
+
 	prospect_http_response.set_code(200);
 	prospect_http_response.headers().set_last_modified(timestamp);
 	prospect_http_response.headers().set("ETag", etag);
 	prospect_http_response.headers().set("Accept-Ranges", "bytes");
+	set_cache_control(prospect_http_response.headers(), size);
 
 	return std::make_tuple(false, send_whole_file);
 }
@@ -882,12 +1185,11 @@ req_get::get_redirect_query_args() {
 	return result;
 }
 
-bool req_get::try_to_redirect_request(const ie::sync_lookup_result &slr, const size_t size) {
-
+bool req_get::redirect_is_allowed(const size_t size) {
 	auto redirect_arg = get_redirect_arg();
 
 	if (redirect_arg != redirect_arg_tag::client_want_redirect) {
-		auto redirect_size = ns_settings(ns_state).redirect_content_length_threshold;
+		auto redirect_size = get_redirect_content_length_threshold();
 		if (redirect_size == -1) {
 			MDS_LOG_INFO("cannot redirect: redirect-content-length-threshold is infinity");
 			return false;
@@ -896,7 +1198,7 @@ bool req_get::try_to_redirect_request(const ie::sync_lookup_result &slr, const s
 		if (static_cast<size_t>(redirect_size) > size) {
 			std::ostringstream oss;
 			oss << "cannot redirect: file is to small;"
-				<< " file-size=" << size << ";"
+				<< " requested-size=" << size << ";"
 				<< " redirect-content-length-threshold=" << redirect_size;
 			auto str = oss.str();
 			MDS_LOG_INFO("%s", str.c_str());
@@ -904,16 +1206,137 @@ bool req_get::try_to_redirect_request(const ie::sync_lookup_result &slr, const s
 		}
 	}
 
+	if (ns_settings(ns_state).sign_token.empty()) {
+		MDS_LOG_INFO("cannot redirect without signature-token");
+
+		if (redirect_arg == redirect_arg_tag::client_want_redirect) {
+			throw http_error(403, "redirect=yes is not allowed for this namespace");
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+std::string
+req_get::get_signature_cache_variant_key(
+		const std::vector<std::tuple<std::string, std::string>> &args) {
 	const auto &headers = request().headers();
+	auto x_regional_host = headers.get("X-Regional-Host").get_value_or("");
+
+	return signature_cache_t::make_variant_key(x_regional_host
+			, expiration_time.get_value_or(ns_settings(ns_state).redirect_expire_time), args);
+}
+
+bool req_get::try_to_redirect_from_cache() {
+	const auto &signature_cache = server()->signature_cache;
+
+	if (!signature_cache->is_enabled()) {
+		return false;
+	}
+
+	auto args = get_redirect_query_args();
+	auto cached = signature_cache->get(
+			signature_cache_t::make_storage_key(m_session->get_groups(), key)
+			, get_signature_cache_variant_key(args));
+
+	if (!cached) {
+		return false;
+	}
 
 	try {
-		if (ns_settings(ns_state).sign_token.empty()) {
-			MDS_LOG_INFO("cannot redirect without signature-token");
+		if (!redirect_is_allowed(requested_size(cached->size))) {
+			return false;
+		}
+	} catch (const std::exception &ex) {
+		MDS_LOG_ERROR("cannot use cached signature: %s", ex.what());
+		return false;
+	}
 
-			if (redirect_arg == redirect_arg_tag::client_want_redirect) {
-				throw http_error(403, "redirect=yes is not allowed for this namespace");
-			}
+	MDS_LOG_INFO("use cached signature");
+
+	send_redirect(cached->host, cached->path, cached->ts, cached->sign, args, cached->size);
+
+	return true;
+}
+
+bool req_get::try_to_send_from_memory() {
+	memory_version = server()->hot_object_cache->version();
+	disk_version = server()->disk_cache->version();
+	memory_object = server()->hot_object_cache->get(couple, key);
+
+	if (!memory_object) {
+		return try_to_send_from_disk();
+	}
+
+	return send_memory_object();
+}
+
+bool req_get::try_to_send_from_disk() {
+	auto self = shared_from_this();
+
+	return server()->disk_cache->get(couple, key
+			, [this, self] (disk_cache_t::object_ptr_t object) {
+				memory_object = std::move(object);
+
+				if (memory_object) {
+					MDS_LOG_INFO("object is read from disk cache: size=%llu"
+							, static_cast<unsigned long long>(total_size()));
+
+					if (server()->hot_keys->is_hot(couple, key)) {
+						server()->hot_object_cache->set(couple, key, memory_object->data
+								, memory_object->timestamp, memory_version);
+					}
+
+					if (send_memory_object()) {
+						return;
+					}
+				}
+
+				start_lookup();
+			});
+}
 
+bool req_get::send_memory_object() {
+	try {
+		// Redirects take precedence over the memory as they do over preconditions
+		if (redirect_is_allowed(requested_size(total_size()))) {
+			memory_object.reset();
+			return false;
+		}
+
+		MDS_LOG_INFO("object is found in memory: size=%llu"
+				, static_cast<unsigned long long>(total_size()));
+
+		auto res = process_precondition_headers(memory_object->timestamp.tsec, total_size());
+
+		if (std::get<0>(res)) {
+			return true;
+		}
+
+		if (request().method() == "HEAD") {
+			prospect_http_response.headers().set_content_length(total_size());
+			send_reply(std::move(prospect_http_response));
+			MDS_REQUEST_REPLY("get", 200, reinterpret_cast<uint64_t>(this->reply().get()));
+			MDS_REQUEST_STOP("get", reinterpret_cast<uint64_t>(this->reply().get()));
+			return true;
+		}
+
+		start_reading(total_size(), std::get<1>(res));
+	} catch (const http_error &ex) {
+		MDS_LOG_INFO("http_error: status=%d; description=\"%s\"", ex.http_status(), ex.what());
+		send_reply(ex.http_status());
+	}
+
+	return true;
+}
+
+bool req_get::try_to_redirect_request(const ie::sync_lookup_result &slr, const size_t size) {
+	const auto &headers = request().headers();
+
+	try {
+		if (!redirect_is_allowed(size)) {
 			return false;
 		}
 
@@ -925,24 +1348,22 @@ bool req_get::try_to_redirect_request(const ie::sync_lookup_result &slr, const s
 		auto message = make_signature_message(file_location, ts, args);
 		auto sign = make_signature(message, ns_settings(ns_state).sign_token);
 
-		std::stringstream oss;
-		oss << "//" << file_location.host << file_location.path << "?ts=" << ts;
-
-		for (auto it = args.begin(), end = args.end(); it != end; ++it) {
-			oss << '&' << std::get<0>(*it) << '=' << std::get<1>(*it);
+		{
+			signature_cache_t::value_t value;
+			value.host = file_location.host;
+			value.path = file_location.path;
+			value.ts = ts;
+			value.sign = sign;
+			value.size = total_size();
+
+			server()->signature_cache->set(
+					signature_cache_t::make_storage_key(m_session->get_groups(), key)
+					, get_signature_cache_variant_key(args), std::move(value)
+					, expiration_time.get_value_or(ns_settings(ns_state).redirect_expire_time)
+					, signature_version);
 		}
 
-		oss << "&sign=" << sign;
-
-		ioremap::thevoid::http_response http_response;
-		http_response.set_code(302);
-		http_response.headers().set_content_length(0);
-
-		auto location = oss.str();
-		http_response.headers().set("Location", location);
-
-		MDS_LOG_INFO("redirect request to \"%s\"", location.c_str());
-		send_reply(std::move(http_response));
+		send_redirect(file_location.host, file_location.path, ts, sign, args, total_size());
 
 		return true;
 	} catch (const std::exception &ex) {
@@ -951,6 +1372,120 @@ bool req_get::try_to_redirect_request(const ie::sync_lookup_result &slr, const s
 	}
 }
 
+void
+req_get::set_cache_control(ioremap::swarm::http_headers &headers, size_t size
+		, boost::optional<std::chrono::seconds> max_lifetime) {
+	const auto &settings = ns_settings(ns_state);
+	const auto *rule = find_cache_control_rule(settings, key, size);
+
+	if (!rule) {
+		return;
+	}
+
+	std::ostringstream oss;
+
+	if (max_lifetime) {
+		// Redirect expires with its signature and is useless for other clients
+		oss << "private, max-age="
+			<< std::max<int64_t>(std::min<int64_t>(rule->max_age, max_lifetime->count()), 0);
+	} else {
+		oss << "public, max-age=" << rule->max_age;
+
+		if (rule->s_maxage != -1) {
+			oss << ", s-maxage=" << rule->s_maxage;
+		}
+
+		if (rule->stale_while_revalidate != 0) {
+			oss << ", stale-while-revalidate=" << rule->stale_while_revalidate;
+		}
+
+		if (settings.cache_control_immutable) {
+			oss << ", immutable";
+		}
+	}
+
+	headers.set("Cache-Control", oss.str());
+
+	if (!settings.cache_control_vary.empty()) {
+		std::ostringstream vary;
+
+		for (auto it = settings.cache_control_vary.begin(), end = settings.cache_control_vary.end()
+				; it != end; ++it) {
+			if (it != settings.cache_control_vary.begin()) {
+				vary << ", ";
+			}
+
+			vary << *it;
+		}
+
+		headers.set("Vary", vary.str());
+	}
+}
+
+void req_get::send_redirect(const std::string &host, const std::string &path
+		, const std::string &ts, const std::string &sign
+		, const std::vector<std::tuple<std::string, std::string>> &args
+		, size_t size) {
+	std::stringstream oss;
+	oss << "//" << host << path << "?ts=" << ts;
+
+	for (auto it = args.begin(), end = args.end(); it != end; ++it) {
+		oss << '&' << std::get<0>(*it) << '=' << std::get<1>(*it);
+	}
+
+	oss << "&sign=" << sign;
+
+	ioremap::thevoid::http_response http_response;
+	http_response.set_code(302);
+	http_response.headers().set_content_length(0);
+
+	auto location = oss.str();
+	http_response.headers().set("Location", location);
+
+	{
+		using namespace std::chrono;
+
+		// ts is the expiration time of the signature in microseconds
+		auto expires_at = microseconds(std::strtoll(ts.c_str(), nullptr, 16));
+		auto now = duration_cast<microseconds>(system_clock::now().time_since_epoch());
+
+		set_cache_control(http_response.headers(), size
+				, duration_cast<seconds>(expires_at - now));
+	}
+
+	MDS_LOG_INFO("redirect request to \"%s\"", location.c_str());
+	send_reply(std::move(http_response));
+}
+
+int64_t
+req_get::get_redirect_content_length_threshold() {
+	const auto &settings = ns_settings(ns_state);
+
+	if (!settings.redirect_is_adaptive) {
+		return settings.redirect_content_length_threshold;
+	}
+
+	auto min_threshold = settings.redirect_min_content_length_threshold;
+	auto max_threshold = settings.redirect_max_content_length_threshold;
+
+	// The more the proxy is loaded the more requests are redirected
+	auto pressure = server()->egress_meter->pressure();
+	auto threshold = max_threshold
+		- static_cast<int64_t>(pressure * (max_threshold - min_threshold));
+
+	{
+		std::ostringstream oss;
+		oss << "adaptive redirect threshold: pressure=" << pressure
+			<< "; threshold=" << threshold
+			<< "; min-threshold=" << min_threshold
+			<< "; max-threshold=" << max_threshold;
+		auto msg = oss.str();
+		MDS_LOG_INFO("%s", msg.c_str());
+	}
+
+	return threshold;
+}
+
 void req_get::start_reading(const size_t size, bool send_whole_file) {
 	const auto &headers = request().headers();
 	auto range_header = headers.get("Range");
@@ -1031,8 +1566,35 @@ void req_get::start_reading(const size_t size, bool send_whole_file) {
 	send_reply(std::move(prospect_http_response));
 }
 
+size_t
+req_get::requested_size(size_t size) {
+	auto range_header = request().headers().get("Range");
+
+	if (!range_header) {
+		return size;
+	}
+
+	auto ranges = parse_range_header(*range_header, size);
+
+	if (!ranges) {
+		return size;
+	}
+
+	size_t result = 0;
+
+	for (auto it = ranges->begin(), end = ranges->end(); it != end; ++it) {
+		result += it->size;
+	}
+
+	return result;
+}
+
 size_t
 req_get::total_size() {
+	if (memory_object) {
+		return memory_object->data.size();
+	}
+
 	if (!lookup_result_entry_opt) {
 		return 0;
 	}
@@ -1041,6 +1603,11 @@ req_get::total_size() {
 }
 
 void req_get::on_error() {
+	// Stored callbacks refer to the handler, the cycle is broken here as the range will not be
+	// continued. The callback which is being called is a copy, hence it can be safely dropped
+	range_state.on_result = nullptr;
+	range_state.on_error = nullptr;
+
 	if (headers_were_sent) {
 		MDS_LOG_ERROR("error occured after headers were sent and cannot be reported to the client");
 		reply()->close(boost::system::errc::make_error_code(
@@ -1060,6 +1627,13 @@ void req_get::on_error() {
 
 void
 req_get::request_is_finished() {
+	if (parallel_lookuper_ptr) {
+		parallel_lookuper_ptr->stop();
+	}
+
+	range_state.on_result = nullptr;
+	range_state.on_error = nullptr;
+
 	reply()->close(boost::system::error_code());
 	MDS_REQUEST_STOP("get", reinterpret_cast<uint64_t>(this->reply().get()));
 }
@@ -37,6 +37,7 @@ buffer(const ioremap::elliptics::data_pointer &data_pointer);
 #include "ranges.hpp"
 #include "lookuper.hpp"
 #include "timer.hpp"
+#include "signature_cache.hpp"
 
 #include <elliptics/session.hpp>
 
@@ -104,7 +105,12 @@ private:
 
 	void
 	read_chunk(size_t offset, size_t size
-			, std::function<void (const ie::read_result_entry &)> on_result
+			, std::function<void (const ie::data_pointer &)> on_result
+			, std::function<void ()> on_error);
+
+	void
+	read_reserved_chunk(size_t offset, size_t size
+			, std::function<void (const ie::data_pointer &)> on_result
 			, std::function<void ()> on_error);
 
 	void
@@ -113,7 +119,7 @@ private:
 			, const ie::error_info &error_info
 			, util::timer_t timer
 			, size_t offset, size_t size
-			, std::function<void (const ie::read_result_entry &)> on_result
+			, std::function<void (const ie::data_pointer &)> on_result
 			, std::function<void ()> on_error);
 
 	void
@@ -123,7 +129,7 @@ private:
 
 	void
 	send_chunk_is_finished(const boost::system::error_code &error_code
-			, util::timer_t timer
+			, util::timer_t timer, size_t size
 			, std::function<void ()> on_result
 			, std::function<void ()> on_error);
 
@@ -136,10 +142,20 @@ private:
 	read_and_send_range(size_t offset, size_t size
 			, std::function<void ()> on_result
 			, std::function<void ()> on_error);
+
 	void
-	read_and_send_ranges(ranges_t ranges, std::list<std::string> ranges_headers
-			, std::function<void ()> on_result
-			, std::function<void ()> on_error);
+	read_and_send_range_chunk();
+
+	void
+	range_chunk_is_sent();
+
+	// Sends pending_ranges separated by pending_boundaries
+	void
+	read_and_send_ranges();
+
+	// Looks the key up in all groups and sends the data of the first good one
+	void
+	start_lookup();
 
 	void
 	process_whole_file();
@@ -151,7 +167,24 @@ private:
 	process_ranges(ranges_t ranges, std::list<std::string> boundaries);
 
 	void
-	detect_content_type(const ie::read_result_entry &entry);
+	detect_content_type(const ie::data_pointer &data_pointer);
+
+	// Returns the gzipped file and sets Content-Encoding, Content-Length and ETag of the variant,
+	// the data is returned as it is if it cannot be compressed profitably
+	ie::data_pointer
+	gzip_whole_file(const ie::data_pointer &data_pointer);
+
+	// Tells whether the gzipped variant can be the answer to the request before the data is read.
+	// The content type and the compression ratio are not known yet, they are vouched for
+	// by the ETag of the variant which is issued only if the variant was sent
+	bool
+	gzip_variant_may_be_served(size_t size, bool send_whole_file);
+
+	void
+	set_content_encoding(const std::string &encoding, size_t size);
+
+	static void
+	add_vary_accept_encoding(ioremap::swarm::http_headers &headers);
 
 	std::tuple<bool, bool> process_precondition_headers(const time_t timestamp, const size_t size);
 
@@ -161,9 +194,43 @@ private:
 	std::vector<std::tuple<std::string, std::string>>
 	get_redirect_query_args();
 
+	int64_t
+	get_redirect_content_length_threshold();
+
+	// Throws http_error if client wants redirect but it is not allowed
+	bool
+	redirect_is_allowed(const size_t size);
+
+	std::string
+	get_signature_cache_variant_key(const std::vector<std::tuple<std::string, std::string>> &args);
+
+	bool try_to_redirect_from_cache();
+	// Hot objects promoted into memory or written to disk cache are sent
+	// without any request to storage
+	bool try_to_send_from_memory();
+	bool try_to_send_from_disk();
+	// Returns false if the object should be redirected instead
+	bool send_memory_object();
 	bool try_to_redirect_request(const ie::sync_lookup_result &slr, const size_t size);
+
+	void
+	send_redirect(const std::string &host, const std::string &path
+			, const std::string &ts, const std::string &sign
+			, const std::vector<std::tuple<std::string, std::string>> &args
+			, size_t size);
+
+	// Sets Cache-Control and Vary in accordance with the namespace policy,
+	// max_lifetime bounds max-age of responses which expire earlier than data, e.g. redirects
+	void
+	set_cache_control(ioremap::swarm::http_headers &headers, size_t size
+			, boost::optional<std::chrono::seconds> max_lifetime = boost::none);
 	void start_reading(const size_t size, bool send_whole_file);
 
+	// The size of data which the client asks for: the sum of requested ranges or
+	// the size of the whole file
+	size_t
+	requested_size(size_t size);
+
 	size_t
 	total_size();
 
@@ -181,8 +248,17 @@ private:
 	boost::optional<ie::session> m_session;
 	mastermind::namespace_state_t ns_state;
 	std::string key;
+	ie::key ell_key;
+	couple_t couple;
 	parallel_lookuper_ptr_t parallel_lookuper_ptr;
 	boost::optional<ie::lookup_result_entry> lookup_result_entry_opt;
+	hot_object_cache_t::object_ptr_t memory_object;
+	// The object read after the key was invalidated is not cached
+	hot_object_cache_t::version_t memory_version;
+	disk_cache_t::version_t disk_version;
+	signature_cache_t::version_t signature_version;
+	memory_accountant_t::reservation_ptr_t chunk_reservation;
+	transfer_rate_guard_t::transfer_ptr_t transfer;
 
 	bool m_first_chunk;
 	bool with_chunked_csum;
@@ -193,6 +269,17 @@ private:
 	groups_t cached_groups;
 	std::vector<int> bad_groups;
 
+	// The range which is being sent
+	struct {
+		size_t offset;
+		size_t size;
+		std::function<void ()> on_result;
+		std::function<void ()> on_error;
+	} range_state;
+
+	ranges_t pending_ranges;
+	std::list<std::string> pending_boundaries;
+
 	boost::optional<std::chrono::seconds> expiration_time;
 };
 
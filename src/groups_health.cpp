@@ -0,0 +1,112 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "groups_health.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <algorithm>
+
+namespace elliptics {
+
+namespace {
+
+// Weight of a new reply in the moving averages
+const double smoothing_factor = 0.1;
+
+// An always failing group looks as slow as this penalty, microseconds
+const double error_penalty = 10 * 1000 * 1000;
+
+} // namespace
+
+groups_health_t::groups_health_t()
+{
+}
+
+void
+groups_health_t::report(group_t group, bool is_successful, std::chrono::microseconds latency) {
+	double error = is_successful ? 0 : 1;
+	state_t state;
+
+	{
+		lock_guard_t lock_guard(mutex);
+
+		auto it = states.find(group);
+
+		if (it == states.end()) {
+			state.latency = latency.count();
+			state.error_rate = error;
+			states.insert(std::make_pair(group, state));
+		} else {
+			it->second.latency += smoothing_factor * (latency.count() - it->second.latency);
+			it->second.error_rate += smoothing_factor * (error - it->second.error_rate);
+			state = it->second;
+		}
+	}
+
+	HANDY_GAUGE_SET(("mds.groups.%d.latency_us", group), state.latency);
+	HANDY_GAUGE_SET(("mds.groups.%d.error_rate", group), state.error_rate);
+}
+
+double
+groups_health_t::score(group_t group) const {
+	lock_guard_t lock_guard(mutex);
+
+	auto it = states.find(group);
+
+	if (it == states.end()) {
+		return 0;
+	}
+
+	return score(it->second);
+}
+
+groups_t
+groups_health_t::rank(groups_t groups) const {
+	std::vector<std::pair<double, group_t>> scores;
+	scores.reserve(groups.size());
+
+	{
+		lock_guard_t lock_guard(mutex);
+
+		for (auto it = groups.begin(), end = groups.end(); it != end; ++it) {
+			auto sit = states.find(*it);
+			scores.emplace_back(sit == states.end() ? 0 : score(sit->second), *it);
+		}
+	}
+
+	std::stable_sort(scores.begin(), scores.end()
+			, [] (const std::pair<double, group_t> &lhs, const std::pair<double, group_t> &rhs) {
+				return lhs.first < rhs.first;
+			});
+
+	for (size_t index = 0; index != scores.size(); ++index) {
+		groups[index] = scores[index].second;
+	}
+
+	return groups;
+}
+
+double
+groups_health_t::score(const state_t &state) const {
+	return state.latency + state.error_rate * error_penalty;
+}
+
+} // namespace elliptics
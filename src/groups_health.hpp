@@ -0,0 +1,72 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef MDS_PROXY__SRC__GROUPS_HEALTH__HPP
+#define MDS_PROXY__SRC__GROUPS_HEALTH__HPP
+
+#include "utils.hpp"
+
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+
+namespace elliptics {
+
+// Passive health of groups collected from replies of storage operations.
+// Every group keeps exponentially weighted moving averages of the latency and
+// of the error rate, the score of a group is its expected latency penalized by errors.
+// Groups without replies are considered healthy to give them a chance to be measured.
+class groups_health_t {
+public:
+	groups_health_t();
+
+	// A failed reply is the one which says nothing about the data, e.g. a timeout.
+	// -ENOENT is a successful reply in terms of health
+	void
+	report(group_t group, bool is_successful, std::chrono::microseconds latency);
+
+	// The lower the better, microseconds
+	double
+	score(group_t group) const;
+
+	// Returns groups ordered by score, groups with equal scores keep their order
+	groups_t
+	rank(groups_t groups) const;
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::lock_guard<mutex_t> lock_guard_t;
+
+	struct state_t {
+		double latency;
+		double error_rate;
+	};
+
+	double
+	score(const state_t &state) const;
+
+	mutable mutex_t mutex;
+	std::unordered_map<group_t, state_t> states;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__GROUPS_HEALTH__HPP */
+
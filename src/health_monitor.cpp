@@ -0,0 +1,146 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "health_monitor.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+namespace elliptics {
+
+health_monitor_t::health_monitor_t(ioremap::swarm::logger bh_logger_, config_t config_
+		, evaluate_function_t evaluate_function_)
+	: bh_logger(std::move(bh_logger_))
+	, config(std::move(config_))
+	, evaluate_function(std::move(evaluate_function_))
+	, published_code(500)
+	, work_is_done(false)
+{
+	config.period = std::max(config.period, 1);
+
+	// The first probe must not see the default state
+	check();
+
+	MDS_LOG_INFO("starting background thread");
+	background_evaluator = std::thread(std::bind(&health_monitor_t::background_loop, this));
+}
+
+health_monitor_t::~health_monitor_t() {
+	MDS_LOG_INFO("stopping health monitor");
+
+	{
+		lock_guard_t lock_guard(mutex);
+		work_is_done = true;
+		background_evaluator_cv.notify_one();
+	}
+
+	background_evaluator.join();
+	MDS_LOG_INFO("health monitor is stopped");
+}
+
+int
+health_monitor_t::code() const {
+	return published_code;
+}
+
+int
+health_monitor_t::check() {
+	lock_guard_t lock_guard(evaluation_mutex);
+
+	int code = 500;
+	std::string description;
+
+	try {
+		auto health = evaluate_function();
+		code = get_code(health);
+		description = describe(health);
+	} catch (const std::exception &ex) {
+		description = std::string("cannot evaluate health: ") + ex.what();
+	}
+
+	published_code = code;
+	HANDY_GAUGE_SET("mds.health.code", code);
+
+	if (description != last_description) {
+		if (code == 200) {
+			MDS_LOG_INFO("health is changed: code=%d; %s", code, description.c_str());
+		} else {
+			MDS_LOG_ERROR("health is changed: code=%d; %s", code, description.c_str());
+		}
+
+		last_description = std::move(description);
+	}
+
+	return code;
+}
+
+ioremap::swarm::logger &
+health_monitor_t::logger() {
+	return bh_logger;
+}
+
+int
+health_monitor_t::get_code(const health_t &health) const {
+	if (!health.mastermind_is_valid || !health.session_is_initialized
+			|| health.state_num < health.die_limit) {
+		return 500;
+	}
+
+	if (config.overload_is_unhealthy && health.is_overloaded) {
+		return 503;
+	}
+
+	return 200;
+}
+
+std::string
+health_monitor_t::describe(const health_t &health) {
+	std::ostringstream oss;
+	oss
+		<< "mastermind=" << (health.mastermind_is_valid ? "valid" : "invalid")
+		<< "; session=" << (health.session_is_initialized ? "initialized" : "uninitialized")
+		<< "; nodes-alive=" << health.state_num
+		<< "; die-limit=" << health.die_limit
+		<< "; overloaded=" << (health.is_overloaded ? "yes" : "no");
+	return oss.str();
+}
+
+void
+health_monitor_t::background_loop() {
+	lock_guard_t lock_guard(mutex);
+
+	while (!work_is_done) {
+		background_evaluator_cv.wait_for(lock_guard, std::chrono::milliseconds(config.period));
+
+		if (work_is_done) {
+			break;
+		}
+
+		lock_guard.unlock();
+		check();
+		lock_guard.lock();
+	}
+}
+
+} // namespace elliptics
+
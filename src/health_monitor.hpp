@@ -0,0 +1,105 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef MDS_PROXY__SRC__HEALTH_MONITOR__HPP
+#define MDS_PROXY__SRC__HEALTH_MONITOR__HPP
+
+#include "loggers.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <string>
+
+namespace elliptics {
+
+// Evaluates health of the proxy in background and publishes the http code for /ping.
+// Load balancers probe the proxy many times a second, hence the probe only reads the atomic
+// and the live check (which clones a session and counts connected nodes) runs once a period.
+class health_monitor_t {
+public:
+	struct config_t {
+		// milliseconds
+		int period;
+		// The proxy is reported unhealthy while requests wait for memory
+		bool overload_is_unhealthy;
+	};
+
+	struct health_t {
+		bool mastermind_is_valid;
+		bool session_is_initialized;
+		size_t state_num;
+		size_t die_limit;
+		bool is_overloaded;
+	};
+
+	typedef std::function<health_t ()> evaluate_function_t;
+
+	health_monitor_t(ioremap::swarm::logger bh_logger_, config_t config_
+			, evaluate_function_t evaluate_function_);
+	~health_monitor_t();
+
+	// Returns the code of the last background evaluation
+	int
+	code() const;
+
+	// Runs the live check, the result is published as well
+	int
+	check();
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+
+	ioremap::swarm::logger &
+	logger();
+
+	int
+	get_code(const health_t &health) const;
+
+	static std::string
+	describe(const health_t &health);
+
+	void
+	background_loop();
+
+	ioremap::swarm::logger bh_logger;
+
+	config_t config;
+	evaluate_function_t evaluate_function;
+
+	std::atomic<int> published_code;
+
+	// Serializes evaluations to log changes of the health exactly once
+	mutex_t evaluation_mutex;
+	std::string last_description;
+
+	mutex_t mutex;
+	std::thread background_evaluator;
+	std::condition_variable background_evaluator_cv;
+	bool work_is_done;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__HEALTH_MONITOR__HPP */
+
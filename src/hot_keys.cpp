@@ -0,0 +1,261 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "hot_keys.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+namespace elliptics {
+
+namespace {
+
+// Counters are rescaled when the weight reaches 2^32
+const double max_weight_exponent = 32;
+
+} // namespace
+
+hot_keys_t::hot_keys_t(config_t config_)
+	: config(std::move(config_))
+	, shard_capacity(0)
+{
+	if (!is_enabled()) {
+		return;
+	}
+
+	config.shards = std::max<size_t>(std::min(config.shards, config.capacity), 1);
+	config.half_life = std::max(config.half_life, 1);
+	shard_capacity = std::max<size_t>(config.capacity / config.shards, 1);
+
+	for (size_t index = 0; index != config.shards; ++index) {
+		std::unique_ptr<shard_t> shard(new shard_t);
+		shard->base_time = clock_t::now();
+		shards.emplace_back(std::move(shard));
+	}
+}
+
+bool
+hot_keys_t::is_enabled() const {
+	return config.capacity != 0;
+}
+
+const hot_keys_t::config_t &
+hot_keys_t::get_config() const {
+	return config;
+}
+
+void
+hot_keys_t::hit(const std::string &ns, const couple_t &couple, const std::string &key
+		, size_t requests, size_t bytes) {
+	if (!is_enabled() || couple.empty()) {
+		return;
+	}
+
+	auto id = make_id(couple, key);
+	auto &shard = get_shard(id);
+	auto now = clock_t::now();
+
+	lock_guard_t lock_guard(shard.mutex);
+
+	if (std::log2(weight(shard, now)) >= max_weight_exponent) {
+		rescale(shard, now);
+	}
+
+	auto w = weight(shard, now);
+	auto it = shard.entries.find(id);
+
+	if (it != shard.entries.end()) {
+		auto &entry = it->second;
+
+		if (requests != 0) {
+			shard.index.erase(std::make_pair(entry.requests, id));
+			entry.requests += requests * w;
+			shard.index.emplace(entry.requests, id);
+		}
+
+		entry.bytes += bytes * w;
+		return;
+	}
+
+	if (requests == 0) {
+		return;
+	}
+
+	entry_t entry;
+	entry.ns = ns;
+	entry.couple_id = *std::min_element(couple.begin(), couple.end());
+	entry.key = key;
+	entry.requests = requests * w;
+	entry.bytes = bytes * w;
+	entry.writes = 0;
+	entry.error = 0;
+
+	if (shard.entries.size() >= shard_capacity) {
+		auto victim = shard.index.begin();
+
+		entry.error = victim->first;
+		entry.requests += victim->first;
+
+		shard.entries.erase(victim->second);
+		shard.index.erase(victim);
+	}
+
+	shard.index.emplace(entry.requests, id);
+	shard.entries.emplace(std::move(id), std::move(entry));
+}
+
+void
+hot_keys_t::written(const couple_t &couple, const std::string &key) {
+	if (!is_enabled() || couple.empty()) {
+		return;
+	}
+
+	auto id = make_id(couple, key);
+	auto &shard = get_shard(id);
+	auto now = clock_t::now();
+
+	lock_guard_t lock_guard(shard.mutex);
+
+	if (std::log2(weight(shard, now)) >= max_weight_exponent) {
+		rescale(shard, now);
+	}
+
+	auto it = shard.entries.find(id);
+
+	if (it == shard.entries.end()) {
+		return;
+	}
+
+	it->second.writes += weight(shard, now);
+}
+
+double
+hot_keys_t::requests(const couple_t &couple, const std::string &key) const {
+	if (!is_enabled() || couple.empty()) {
+		return 0;
+	}
+
+	auto id = make_id(couple, key);
+	auto &shard = get_shard(id);
+
+	lock_guard_t lock_guard(shard.mutex);
+
+	auto it = shard.entries.find(id);
+
+	if (it == shard.entries.end()) {
+		return 0;
+	}
+
+	return it->second.requests / weight(shard, clock_t::now());
+}
+
+bool
+hot_keys_t::is_hot(const couple_t &couple, const std::string &key) const {
+	if (config.promotion_threshold <= 0) {
+		return false;
+	}
+
+	return requests(couple, key) >= config.promotion_threshold;
+}
+
+std::vector<hot_keys_t::entry_t>
+hot_keys_t::top(size_t limit, const std::string &ns, bool by_bytes) const {
+	std::vector<entry_t> result;
+
+	if (!is_enabled()) {
+		return result;
+	}
+
+	auto now = clock_t::now();
+
+	for (auto it = shards.begin(), end = shards.end(); it != end; ++it) {
+		auto &shard = **it;
+
+		lock_guard_t lock_guard(shard.mutex);
+
+		auto w = weight(shard, now);
+
+		for (auto eit = shard.entries.begin(), eend = shard.entries.end(); eit != eend; ++eit) {
+			const auto &entry = eit->second;
+
+			if (!ns.empty() && entry.ns != ns) {
+				continue;
+			}
+
+			result.emplace_back(entry);
+
+			auto &copy = result.back();
+			copy.requests /= w;
+			copy.bytes /= w;
+			copy.writes /= w;
+			copy.error /= w;
+		}
+	}
+
+	auto comparator = [by_bytes] (const entry_t &lhs, const entry_t &rhs) {
+		return by_bytes ? lhs.bytes > rhs.bytes : lhs.requests > rhs.requests;
+	};
+
+	limit = std::min(limit, result.size());
+
+	std::partial_sort(result.begin(), result.begin() + limit, result.end(), comparator);
+	result.resize(limit);
+
+	return result;
+}
+
+std::string
+hot_keys_t::make_id(const couple_t &couple, const std::string &key) {
+	return std::to_string(*std::min_element(couple.begin(), couple.end())) + '/' + key;
+}
+
+hot_keys_t::shard_t &
+hot_keys_t::get_shard(const std::string &id) const {
+	return *shards[std::hash<std::string>()(id) % shards.size()];
+}
+
+double
+hot_keys_t::weight(const shard_t &shard, clock_t::time_point now) const {
+	auto elapsed = std::chrono::duration<double>(now - shard.base_time).count();
+	return std::exp2(elapsed / config.half_life);
+}
+
+void
+hot_keys_t::rescale(shard_t &shard, clock_t::time_point now) {
+	auto w = weight(shard, now);
+
+	shard.index.clear();
+
+	for (auto it = shard.entries.begin(), end = shard.entries.end(); it != end; ++it) {
+		auto &entry = it->second;
+
+		entry.requests /= w;
+		entry.bytes /= w;
+		entry.writes /= w;
+		entry.error /= w;
+
+		shard.index.emplace(entry.requests, it->first);
+	}
+
+	shard.base_time = now;
+}
+
+} // namespace elliptics
+
@@ -0,0 +1,131 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__HOT_KEYS__HPP
+#define MDS_PROXY__SRC__HOT_KEYS__HPP
+
+#include "utils.hpp"
+
+#include <unordered_map>
+#include <set>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <string>
+
+namespace elliptics {
+
+// Streaming heavy-hitter sketch of keys (space-saving algorithm).
+// Only capacity keys are tracked: a new key replaces the key with the least number
+// of requests and inherits its counter, the inherited value is the error bound of the new key.
+// Counters are decayed exponentially with half-life, hence they approximate the load of
+// the last few half-lives. The decay is applied lazily: increments are scaled by the weight
+// which grows with time, and all counters are rescaled rarely.
+// Keys are spread over shards to keep lock contention of hit() low.
+class hot_keys_t {
+public:
+	struct config_t {
+		size_t capacity;
+		size_t shards;
+		int half_life;
+		// The decayed number of requests from which the key is considered hot,
+		// keys are never hot if it is 0
+		double promotion_threshold;
+	};
+
+	struct entry_t {
+		std::string ns;
+		int couple_id;
+		std::string key;
+
+		double requests;
+		double bytes;
+		// Uploads are not requests: they neither promote the key nor admit it to the disk cache
+		double writes;
+		// Requests which might be inherited from the replaced keys
+		double error;
+	};
+
+	hot_keys_t(config_t config_);
+
+	bool
+	is_enabled() const;
+
+	const config_t &
+	get_config() const;
+
+	// The key starts to be tracked only by requests, hits with only bytes
+	// are accounted for already tracked keys.
+	void
+	hit(const std::string &ns, const couple_t &couple, const std::string &key
+			, size_t requests, size_t bytes);
+
+	// Counts an upload of the key. Uploads do not start tracking of the key, otherwise
+	// written once keys would evict the keys which are read
+	void
+	written(const couple_t &couple, const std::string &key);
+
+	// Returns the decayed number of requests of the key, 0 if the key is not tracked
+	double
+	requests(const couple_t &couple, const std::string &key) const;
+
+	bool
+	is_hot(const couple_t &couple, const std::string &key) const;
+
+	// Returns limit keys with the greatest number of requests or bytes,
+	// all namespaces are considered if ns is empty
+	std::vector<entry_t>
+	top(size_t limit, const std::string &ns, bool by_bytes) const;
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::lock_guard<mutex_t> lock_guard_t;
+	typedef std::chrono::steady_clock clock_t;
+
+	typedef std::set<std::pair<double, std::string>> index_t;
+
+	struct shard_t {
+		mutex_t mutex;
+		std::unordered_map<std::string, entry_t> entries;
+		index_t index;
+		clock_t::time_point base_time;
+	};
+
+	static std::string
+	make_id(const couple_t &couple, const std::string &key);
+
+	shard_t &
+	get_shard(const std::string &id) const;
+
+	double
+	weight(const shard_t &shard, clock_t::time_point now) const;
+
+	void
+	rescale(shard_t &shard, clock_t::time_point now);
+
+	config_t config;
+	size_t shard_capacity;
+	std::vector<std::unique_ptr<shard_t>> shards;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__HOT_KEYS__HPP */
+
@@ -0,0 +1,231 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "hot_object_cache.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <algorithm>
+#include <tuple>
+
+namespace elliptics {
+
+namespace {
+
+// Encodings of variants which are dropped together with the object
+const std::string encodings[] = {"", "gzip"};
+
+const size_t max_invalidations = 65536;
+
+} // namespace
+
+hot_object_cache_t::hot_object_cache_t(config_t config_
+		, std::shared_ptr<memory_accountant_t> memory_accountant_)
+	: config(std::move(config_))
+	, memory_accountant(std::move(memory_accountant_))
+	, total_size(0)
+	, last_version(0)
+	, forgotten_version(0)
+{
+}
+
+bool
+hot_object_cache_t::is_enabled() const {
+	return config.size != 0;
+}
+
+const hot_object_cache_t::config_t &
+hot_object_cache_t::get_config() const {
+	return config;
+}
+
+hot_object_cache_t::object_ptr_t
+hot_object_cache_t::get(const couple_t &couple, const std::string &key
+		, const std::string &encoding) {
+	if (!is_enabled() || couple.empty()) {
+		return object_ptr_t();
+	}
+
+	auto id = make_id(couple, key, encoding);
+
+	reservations_t reservations;
+	lock_guard_t lock_guard(mutex);
+
+	auto it = entries.find(id);
+
+	if (it == entries.end()) {
+		HANDY_COUNTER_INCREMENT("mds.hot_object_cache.miss");
+		return object_ptr_t();
+	}
+
+	if (it->second.valid_until <= clock_t::now()) {
+		erase(it, reservations);
+		update_stats();
+		HANDY_COUNTER_INCREMENT("mds.hot_object_cache.miss");
+		return object_ptr_t();
+	}
+
+	lru.splice(lru.begin(), lru, it->second.lru_iterator);
+
+	HANDY_COUNTER_INCREMENT("mds.hot_object_cache.hit");
+	return it->second.object;
+}
+
+hot_object_cache_t::version_t
+hot_object_cache_t::version() {
+	lock_guard_t lock_guard(mutex);
+
+	return last_version;
+}
+
+void
+hot_object_cache_t::set(const couple_t &couple, const std::string &key
+		, const ioremap::elliptics::data_pointer &data, const dnet_time &timestamp
+		, version_t version_, const std::string &encoding) {
+	if (!is_enabled() || couple.empty()) {
+		return;
+	}
+
+	auto size = data.size();
+
+	if (size > std::min(config.max_object_size, config.size)) {
+		return;
+	}
+
+	auto reservation = memory_accountant->try_reserve(
+			memory_accountant_t::subsystem_tag::cache, size);
+
+	if (!reservation) {
+		HANDY_COUNTER_INCREMENT("mds.hot_object_cache.no_memory");
+		return;
+	}
+
+	auto object = std::make_shared<object_t>();
+	object->data = ioremap::elliptics::data_pointer::copy(data.data(), size);
+	object->timestamp = timestamp;
+
+	auto id = make_id(couple, key, encoding);
+
+	reservations_t reservations;
+	lock_guard_t lock_guard(mutex);
+
+	// The key was invalidated while the object was read
+	if (version_ < forgotten_version) {
+		HANDY_COUNTER_INCREMENT("mds.hot_object_cache.stale");
+		return;
+	}
+
+	{
+		auto it = invalidations.find(make_id(couple, key, std::string()));
+
+		if (it != invalidations.end() && version_ < it->second) {
+			HANDY_COUNTER_INCREMENT("mds.hot_object_cache.stale");
+			return;
+		}
+	}
+
+	auto it = entries.find(id);
+
+	if (it != entries.end()) {
+		const auto &cached_timestamp = it->second.object->timestamp;
+
+		if (std::make_tuple(timestamp.tsec, timestamp.tnsec)
+				< std::make_tuple(cached_timestamp.tsec, cached_timestamp.tnsec)) {
+			HANDY_COUNTER_INCREMENT("mds.hot_object_cache.stale");
+			return;
+		}
+
+		erase(it, reservations);
+	}
+
+	lru.push_front(id);
+
+	entry_t entry;
+	entry.object = std::move(object);
+	entry.reservation = std::move(reservation);
+	entry.valid_until = clock_t::now() + std::chrono::seconds(config.ttl);
+	entry.lru_iterator = lru.begin();
+
+	entries.insert(std::make_pair(std::move(id), std::move(entry)));
+	total_size += size;
+
+	while (total_size > config.size && !lru.empty()) {
+		erase(entries.find(lru.back()), reservations);
+	}
+
+	update_stats();
+}
+
+void
+hot_object_cache_t::invalidate(const couple_t &couple, const std::string &key) {
+	if (!is_enabled() || couple.empty()) {
+		return;
+	}
+
+	reservations_t reservations;
+	lock_guard_t lock_guard(mutex);
+
+	if (invalidations.size() >= max_invalidations) {
+		invalidations.clear();
+		forgotten_version = last_version;
+	}
+
+	invalidations[make_id(couple, key, std::string())] = ++last_version;
+
+	for (auto eit = std::begin(encodings), eend = std::end(encodings); eit != eend; ++eit) {
+		auto it = entries.find(make_id(couple, key, *eit));
+
+		if (it != entries.end()) {
+			erase(it, reservations);
+		}
+	}
+
+	update_stats();
+}
+
+std::string
+hot_object_cache_t::make_id(const couple_t &couple, const std::string &key
+		, const std::string &encoding) {
+	auto id = std::to_string(*std::min_element(couple.begin(), couple.end())) + '/' + key;
+
+	// Ids of objects start with a digit, hence prefixed variants never clash with them
+	if (!encoding.empty()) {
+		id = encoding + ':' + id;
+	}
+
+	return id;
+}
+
+void
+hot_object_cache_t::erase(entries_t::iterator it, reservations_t &reservations) {
+	total_size -= it->second.object->data.size();
+	reservations.emplace_back(std::move(it->second.reservation));
+	lru.erase(it->second.lru_iterator);
+	entries.erase(it);
+}
+
+void
+hot_object_cache_t::update_stats() {
+	HANDY_GAUGE_SET("mds.hot_object_cache.objects", entries.size());
+	HANDY_GAUGE_SET("mds.hot_object_cache.size", total_size);
+}
+
+} // namespace elliptics
+
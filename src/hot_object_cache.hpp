@@ -0,0 +1,141 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef MDS_PROXY__SRC__HOT_OBJECT_CACHE__HPP
+#define MDS_PROXY__SRC__HOT_OBJECT_CACHE__HPP
+
+#include "utils.hpp"
+#include "memory_accountant.hpp"
+
+#include <elliptics/utils.hpp>
+#include <elliptics/interface.h>
+
+#include <unordered_map>
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <string>
+
+namespace elliptics {
+
+// In-memory cache of small objects which were found hot by hot_keys_t.
+// GET handler serves a cached object without any request to storage until the entry
+// expires or the key is uploaded or removed. The cache is bounded by the total size of objects,
+// the least recently used objects are evicted first. Objects are accounted in the cache budget
+// of memory_accountant_t, an object is not cached if the budget is exhausted.
+// Besides the object itself the cache keeps its content-encoded variants (e.g. gzip),
+// a variant is an independent entry, but all variants are invalidated together with the key.
+// An object which was read before the key was invalidated is never cached, nor an object which
+// is older than the cached one.
+class hot_object_cache_t {
+public:
+	struct config_t {
+		// Total size of cached objects, bytes
+		size_t size;
+		// Objects which are larger are never cached, bytes
+		size_t max_object_size;
+		// Lifetime of an object, seconds
+		int ttl;
+	};
+
+	struct object_t {
+		ioremap::elliptics::data_pointer data;
+		dnet_time timestamp;
+	};
+
+	typedef std::shared_ptr<const object_t> object_ptr_t;
+
+	// Is taken before the object is read and is passed to set
+	typedef uint64_t version_t;
+
+	hot_object_cache_t(config_t config_
+			, std::shared_ptr<memory_accountant_t> memory_accountant_);
+
+	bool
+	is_enabled() const;
+
+	const config_t &
+	get_config() const;
+
+	// Empty encoding means the object as it is stored
+	object_ptr_t
+	get(const couple_t &couple, const std::string &key
+			, const std::string &encoding = std::string());
+
+	version_t
+	version();
+
+	// The data is copied, hence data may refer to a larger buffer
+	void
+	set(const couple_t &couple, const std::string &key
+			, const ioremap::elliptics::data_pointer &data, const dnet_time &timestamp
+			, version_t version_, const std::string &encoding = std::string());
+
+	// Drops the object and all its variants
+	void
+	invalidate(const couple_t &couple, const std::string &key);
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::lock_guard<mutex_t> lock_guard_t;
+	typedef std::chrono::steady_clock clock_t;
+
+	struct entry_t {
+		object_ptr_t object;
+		memory_accountant_t::reservation_ptr_t reservation;
+		clock_t::time_point valid_until;
+		std::list<std::string>::iterator lru_iterator;
+	};
+
+	typedef std::unordered_map<std::string, entry_t> entries_t;
+	typedef std::vector<memory_accountant_t::reservation_ptr_t> reservations_t;
+
+	static std::string
+	make_id(const couple_t &couple, const std::string &key, const std::string &encoding);
+
+	// Reservations must be released after the mutex is unlocked
+	// as waiters of memory are called in place
+	void
+	erase(entries_t::iterator it, reservations_t &reservations);
+
+	void
+	update_stats();
+
+	config_t config;
+	std::shared_ptr<memory_accountant_t> memory_accountant;
+
+	mutex_t mutex;
+	entries_t entries;
+	std::list<std::string> lru;
+	size_t total_size;
+
+	// Versions of the last invalidations of keys. Invalidations are forgotten when there are
+	// too many of them, objects read before that are refused
+	std::unordered_map<std::string, version_t> invalidations;
+	version_t last_version;
+	version_t forgotten_version;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__HOT_OBJECT_CACHE__HPP */
+
@@ -18,6 +18,7 @@
 */
 
 #include "lookup_result.hpp"
+#include "dns_cache.hpp"
 
 #include <elliptics/interface.h>
 
@@ -25,9 +26,6 @@
 
 #include <boost/lexical_cast.hpp>
 
-#include <sys/socket.h>
-#include <netdb.h>
-
 namespace {
 
 static inline char*
@@ -51,19 +49,13 @@ lookup_result::lookup_result(const ioremap::elliptics::lookup_result_entry &entr
 {
 }
 
-const std::string &lookup_result::host() const
+const std::string &lookup_result::host(dns_cache_t &dns_cache) const
 {
 	if (!m_host) {
-		char hbuf[NI_MAXHOST];
-		memset(hbuf, 0, NI_MAXHOST);
 		struct dnet_addr *addr = m_entry.storage_address();
 
-		if (getnameinfo((const sockaddr*)addr, addr->addr_len, hbuf, sizeof(hbuf), NULL, 0, 0) != 0) {
-			throw std::runtime_error("can not make dns lookup");
-		}
-
 		std::ostringstream oss;
-		oss << hbuf;
+		oss << dns_cache.get_hostname(*addr);
 		if (!m_sign_port.empty()) {
 			oss << ':' << m_sign_port;
 		}
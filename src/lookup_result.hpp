@@ -27,11 +27,13 @@
 
 namespace elliptics {
 
+class dns_cache_t;
+
 class lookup_result {
 public:
 	lookup_result(const ioremap::elliptics::lookup_result_entry &entry, std::string sign_port);
 
-	const std::string &host() const;
+	const std::string &host(dns_cache_t &dns_cache) const;
 	uint16_t port() const;
 	int group() const;
 	int status() const;
@@ -1,62 +1,90 @@
 #include "lookuper.hpp"
 #include "loggers.hpp"
+#include "timer.hpp"
+
+#include <iterator>
+
+elliptics::parallel_lookuper_t::slot_t::slot_t()
+	: state(slot_state_tag::empty)
+{
+}
 
 elliptics::parallel_lookuper_t::parallel_lookuper_t(
 		ioremap::swarm::logger bh_logger_
 		, ioremap::elliptics::session session_
-		, std::string key_
+		, ioremap::elliptics::key key_
+		, boost::optional<preference_t> preference_
+		, std::shared_ptr<groups_health_t> groups_health_
+		, storage_flow_t flow_
 		)
 	: bh_logger(std::move(bh_logger_))
 	, session(session_.clone())
 	, key(std::move(key_))
-	, groups_to_handle(0)
+	, preference(std::move(preference_))
+	, groups_health(std::move(groups_health_))
+	, flow(std::move(flow_))
+	, groups_count(0)
+	, next_free_slot(0)
+	, next_slot_to_consume(0)
+	, is_stopped(false)
+	, preference_is_decided(!preference)
 {
+	// Every group replies with exactly one entry, negative ones included
+	session.set_filter(ioremap::elliptics::filters::all);
 }
 
 void
 elliptics::parallel_lookuper_t::start() {
 	const auto &groups = session.get_groups();
-	groups_to_handle = groups.size();
 
-	auto self = shared_from_this();
-	auto callback = [this, self] (
-			const ioremap::elliptics::sync_lookup_result &entries
-			, const ioremap::elliptics::error_info &error_info) {
-		on_lookup(entries, error_info);
-	};
+	groups_count = groups.size();
+	group_states.reset(new group_state_t[groups_count]);
+	slots.reset(new slot_t[groups_count]);
 
-	for (auto it = groups.begin(), end = groups.end(); it != end; ++it) {
-		auto group_session = session.clone();
-		group_session.set_filter(ioremap::elliptics::filters::all_with_ack);
-		group_session.set_groups({*it});
-		auto future = group_session.lookup(key);
-		future.connect(callback);
+	for (size_t index = 0; index != groups_count; ++index) {
+		group_states[index].group = groups[index];
+		group_states[index].is_replied = false;
 	}
+
+	if (preference && groups_count > 1) {
+		// The lookuper must not be kept alive by the deadline
+		std::weak_ptr<parallel_lookuper_t> weak_self = shared_from_this();
+
+		preference->deadline_queue->add(preference->timeout, [weak_self] {
+				if (auto self = weak_self.lock()) {
+					self->preference_is_expired();
+				}
+			});
+	}
+
+	flow.schedule(std::bind(&parallel_lookuper_t::lookup, shared_from_this()
+				, std::placeholders::_1));
 }
 
 ioremap::elliptics::async_lookup_result
 elliptics::parallel_lookuper_t::next_lookup_result() {
-	lock_guard_t lock_guard(results_mutex);
-
 	ioremap::elliptics::async_lookup_result future(session);
-	ioremap::elliptics::async_lookup_result::handler promise(future);
+	promise_t promise(future);
 
-	if (!results.empty()) {
-		auto result = std::move(results.front());
-		results.pop_front();
+	auto index = next_slot_to_consume++;
 
-		lock_guard.unlock();
-		process_promise(promise, result);
+	if (index >= groups_count || is_stopped) {
+		process_promise(promise);
 		return future;
 	}
 
-	if (groups_to_handle - promises.size()) {
-		promises.emplace_back(std::move(promise));
+	auto &slot = slots[index];
+	slot.promise = std::move(promise);
+
+	auto state = slot_state_tag::empty;
+
+	if (slot.state.compare_exchange_strong(state, slot_state_tag::awaited)) {
 		return future;
 	}
 
-	lock_guard.unlock();
-	process_promise(promise);
+	// The result is already in the slot
+	process_promise(*slot.promise, slot.result);
+	slot.promise = boost::none;
 	return future;
 }
 
@@ -67,8 +95,18 @@ elliptics::parallel_lookuper_t::total_size() const {
 
 size_t
 elliptics::parallel_lookuper_t::results_left() const {
-	lock_guard_t lock_guard(results_mutex);
-	return groups_to_handle + results.size();
+	size_t consumed = next_slot_to_consume;
+
+	if (is_stopped || consumed >= groups_count) {
+		return 0;
+	}
+
+	return groups_count - consumed;
+}
+
+void
+elliptics::parallel_lookuper_t::stop() {
+	is_stopped = true;
 }
 
 ioremap::swarm::logger &
@@ -77,29 +115,197 @@ elliptics::parallel_lookuper_t::logger() {
 }
 
 void
-elliptics::parallel_lookuper_t::on_lookup(const ioremap::elliptics::sync_lookup_result &entries
-		, const ioremap::elliptics::error_info &error_info) {
-	lock_guard_t lock_guard(results_mutex);
+elliptics::parallel_lookuper_t::lookup(storage_scheduler_t::slot_ptr_t slot) {
+	boost::optional<ioremap::elliptics::session> accepted_session;
+
+	// Places in bulkheads are taken group by group to release them on every reply
+	if (flow.limits_groups()) {
+		groups_t accepted_groups;
+		accepted_groups.reserve(groups_count);
+
+		for (size_t index = 0; index != groups_count; ++index) {
+			auto &group_state = group_states[index];
+			auto permit = flow.acquire({group_state.group});
+
+			// The group is treated as unavailable, thus the caller goes to another replica
+			if (permit->groups().empty()) {
+				on_reply(index, error_info_t(-EBUSY, "bulkhead of group is full"), nullptr, false);
+				continue;
+			}
+
+			group_state.permit = std::move(permit);
+			accepted_groups.push_back(group_state.group);
+		}
+
+		if (accepted_groups.empty()) {
+			return;
+		}
+
+		if (accepted_groups.size() != groups_count) {
+			accepted_session = session.clone();
+			accepted_session->set_groups(accepted_groups);
+		}
+	}
+
+	auto &lookup_session = (accepted_session ? *accepted_session : session);
+
+	timer.reset();
+	auto future = lookup_session.parallel_lookup(key);
+
+	// The slot is held until the last group replies
+	future.connect(std::bind(&parallel_lookuper_t::on_entry, shared_from_this()
+				, std::placeholders::_1)
+			, hold_slot(std::move(slot), std::bind(&parallel_lookuper_t::on_final
+					, shared_from_this(), std::placeholders::_1)));
+}
+
+void
+elliptics::parallel_lookuper_t::on_entry(const ioremap::elliptics::lookup_result_entry &entry) {
+	group_t group = entry.command()->id.group_id;
+
+	for (size_t index = 0; index != groups_count; ++index) {
+		if (group_states[index].group == group) {
+			on_reply(index, entry.error(), &entry, true);
+			return;
+		}
+	}
+
+	MDS_LOG_ERROR("lookup reply from unexpected group: group=%d", group);
+}
+
+void
+elliptics::parallel_lookuper_t::on_final(const error_info_t &error_info) {
+	// Groups which did not reply are completed with the error of the whole lookup
+	for (size_t index = 0; index != groups_count; ++index) {
+		on_reply(index, error_info ? error_info : error_info_t(-ETIMEDOUT, "group did not reply")
+				, nullptr, true);
+	}
+}
+
+void
+elliptics::parallel_lookuper_t::on_reply(size_t index, const error_info_t &error_info
+		, const ioremap::elliptics::lookup_result_entry *entry, bool is_reported) {
+	auto &group_state = group_states[index];
+
+	if (group_state.is_replied.exchange(true)) {
+		return;
+	}
+
+	group_state.permit.reset();
+
+	if (is_reported && groups_health) {
+		// Missing key says nothing bad about the group
+		bool is_successful = !error_info || error_info.code() == -ENOENT;
+		groups_health->report(group_state.group, is_successful
+				, std::chrono::microseconds(timer.get_us()));
+	}
+
+	if (is_stopped) {
+		return;
+	}
+
+	result_t result;
+	result.error_info = error_info;
+
+	if (entry) {
+		result.entries.push_back(*entry);
+	}
+
+	if (!preference) {
+		publish(slots[next_free_slot++], std::move(result));
+		return;
+	}
+
+	publish_preferred(index, std::move(result));
+}
+
+void
+elliptics::parallel_lookuper_t::publish_preferred(size_t index, result_t result) {
+	std::vector<result_t> results;
+	size_t slot_index = 0;
+
+	{
+		std::lock_guard<std::mutex> lock_guard(preference_mutex);
+		(void) lock_guard;
+
+		if (preference_is_decided) {
+			results.emplace_back(std::move(result));
+		} else if (index != 0) {
+			deferred_results.emplace_back(std::move(result));
+			return;
+		} else {
+			preference_is_decided = true;
+
+			// The error of the preferred group goes after replies which have already arrived
+			bool is_successful = !result.error_info;
+
+			if (is_successful) {
+				results.emplace_back(std::move(result));
+			}
+
+			std::move(deferred_results.begin(), deferred_results.end()
+					, std::back_inserter(results));
+			deferred_results.clear();
+
+			if (!is_successful) {
+				results.emplace_back(std::move(result));
+			}
+		}
+
+		// Slots are taken under the lock, otherwise a later reply could overtake the preferred one
+		slot_index = next_free_slot.fetch_add(results.size());
+	}
+
+	publish(slot_index, std::move(results));
+}
+
+void
+elliptics::parallel_lookuper_t::preference_is_expired() {
+	std::vector<result_t> results;
+	size_t slot_index = 0;
+
+	{
+		std::lock_guard<std::mutex> lock_guard(preference_mutex);
+		(void) lock_guard;
 
-	groups_to_handle -= 1;
-	result_t result{entries, error_info};
+		if (preference_is_decided) {
+			return;
+		}
+
+		preference_is_decided = true;
+		results.swap(deferred_results);
+		slot_index = next_free_slot.fetch_add(results.size());
+	}
 
-	if (!promises.empty()) {
-		auto promise = std::move(promises.front());
-		promises.pop_front();
+	MDS_LOG_INFO("preferred group is late: group=%d", group_states[0].group);
 
-		lock_guard.unlock();
-		process_promise(promise, result);
+	publish(slot_index, std::move(results));
+}
+
+void
+elliptics::parallel_lookuper_t::publish(size_t slot_index, std::vector<result_t> results) {
+	for (auto it = results.begin(), end = results.end(); it != end; ++it, ++slot_index) {
+		publish(slots[slot_index], std::move(*it));
+	}
+}
+
+void
+elliptics::parallel_lookuper_t::publish(slot_t &slot, result_t result) {
+	slot.result = std::move(result);
+
+	auto state = slot_state_tag::empty;
+
+	if (slot.state.compare_exchange_strong(state, slot_state_tag::ready)) {
 		return;
 	}
 
-	results.emplace_back(std::move(result));
+	// The caller already waits for the result
+	process_promise(*slot.promise, slot.result);
+	slot.promise = boost::none;
 }
 
 void
-elliptics::parallel_lookuper_t::process_promise(
-		ioremap::elliptics::async_lookup_result::handler &promise
-		, const result_t &result) {
+elliptics::parallel_lookuper_t::process_promise(promise_t &promise, const result_t &result) {
 	auto &entries = result.entries;
 
 	promise.set_total(entries.size());
@@ -112,8 +318,7 @@ elliptics::parallel_lookuper_t::process_promise(
 }
 
 void
-elliptics::parallel_lookuper_t::process_promise(
-		ioremap::elliptics::async_lookup_result::handler &promise) {
+elliptics::parallel_lookuper_t::process_promise(promise_t &promise) {
 	promise.complete(ioremap::elliptics::error_info(EPIPE, "There is no enough groups"));
 }
 
@@ -121,11 +326,14 @@ elliptics::parallel_lookuper_ptr_t
 elliptics::make_parallel_lookuper(
 		ioremap::swarm::logger bh_logger
 		, ioremap::elliptics::session session
-		, std::string key
+		, ioremap::elliptics::key key
+		, boost::optional<parallel_lookuper_t::preference_t> preference
+		, std::shared_ptr<groups_health_t> groups_health
+		, storage_flow_t flow
 		) {
 	auto parallel_lookuper = std::make_shared<parallel_lookuper_t>(std::move(bh_logger)
-			, std::move(session), std::move(key));
+			, std::move(session), std::move(key), std::move(preference), std::move(groups_health)
+			, std::move(flow));
 	parallel_lookuper->start();
 	return parallel_lookuper;
 }
-
@@ -20,14 +20,24 @@
 #ifndef MDS_PROXY__SRC__LOOKUPER__HPP
 #define MDS_PROXY__SRC__LOOKUPER__HPP
 
+#include "groups_health.hpp"
+#include "storage_scheduler.hpp"
+#include "deadline_queue.hpp"
+#include "timer.hpp"
+#include "utils.hpp"
+
 #include <elliptics/session.hpp>
 
 #include <swarm/logger.hpp>
 
-#include <vector>
+#include <boost/optional.hpp>
+
 #include <memory>
 #include <string>
+#include <vector>
 #include <mutex>
+#include <chrono>
+#include <atomic>
 
 namespace elliptics {
 
@@ -43,15 +53,32 @@ public:
 		error_info_t error_info;
 	};
 
+	// The first group of the session is preferred: its successful reply is returned first
+	// if it arrives within timeout. If the preferred group fails or is late, the replies
+	// are returned in the order of arrival, so a dead group does not stall the caller.
+	struct preference_t {
+		std::shared_ptr<deadline_queue_t> deadline_queue;
+		std::chrono::milliseconds timeout;
+	};
+
+	// Results are returned in the order of arrival, the reply of the first group goes first
+	// if preference_ is set. Replies of groups are reported to groups_health_ if it is set.
+	// All groups are asked by one parallel lookup scheduled by flow_, they are asked at once
+	// by default. Groups whose bulkheads are full are not asked and reply with -EBUSY.
 	parallel_lookuper_t(
 			ioremap::swarm::logger bh_logger_
 			, ioremap::elliptics::session session_
-			, std::string key_
+			, ioremap::elliptics::key key_
+			, boost::optional<preference_t> preference_ = boost::none
+			, std::shared_ptr<groups_health_t> groups_health_ = nullptr
+			, storage_flow_t flow_ = storage_flow_t()
 			);
 
 	void
 	start();
 
+	// Results are consumed by one caller, the next result must not be requested
+	// before the previous one is obtained
 	ioremap::elliptics::async_lookup_result
 	next_lookup_result();
 
@@ -61,38 +88,100 @@ public:
 	size_t
 	results_left() const;
 
+	// Is called when the caller has committed to a group: replies which arrive later
+	// are only reported to groups_health. Must not be called while a result is awaited
+	void
+	stop();
+
 #if 0
 	ioremap::elliptics::async_lookup_result
 	get_group(const ioremap::elliptics::lookup_result_entry &entry);
 #endif
 
 private:
-	typedef std::mutex mutex_t;
-	typedef std::unique_lock<mutex_t> lock_guard_t;
+	typedef ioremap::elliptics::async_lookup_result::handler promise_t;
+
+	enum class slot_state_tag {
+		  empty
+		, ready
+		, awaited
+	};
+
+	// The result is put into the slot by the group's reply and the promise by the caller,
+	// whoever comes second completes the promise, thus no lock is needed
+	struct slot_t {
+		slot_t();
+
+		std::atomic<slot_state_tag> state;
+		result_t result;
+		boost::optional<promise_t> promise;
+	};
+
+	struct group_state_t {
+		group_t group;
+		std::atomic<bool> is_replied;
+		// The place in the bulkhead is released as soon as the group replies
+		storage_bulkheads_t::permit_ptr_t permit;
+	};
 
 	ioremap::swarm::logger &
 	logger();
 
 	void
-	on_lookup(const ioremap::elliptics::sync_lookup_result &entries
-			, const ioremap::elliptics::error_info &error_info);
+	lookup(storage_scheduler_t::slot_ptr_t slot);
 
 	void
-	process_promise(ioremap::elliptics::async_lookup_result::handler &promise
-			, const result_t &result);
+	on_entry(const ioremap::elliptics::lookup_result_entry &entry);
 
 	void
-	process_promise(ioremap::elliptics::async_lookup_result::handler &promise);
+	on_final(const error_info_t &error_info);
+
+	// The entry is nullptr if the group did not reply
+	void
+	on_reply(size_t index, const error_info_t &error_info
+			, const ioremap::elliptics::lookup_result_entry *entry, bool is_reported);
+
+	// Results of other groups are deferred until the preferred group replies
+	// or the preference expires
+	void
+	publish_preferred(size_t index, result_t result);
+
+	void
+	preference_is_expired();
+
+	void
+	publish(size_t slot_index, std::vector<result_t> results);
+
+	void
+	publish(slot_t &slot, result_t result);
+
+	static void
+	process_promise(promise_t &promise, const result_t &result);
+
+	static void
+	process_promise(promise_t &promise);
 
 	ioremap::swarm::logger bh_logger;
 	ioremap::elliptics::session session;
-	std::string key;
+	ioremap::elliptics::key key;
+	boost::optional<preference_t> preference;
+	std::shared_ptr<groups_health_t> groups_health;
+	storage_flow_t flow;
+
+	size_t groups_count;
+	std::unique_ptr<group_state_t[]> group_states;
+	std::unique_ptr<slot_t[]> slots;
+
+	// Slots are taken in the order of arrival
+	std::atomic<size_t> next_free_slot;
+	std::atomic<size_t> next_slot_to_consume;
+	std::atomic<bool> is_stopped;
 
-	mutable mutex_t results_mutex;
-	std::list<result_t> results;
-	std::list<ioremap::elliptics::async_lookup_result::handler> promises;
-	size_t groups_to_handle;
+	std::mutex preference_mutex;
+	bool preference_is_decided;
+	std::vector<result_t> deferred_results;
 
+	util::timer_t timer;
 };
 
 typedef std::shared_ptr<parallel_lookuper_t> parallel_lookuper_ptr_t;
@@ -101,7 +190,10 @@ parallel_lookuper_ptr_t
 make_parallel_lookuper(
 		ioremap::swarm::logger bh_logger
 		, ioremap::elliptics::session session
-		, std::string key
+		, ioremap::elliptics::key key
+		, boost::optional<parallel_lookuper_t::preference_t> preference = boost::none
+		, std::shared_ptr<groups_health_t> groups_health = nullptr
+		, storage_flow_t flow = storage_flow_t()
 		);
 
 } // namespace elliptics
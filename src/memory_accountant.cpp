@@ -0,0 +1,232 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "memory_accountant.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <algorithm>
+#include <vector>
+#include <utility>
+
+namespace elliptics {
+
+memory_accountant_t::reservation_t::reservation_t(
+		std::shared_ptr<memory_accountant_t> accountant_
+		, subsystem_tag subsystem_, size_t size_)
+	: accountant(std::move(accountant_))
+	, subsystem(subsystem_)
+	, reserved_size(size_)
+{
+}
+
+memory_accountant_t::reservation_t::~reservation_t() {
+	accountant->release(subsystem, reserved_size);
+}
+
+size_t
+memory_accountant_t::reservation_t::size() const {
+	return reserved_size;
+}
+
+bool
+memory_accountant_t::reservation_t::try_grow(size_t size) {
+	const auto index = static_cast<size_t>(subsystem);
+
+	memory_accountant_t::lock_guard_t lock_guard(accountant->mutex);
+
+	// The reservation itself is in use, hence there is no exception for an idle subsystem
+	const auto &config = accountant->config;
+	const auto used = accountant->used_by_subsystem[index];
+
+	if ((config.budgets[index] != 0 && used + size > config.budgets[index])
+			|| (config.limit != 0 && accountant->total_used + size > config.limit)) {
+		return false;
+	}
+
+	reserved_size += size;
+	accountant->used_by_subsystem[index] += size;
+	accountant->total_used += size;
+	accountant->update_stats(index);
+
+	return true;
+}
+
+void
+memory_accountant_t::reservation_t::shrink(size_t size) {
+	{
+		memory_accountant_t::lock_guard_t lock_guard(accountant->mutex);
+
+		size = std::min(size, reserved_size);
+		reserved_size -= size;
+	}
+
+	if (size != 0) {
+		accountant->release(subsystem, size);
+	}
+}
+
+memory_accountant_t::memory_accountant_t(config_t config_)
+	: config(std::move(config_))
+	, total_used(0)
+{
+	used_by_subsystem.fill(0);
+}
+
+void
+memory_accountant_t::reserve(subsystem_tag subsystem, size_t size, callback_t callback) {
+	const auto index = static_cast<size_t>(subsystem);
+
+	lock_guard_t lock_guard(mutex);
+
+	// Queued reservations go first to not starve large ones
+	if (!waiters[index].empty() || !fits(index, size)) {
+		waiters[index].push_back(waiter_t{size, std::move(callback)});
+		HANDY_GAUGE_SET(("mds.memory.%s.waiting", subsystem_name(subsystem).c_str())
+				, waiters[index].size());
+		return;
+	}
+
+	used_by_subsystem[index] += size;
+	total_used += size;
+	update_stats(index);
+
+	lock_guard.unlock();
+
+	callback(reservation_ptr_t(new reservation_t(shared_from_this(), subsystem, size)));
+}
+
+memory_accountant_t::reservation_ptr_t
+memory_accountant_t::try_reserve(subsystem_tag subsystem, size_t size) {
+	const auto index = static_cast<size_t>(subsystem);
+
+	lock_guard_t lock_guard(mutex);
+
+	if (!waiters[index].empty() || !fits(index, size)) {
+		return reservation_ptr_t();
+	}
+
+	used_by_subsystem[index] += size;
+	total_used += size;
+	update_stats(index);
+
+	lock_guard.unlock();
+
+	return reservation_ptr_t(new reservation_t(shared_from_this(), subsystem, size));
+}
+
+size_t
+memory_accountant_t::used(subsystem_tag subsystem) const {
+	lock_guard_t lock_guard(mutex);
+	return used_by_subsystem[static_cast<size_t>(subsystem)];
+}
+
+size_t
+memory_accountant_t::waiting() const {
+	lock_guard_t lock_guard(mutex);
+
+	size_t result = 0;
+
+	for (auto it = waiters.begin(), end = waiters.end(); it != end; ++it) {
+		result += it->size();
+	}
+
+	return result;
+}
+
+std::string
+memory_accountant_t::subsystem_name(subsystem_tag subsystem) {
+	switch (subsystem) {
+	case subsystem_tag::get:
+		return "get";
+	case subsystem_tag::upload:
+		return "upload";
+	case subsystem_tag::multipart:
+		return "multipart";
+	case subsystem_tag::cache:
+		return "cache";
+	}
+
+	return "unknown";
+}
+
+bool
+memory_accountant_t::fits(size_t index, size_t size) const {
+	if (used_by_subsystem[index] == 0) {
+		return true;
+	}
+
+	if (config.budgets[index] != 0 && used_by_subsystem[index] + size > config.budgets[index]) {
+		return false;
+	}
+
+	if (config.limit != 0 && total_used + size > config.limit) {
+		return false;
+	}
+
+	return true;
+}
+
+void
+memory_accountant_t::release(subsystem_tag subsystem, size_t size) {
+	std::vector<std::pair<callback_t, reservation_ptr_t>> granted;
+
+	lock_guard_t lock_guard(mutex);
+
+	used_by_subsystem[static_cast<size_t>(subsystem)] -= size;
+	total_used -= size;
+
+	// The released memory may be used by any subsystem as all of them share the limit
+	for (size_t index = 0; index != subsystems_count; ++index) {
+		auto &queue = waiters[index];
+		auto tag = static_cast<subsystem_tag>(index);
+
+		while (!queue.empty() && fits(index, queue.front().size)) {
+			auto waiter = std::move(queue.front());
+			queue.pop_front();
+
+			used_by_subsystem[index] += waiter.size;
+			total_used += waiter.size;
+
+			granted.emplace_back(std::move(waiter.callback)
+					, reservation_ptr_t(new reservation_t(shared_from_this(), tag, waiter.size)));
+		}
+
+		HANDY_GAUGE_SET(("mds.memory.%s.waiting", subsystem_name(tag).c_str()), queue.size());
+		update_stats(index);
+	}
+
+	lock_guard.unlock();
+
+	for (auto it = granted.begin(), end = granted.end(); it != end; ++it) {
+		it->first(std::move(it->second));
+	}
+}
+
+void
+memory_accountant_t::update_stats(size_t index) {
+	HANDY_GAUGE_SET(("mds.memory.%s.used"
+				, subsystem_name(static_cast<subsystem_tag>(index)).c_str())
+			, used_by_subsystem[index]);
+	HANDY_GAUGE_SET("mds.memory.used", total_used);
+}
+
+} // namespace elliptics
+
@@ -0,0 +1,143 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef MDS_PROXY__SRC__MEMORY_ACCOUNTANT__HPP
+#define MDS_PROXY__SRC__MEMORY_ACCOUNTANT__HPP
+
+#include <array>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <string>
+
+namespace elliptics {
+
+// Bounds the memory which is held by request buffers and caches.
+// Every subsystem has its own budget and all of them share the global limit.
+// Memory is reserved before data is read from storage or from client's socket,
+// a reservation which does not fit is queued until other reservations are released,
+// hence slow clients pause reads of the proxy instead of growing its memory.
+// A subsystem which holds nothing is always granted one reservation to not stall
+// on requests larger than the budget.
+class memory_accountant_t
+	: public std::enable_shared_from_this<memory_accountant_t>
+{
+public:
+	enum class subsystem_tag {
+		  get
+		, upload
+		, multipart
+		, cache
+	};
+
+	static const size_t subsystems_count = 4;
+
+	struct config_t {
+		// bytes, 0 means unlimited
+		size_t limit;
+		std::array<size_t, subsystems_count> budgets;
+	};
+
+	// Memory is released when the reservation is destroyed
+	class reservation_t {
+	public:
+		~reservation_t();
+
+		size_t
+		size() const;
+
+		// Returns false and leaves the reservation untouched if size does not fit
+		bool
+		try_grow(size_t size);
+
+		// Releases size bytes of the reservation, e.g. when a part of the buffered data is freed.
+		// The memory is handed to waiting reservations at once
+		void
+		shrink(size_t size);
+
+	private:
+		friend class memory_accountant_t;
+
+		reservation_t(std::shared_ptr<memory_accountant_t> accountant_
+				, subsystem_tag subsystem_, size_t size_);
+
+		reservation_t(const reservation_t &) = delete;
+		reservation_t &operator = (const reservation_t &) = delete;
+
+		std::shared_ptr<memory_accountant_t> accountant;
+		subsystem_tag subsystem;
+		size_t reserved_size;
+	};
+
+	typedef std::shared_ptr<reservation_t> reservation_ptr_t;
+	typedef std::function<void (reservation_ptr_t)> callback_t;
+
+	memory_accountant_t(config_t config_);
+
+	// The callback is called immediately if the memory is available,
+	// otherwise it is called by the thread which releases enough memory
+	void
+	reserve(subsystem_tag subsystem, size_t size, callback_t callback);
+
+	// Returns nullptr if the memory is not available
+	reservation_ptr_t
+	try_reserve(subsystem_tag subsystem, size_t size);
+
+	size_t
+	used(subsystem_tag subsystem) const;
+
+	// Returns the number of reservations which wait for memory in all subsystems
+	size_t
+	waiting() const;
+
+	static std::string
+	subsystem_name(subsystem_tag subsystem);
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+
+	struct waiter_t {
+		size_t size;
+		callback_t callback;
+	};
+
+	bool
+	fits(size_t index, size_t size) const;
+
+	void
+	release(subsystem_tag subsystem, size_t size);
+
+	void
+	update_stats(size_t index);
+
+	config_t config;
+
+	mutable mutex_t mutex;
+	size_t total_used;
+	std::array<size_t, subsystems_count> used_by_subsystem;
+	std::array<std::deque<waiter_t>, subsystems_count> waiters;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__MEMORY_ACCOUNTANT__HPP */
+
@@ -19,8 +19,56 @@
 
 #include "ns_settings.hpp"
 
+#include <algorithm>
+
 const elliptics::ns_settings_t &
 elliptics::ns_settings(const mastermind::namespace_state_t &ns_state) {
 	return static_cast<const ns_settings_t &>(ns_state.settings().user_settings());
 }
 
+
+const elliptics::cache_control_rule_t *
+elliptics::find_cache_control_rule(const ns_settings_t &settings, const std::string &key
+		, size_t size) {
+	const auto &rules = settings.cache_control_rules;
+
+	for (auto it = rules.begin(), end = rules.end(); it != end; ++it) {
+		if (static_cast<int64_t>(size) < it->min_size
+				|| (it->max_size != -1 && static_cast<int64_t>(size) > it->max_size)) {
+			continue;
+		}
+
+		if (it->extensions.empty()) {
+			return &*it;
+		}
+
+		auto match = [&key] (const std::string &extension) {
+			return key.size() >= extension.size()
+				&& std::equal(extension.rbegin(), extension.rend(), key.rbegin());
+		};
+
+		if (std::any_of(it->extensions.begin(), it->extensions.end(), match)) {
+			return &*it;
+		}
+	}
+
+	return nullptr;
+}
+
+bool
+elliptics::content_is_compressible(const ns_settings_t &settings
+		, const std::string &content_type, size_t size) {
+	if (!settings.gzip_is_enabled
+			|| static_cast<int64_t>(size) < settings.gzip_min_size
+			|| static_cast<int64_t>(size) > settings.gzip_max_size) {
+		return false;
+	}
+
+	const auto &content_types = settings.gzip_content_types;
+
+	auto match = [&content_type] (const std::string &prefix) {
+		return content_type.compare(0, prefix.size(), prefix) == 0;
+	};
+
+	return std::any_of(content_types.begin(), content_types.end(), match);
+}
@@ -30,17 +30,53 @@
 
 namespace elliptics {
 
+// Cache-Control policy for a class of keys
+struct cache_control_rule_t {
+	cache_control_rule_t()
+		: min_size(0)
+		, max_size(-1)
+		, max_age(0)
+		, s_maxage(-1)
+		, stale_while_revalidate(0)
+	{}
+
+	// The rule matches keys with one of the extensions or any key if the list is empty.
+	// Extensions are used instead of content type as the type is detected from data
+	// which is not read for HEAD and 304 responses
+	std::vector<std::string> extensions;
+	int64_t min_size;
+	// -1 means there is no upper bound
+	int64_t max_size;
+
+	// seconds
+	int max_age;
+	// seconds, -1 means the directive is omitted
+	int s_maxage;
+	// seconds, 0 means the directive is omitted
+	int stale_while_revalidate;
+};
+
 struct ns_settings_t
 	: public mastermind::namespace_state_t::user_settings_t {
 
 	ns_settings_t()
 		: redirect_content_length_threshold(-1)
+		, redirect_is_adaptive(false)
+		, redirect_min_content_length_threshold(0)
+		, redirect_max_content_length_threshold(0)
 		, add_orig_path_query_arg(false)
 		, can_choose_couple_to_upload(false)
 		, multipart_content_length_threshold(0)
 		, custom_expiration_time(false)
 		, success_copies_num(-1)
 		, check_for_update(true)
+		, download_info_checks_consistency(false)
+		, scheduler_weight(1)
+		, cache_control_immutable(false)
+		, gzip_is_enabled(false)
+		, gzip_min_size(0)
+		, gzip_max_size(0)
+		, gzip_level(6)
 	{}
 
 	std::string name;
@@ -57,6 +93,11 @@ struct ns_settings_t
 
 	std::chrono::seconds redirect_expire_time;
 	int64_t redirect_content_length_threshold;
+	// If adaptive redirect is enabled the threshold is chosen between min and max
+	// in accordance with the egress pressure: max is used when the proxy is idle
+	bool redirect_is_adaptive;
+	int64_t redirect_min_content_length_threshold;
+	int64_t redirect_max_content_length_threshold;
 	std::vector<std::string> redirect_query_args;
 	bool add_orig_path_query_arg;
 
@@ -67,11 +108,37 @@ struct ns_settings_t
 	int success_copies_num;
 
 	bool check_for_update;
+
+	// download-info waits for a quorum of groups instead of the first good reply
+	bool download_info_checks_consistency;
+
+	// Share of the storage scheduler's capacity relative to other namespaces
+	double scheduler_weight;
+
+	// The first matched rule is used, Cache-Control is not sent if no rule matches
+	std::vector<cache_control_rule_t> cache_control_rules;
+	// Keys are content-addressed, hence their data is never changed
+	bool cache_control_immutable;
+	std::vector<std::string> cache_control_vary;
+
+	// Objects of compressible content types are sent gzipped to clients which accept it
+	bool gzip_is_enabled;
+	// Content type prefixes, e.g. "text/" or "application/json"
+	std::vector<std::string> gzip_content_types;
+	int64_t gzip_min_size;
+	int64_t gzip_max_size;
+	int gzip_level;
 };
 
 const ns_settings_t &
 ns_settings(const mastermind::namespace_state_t &ns_state);
 
+const cache_control_rule_t *
+find_cache_control_rule(const ns_settings_t &settings, const std::string &key, size_t size);
+
+bool
+content_is_compressible(const ns_settings_t &settings, const std::string &content_type, size_t size);
+
 } // namespace elliptics
 
 #endif /* MDS_PROXY__SRC__NS_SETTINGS__HPP */
@@ -28,6 +28,8 @@
 #include "get.hpp"
 #include "download_info.hpp"
 #include "delete.hpp"
+#include "bulk_delete.hpp"
+#include "download_info_batch.hpp"
 
 #include <swarm/url.hpp>
 #include <swarm/logger.hpp>
@@ -45,6 +47,7 @@
 #include <cstring>
 #include <cstdio>
 #include <limits>
+#include <set>
 
 #include <boost/lexical_cast.hpp>
 
@@ -68,6 +71,46 @@ std::string get_string(const rapidjson::Value &config, const char *name, const s
 	return config.HasMember(name) ? config[name].GetString() : def_val;
 }
 
+// Builds the reply of the admin document: 304 if the client has the document,
+// the gzipped body if the client accepts it. The body is empty for 304.
+std::tuple<ioremap::thevoid::http_response, ioremap::elliptics::data_pointer>
+make_admin_document_reply(const ioremap::thevoid::http_request &req
+		, const elliptics::admin_documents_t::document_t &document
+		, const std::string &content_type) {
+	const auto &request_headers = req.headers();
+
+	auto accept_encoding = request_headers.get("Accept-Encoding").get_value_or("");
+	bool is_gzipped = !document.gzipped_body.empty()
+		&& elliptics::encoding_is_accepted(accept_encoding, "gzip");
+
+	const auto &etag = is_gzipped ? document.gzipped_etag : document.etag;
+
+	ioremap::thevoid::http_response reply;
+	ioremap::swarm::http_headers headers;
+
+	headers.set("ETag", etag);
+	headers.set("Vary", "Accept-Encoding");
+
+	if (request_headers.get("If-None-Match").get_value_or("") == etag) {
+		reply.set_code(304);
+		reply.set_headers(headers);
+		return std::make_tuple(std::move(reply), ioremap::elliptics::data_pointer());
+	}
+
+	const auto &body = is_gzipped ? document.gzipped_body : document.body;
+
+	if (is_gzipped) {
+		headers.set("Content-Encoding", "gzip");
+	}
+
+	reply.set_code(200);
+	headers.set_content_length(body.size());
+	headers.set_content_type(content_type);
+	reply.set_headers(headers);
+
+	return std::make_tuple(std::move(reply), body);
+}
+
 ioremap::elliptics::session generate_session(const ioremap::elliptics::node &node) {
 	ioremap::elliptics::session session(node);
 
@@ -273,9 +316,243 @@ std::shared_ptr<cdn_cache_t> proxy::generate_cdn_cache(const rapidjson::Value &c
 	return std::make_shared<cdn_cache_t>(std::move(logger_), std::move(cdn_config));
 }
 
+std::shared_ptr<dns_cache_t> proxy::generate_dns_cache(const rapidjson::Value &config) {
+	dns_cache_t::config_t dns_config;
+
+	dns_config.positive_ttl = 3600;
+	dns_config.negative_ttl = 60;
+	dns_config.refresh_period = 10;
+
+	if (config.HasMember("dns-cache")) {
+		const auto &json = config["dns-cache"];
+
+		dns_config.positive_ttl = get_int(json, "positive-ttl", dns_config.positive_ttl);
+		dns_config.negative_ttl = get_int(json, "negative-ttl", dns_config.negative_ttl);
+		dns_config.refresh_period = get_int(json, "refresh-period", dns_config.refresh_period);
+	}
+
+	auto logger_ = ioremap::swarm::logger(logger(), blackhole::log::attributes_t({
+				blackhole::attribute::make("component", "dns-cache")}));
+
+	return std::make_shared<dns_cache_t>(std::move(logger_), std::move(dns_config));
+}
+
+std::shared_ptr<delete_journal_t> proxy::generate_delete_journal(const rapidjson::Value &config) {
+	if (!config.HasMember("delete-journal")) {
+		return nullptr;
+	}
+
+	const auto &json = config["delete-journal"];
+
+	delete_journal_t::config_t journal_config;
+
+	journal_config.path = get_string(json, "path", "");
+	journal_config.fsync_period = get_int(json, "fsync-period", 10);
+	journal_config.retry_min_timeout = get_int(json, "retry-min-timeout", 1000);
+	journal_config.retry_max_timeout = get_int(json, "retry-max-timeout", 600000);
+	journal_config.in_flight_limit = get_int(json, "in-flight-limit", 16);
+	journal_config.compaction_threshold = get_int(json, "compaction-threshold", 10000);
+
+	if (journal_config.path.empty()) {
+		throw std::runtime_error("delete-journal is set but delete-journal/path is missed");
+	}
+
+	auto logger_ = ioremap::swarm::logger(logger(), blackhole::log::attributes_t({
+				blackhole::attribute::make("component", "delete-journal")}));
+
+	auto shared_logger = make_shared_logger(logger_);
+
+	auto remove_function = [this, shared_logger] (const couple_t &couple, const std::string &key
+			, util::expected<remove_result_t>::callback_t next) {
+		boost::optional<ioremap::elliptics::session> session;
+
+		{
+			std::lock_guard<std::mutex> lock(elliptics_session_mutex);
+			(void) lock;
+
+			if (elliptics_remove_session) {
+				session = elliptics_remove_session->clone();
+			}
+		}
+
+		if (!session) {
+			next(util::expected_from_exception<std::runtime_error>(
+						"remove-session is uninitialized"));
+			return;
+		}
+
+		// The repair of a journaled key is skipped while the delete is pending,
+		// therefore only caches filled while the key was removed are dropped
+		auto on_removed = [this, couple, key, next] (util::expected<remove_result_t> result) {
+			invalidate_caches(couple, key);
+			next(std::move(result));
+		};
+
+		session->set_groups(couple);
+		elliptics::remove(shared_logger, std::move(*session), key
+				, background_storage_flow("delete-journal"), std::move(on_removed));
+	};
+
+	return std::make_shared<delete_journal_t>(std::move(logger_), std::move(journal_config)
+			, std::move(remove_function));
+}
+
+std::shared_ptr<csum_migrator_t> proxy::generate_csum_migrator(const rapidjson::Value &config) {
+	if (!config.HasMember("csum-migration")) {
+		return nullptr;
+	}
+
+	const auto &json = config["csum-migration"];
+	const size_t MB = 1024 * 1024;
+
+	csum_migrator_t::config_t migrator_config;
+
+	migrator_config.queue_size = get_int(json, "queue-size", 1000);
+	migrator_config.min_size = get_int(json, "min-size", 64) * MB;
+	migrator_config.rate = get_int(json, "rate", 16) * MB;
+	migrator_config.in_flight_limit = get_int(json, "in-flight-limit", 2);
+	migrator_config.copier.chunk_size = get_int(json, "chunk-size", m_read_chunk_size / MB) * MB;
+	migrator_config.copier.commit_coef = timeout_coef.data_flow_rate;
+	migrator_config.copier.limit_of_attempts = limit_of_middle_chunk_attempts;
+	migrator_config.copier.scale_retry_timeout = scale_retry_timeout;
+
+	if (migrator_config.rate == 0 || migrator_config.copier.chunk_size == 0) {
+		throw std::runtime_error("csum-migration/rate and csum-migration/chunk-size must be positive");
+	}
+
+	auto logger_ = ioremap::swarm::logger(logger(), blackhole::log::attributes_t({
+				blackhole::attribute::make("component", "csum-migrator")}));
+
+	return std::make_shared<csum_migrator_t>(std::move(logger_), std::move(migrator_config)
+			, background_session_function(elliptics_read_session)
+			, background_session_function(elliptics_write_session)
+			, background_storage_flow("csum-migration"));
+}
+
+std::shared_ptr<read_repairer_t> proxy::generate_read_repairer(const rapidjson::Value &config) {
+	if (!config.HasMember("read-repair")) {
+		return nullptr;
+	}
+
+	const auto &json = config["read-repair"];
+	const size_t MB = 1024 * 1024;
+
+	read_repairer_t::config_t repairer_config;
+
+	repairer_config.queue_size = get_int(json, "queue-size", 1000);
+	repairer_config.rate = get_int(json, "rate", 8) * MB;
+	repairer_config.in_flight_limit = get_int(json, "in-flight-limit", 4);
+	repairer_config.copier.chunk_size = get_int(json, "chunk-size", m_read_chunk_size / MB) * MB;
+	repairer_config.copier.commit_coef = timeout_coef.data_flow_rate;
+	repairer_config.copier.limit_of_attempts = limit_of_middle_chunk_attempts;
+	repairer_config.copier.scale_retry_timeout = scale_retry_timeout;
+
+	if (repairer_config.rate == 0 || repairer_config.copier.chunk_size == 0) {
+		throw std::runtime_error("read-repair/rate and read-repair/chunk-size must be positive");
+	}
+
+	auto logger_ = ioremap::swarm::logger(logger(), blackhole::log::attributes_t({
+				blackhole::attribute::make("component", "read-repairer")}));
+
+	return std::make_shared<read_repairer_t>(std::move(logger_), std::move(repairer_config)
+			, background_session_function(elliptics_read_session)
+			, background_session_function(elliptics_write_session)
+			, [this] (const couple_t &couple, const std::string &key) {
+				return delete_is_pending(couple, key);
+			}
+			, background_storage_flow("read-repair"));
+}
+
+std::shared_ptr<canary_prober_t> proxy::generate_canary_prober(const rapidjson::Value &config) {
+	if (!config.HasMember("canary")) {
+		return nullptr;
+	}
+
+	const auto &json = config["canary"];
+
+	canary_prober_t::config_t prober_config;
+
+	prober_config.rate = get_double(json, "rate", 1);
+	prober_config.key = get_string(json, "key", "mds-proxy-canary");
+	prober_config.write = get_bool(json, "write", false);
+	prober_config.in_flight_limit = get_int(json, "in-flight-limit", 64);
+
+	if (prober_config.rate <= 0) {
+		throw std::runtime_error("canary/rate must be positive");
+	}
+
+	// Every couple is known to mastermind by each of its groups
+	auto couples_function = [this] () {
+		std::set<groups_t> couples;
+		auto symmetric_groups = mastermind()->get_symmetric_groups();
+
+		for (auto it = symmetric_groups.begin(), end = symmetric_groups.end(); it != end; ++it) {
+			auto couple = it->second;
+			std::sort(couple.begin(), couple.end());
+			couples.insert(std::move(couple));
+		}
+
+		return std::vector<groups_t>(couples.begin(), couples.end());
+	};
+
+	auto logger_ = ioremap::swarm::logger(logger(), blackhole::log::attributes_t({
+				blackhole::attribute::make("component", "canary-prober")}));
+
+	return std::make_shared<canary_prober_t>(std::move(logger_), std::move(prober_config)
+			, std::move(couples_function)
+			, background_session_function(elliptics_read_session)
+			, background_session_function(elliptics_write_session)
+			, groups_health, background_storage_flow("canary"));
+}
+
+std::function<boost::optional<ioremap::elliptics::session> ()>
+proxy::background_session_function(const boost::optional<ioremap::elliptics::session> &session) {
+	// Sessions are reset in proxy's dtor, so the reference is checked under the lock
+	return [this, &session] () -> boost::optional<ioremap::elliptics::session> {
+		std::lock_guard<std::mutex> lock(elliptics_session_mutex);
+		(void) lock;
+
+		if (!session) {
+			return boost::none;
+		}
+
+		return session->clone();
+	};
+}
+
 proxy::~proxy() {
 	MDS_LOG_INFO("Mediastorage-proxy stops");
 
+	if (health_monitor) {
+		MDS_LOG_INFO("Mediastorage-proxy stops: health monitor");
+		health_monitor.reset();
+		MDS_LOG_INFO("Mediastorage-proxy stops: done");
+	}
+
+	if (canary_prober) {
+		MDS_LOG_INFO("Mediastorage-proxy stops: canary prober");
+		canary_prober.reset();
+		MDS_LOG_INFO("Mediastorage-proxy stops: done");
+	}
+
+	if (csum_migrator) {
+		MDS_LOG_INFO("Mediastorage-proxy stops: csum migrator");
+		csum_migrator.reset();
+		MDS_LOG_INFO("Mediastorage-proxy stops: done");
+	}
+
+	if (read_repairer) {
+		MDS_LOG_INFO("Mediastorage-proxy stops: read repairer");
+		read_repairer.reset();
+		MDS_LOG_INFO("Mediastorage-proxy stops: done");
+	}
+
+	if (delete_journal) {
+		MDS_LOG_INFO("Mediastorage-proxy stops: delete journal");
+		delete_journal.reset();
+		MDS_LOG_INFO("Mediastorage-proxy stops: done");
+	}
+
 	MDS_LOG_INFO("Mediastorage-proxy stops: mastermind");
 	mastermind()->stop();
 	MDS_LOG_INFO("Mediastorage-proxy stops: done");
@@ -319,6 +596,8 @@ bool proxy::initialize(const rapidjson::Value &config) {
 			timeout.def = 10;
 		}
 
+		timeout.lookup_preference = 50;
+
 		if (config.HasMember("timeouts")) {
 			const auto &json_timeout = config["timeouts"];
 
@@ -326,6 +605,8 @@ bool proxy::initialize(const rapidjson::Value &config) {
 			timeout.write = get_int(json_timeout, "write", timeout.def);
 			timeout.lookup = get_int(json_timeout, "lookup", timeout.def);
 			timeout.remove = get_int(json_timeout, "remove", timeout.def);
+			timeout.lookup_preference = get_int(json_timeout, "lookup-preference"
+					, timeout.lookup_preference);
 		}
 
 		MDS_LOG_INFO("Mediastorage-proxy starts: initialize elliptics session");
@@ -356,6 +637,49 @@ bool proxy::initialize(const rapidjson::Value &config) {
 		cdn_cache = generate_cdn_cache(config);
 		MDS_LOG_INFO("Mediastorage-proxy starts: done");
 
+		MDS_LOG_INFO("Mediastorage-proxy starts: initialize dns cache");
+		dns_cache = generate_dns_cache(config);
+		MDS_LOG_INFO("Mediastorage-proxy starts: done");
+
+		groups_health = std::make_shared<groups_health_t>();
+		deadline_queue = std::make_shared<deadline_queue_t>();
+
+		{
+			storage_scheduler_t::config_t scheduler_config;
+
+			if (config.HasMember("storage-scheduler")) {
+				const auto &json = config["storage-scheduler"];
+
+				scheduler_config.in_flight_limit = get_int(json, "in-flight-limit", 0);
+				scheduler_config.background_in_flight_limit
+					= get_int(json, "background-in-flight-limit", 0);
+			} else {
+				scheduler_config.in_flight_limit = 0;
+				scheduler_config.background_in_flight_limit = 0;
+			}
+
+			storage_scheduler = std::make_shared<storage_scheduler_t>(std::move(scheduler_config));
+		}
+
+		{
+			storage_bulkheads_t::config_t bulkheads_config;
+
+			if (config.HasMember("storage-bulkheads")) {
+				const auto &json = config["storage-bulkheads"];
+
+				bulkheads_config.group_in_flight_limit
+					= get_int(json, "group-in-flight-limit", 0);
+			} else {
+				bulkheads_config.group_in_flight_limit = 0;
+			}
+
+			storage_bulkheads = std::make_shared<storage_bulkheads_t>(std::move(bulkheads_config));
+		}
+
+		MDS_LOG_INFO("Mediastorage-proxy starts: initialize delete journal");
+		delete_journal = generate_delete_journal(config);
+		MDS_LOG_INFO("Mediastorage-proxy starts: done");
+
 		m_die_limit = get_int(config, "die-limit", 1);
 
 		if (config.HasMember("header-protector")) {
@@ -401,6 +725,196 @@ bool proxy::initialize(const rapidjson::Value &config) {
 			timeout_coef.data_flow_rate = get_int(json, "data-flow-rate", 0);
 		}
 
+		{
+			egress_meter_t::config_t egress_config;
+			const size_t MB = 1024 * 1024;
+
+			if (config.HasMember("egress")) {
+				const auto &json = config["egress"];
+
+				egress_config.capacity = get_int(json, "capacity", 0) * MB;
+				egress_config.in_flight_limit = get_int(json, "in-flight-limit", 0) * MB;
+				egress_config.rate_period = get_int(json, "rate-period", 1);
+			} else {
+				egress_config.capacity = 0;
+				egress_config.in_flight_limit = 0;
+				egress_config.rate_period = 1;
+			}
+
+			egress_meter = std::make_shared<egress_meter_t>(std::move(egress_config));
+		}
+
+		{
+			signature_cache_t::config_t signature_cache_config;
+
+			if (config.HasMember("signature-cache")) {
+				const auto &json = config["signature-cache"];
+
+				signature_cache_config.size = get_int(json, "size", 0);
+				signature_cache_config.margin = get_int(json, "margin", 5);
+				signature_cache_config.max_lifetime = get_int(json, "max-lifetime", 60);
+			} else {
+				signature_cache_config.size = 0;
+				signature_cache_config.margin = 5;
+				signature_cache_config.max_lifetime = 60;
+			}
+
+			signature_cache = std::make_shared<signature_cache_t>(
+					std::move(signature_cache_config));
+		}
+
+		admin_documents = std::make_shared<admin_documents_t>();
+
+		{
+			hot_keys_t::config_t hot_keys_config;
+
+			if (config.HasMember("hot-keys")) {
+				const auto &json = config["hot-keys"];
+
+				hot_keys_config.capacity = get_int(json, "capacity", 10000);
+				hot_keys_config.shards = get_int(json, "shards", 16);
+				hot_keys_config.half_life = get_int(json, "half-life", 60);
+				hot_keys_config.promotion_threshold = get_int(json, "promotion-threshold", 0);
+			} else {
+				hot_keys_config.capacity = 10000;
+				hot_keys_config.shards = 16;
+				hot_keys_config.half_life = 60;
+				hot_keys_config.promotion_threshold = 0;
+			}
+
+			hot_keys = std::make_shared<hot_keys_t>(std::move(hot_keys_config));
+		}
+
+		{
+			const size_t MB = 1024 * 1024;
+			memory_accountant_t::config_t memory_config;
+			memory_config.budgets.fill(0);
+
+			if (config.HasMember("memory")) {
+				const auto &json = config["memory"];
+
+				memory_config.limit = get_int(json, "limit", 0) * MB;
+
+				for (size_t index = 0; index != memory_accountant_t::subsystems_count; ++index) {
+					auto name = memory_accountant_t::subsystem_name(
+							static_cast<memory_accountant_t::subsystem_tag>(index));
+					memory_config.budgets[index] = get_int(json, name.c_str(), 0) * MB;
+				}
+			} else {
+				memory_config.limit = 0;
+			}
+
+			memory_accountant = std::make_shared<memory_accountant_t>(std::move(memory_config));
+		}
+
+		{
+			const size_t MB = 1024 * 1024;
+			hot_object_cache_t::config_t hot_object_cache_config;
+
+			if (config.HasMember("hot-object-cache")) {
+				const auto &json = config["hot-object-cache"];
+
+				hot_object_cache_config.size = get_int(json, "size", 0) * MB;
+				hot_object_cache_config.max_object_size
+					= get_int(json, "max-object-size", 1024) * 1024;
+				hot_object_cache_config.ttl = get_int(json, "ttl", 300);
+			} else {
+				hot_object_cache_config.size = 0;
+				hot_object_cache_config.max_object_size = 1024 * 1024;
+				hot_object_cache_config.ttl = 300;
+			}
+
+			hot_object_cache = std::make_shared<hot_object_cache_t>(
+					std::move(hot_object_cache_config), memory_accountant);
+			hot_keys_round_robin = 0;
+		}
+
+		{
+			const size_t MB = 1024 * 1024;
+			disk_cache_t::config_t disk_cache_config;
+
+			if (config.HasMember("disk-cache")) {
+				const auto &json = config["disk-cache"];
+
+				disk_cache_config.path = get_string(json, "path", "");
+				disk_cache_config.size = static_cast<size_t>(get_int(json, "size", 0)) * MB;
+				disk_cache_config.max_object_size
+					= get_int(json, "max-object-size", 1024) * 1024;
+				disk_cache_config.ttl = get_int(json, "ttl", 3600);
+				disk_cache_config.admission_threshold
+					= get_double(json, "admission-threshold", 0);
+				disk_cache_config.write_rate = get_int(json, "write-rate", 10) * MB;
+				disk_cache_config.write_queue_size = get_int(json, "write-queue-size", 64);
+				disk_cache_config.threads = get_int(json, "threads", 2);
+
+				if (disk_cache_config.size != 0 && disk_cache_config.path.empty()) {
+					throw std::runtime_error("disk-cache.path is not set");
+				}
+			} else {
+				disk_cache_config.size = 0;
+			}
+
+			MDS_LOG_INFO("Mediastorage-proxy starts: initialize disk cache");
+			auto logger_ = ioremap::swarm::logger(logger(), blackhole::log::attributes_t({
+						blackhole::attribute::make("component", "disk-cache")}));
+			disk_cache = std::make_shared<disk_cache_t>(std::move(logger_)
+					, std::move(disk_cache_config));
+			MDS_LOG_INFO("Mediastorage-proxy starts: done");
+		}
+
+		{
+			auto parse_transfer_rate_config = [&config] (const char *direction) {
+				transfer_rate_guard_t::config_t transfer_rate_config;
+				transfer_rate_config.min_rate = 0;
+				transfer_rate_config.window = 10;
+				transfer_rate_config.grace_period = 10;
+
+				if (!config.HasMember("transfer-rate-guard")) {
+					return transfer_rate_config;
+				}
+
+				const auto &guard_json = config["transfer-rate-guard"];
+
+				if (!guard_json.HasMember(direction)) {
+					return transfer_rate_config;
+				}
+
+				const auto &json = guard_json[direction];
+
+				transfer_rate_config.min_rate = get_int(json, "min-rate", 0);
+				transfer_rate_config.window = get_int(json, "window", 10);
+				transfer_rate_config.grace_period = get_int(json, "grace-period", 10);
+
+				return transfer_rate_config;
+			};
+
+			auto logger_ = ioremap::swarm::logger(logger(), blackhole::log::attributes_t({
+						blackhole::attribute::make("component", "transfer-rate-guard")}));
+			transfer_rate_guard = std::make_shared<transfer_rate_guard_t>(std::move(logger_)
+					, parse_transfer_rate_config("download")
+					, parse_transfer_rate_config("upload"));
+		}
+
+		if (config.HasMember("bulk-delete")) {
+			const auto &json = config["bulk-delete"];
+
+			bulk_delete.in_flight_limit = get_int(json, "in-flight-limit", 64);
+			bulk_delete.chunk_size = get_int(json, "chunk-size", 64 * 1024);
+		} else {
+			bulk_delete.in_flight_limit = 64;
+			bulk_delete.chunk_size = 64 * 1024;
+		}
+
+		if (config.HasMember("download-info-batch")) {
+			const auto &json = config["download-info-batch"];
+
+			download_info_batch.in_flight_limit = get_int(json, "in-flight-limit", 32);
+			download_info_batch.max_keys = get_int(json, "max-keys", 1000);
+		} else {
+			download_info_batch.in_flight_limit = 32;
+			download_info_batch.max_keys = 1000;
+		}
+
 		MDS_LOG_INFO("Mediastorage-proxy starts: initialize cache updater");
 		mastermind()->set_update_cache_callback(std::bind(&proxy::cache_update_callback, this));
 		mastermind()->start();
@@ -421,6 +935,18 @@ bool proxy::initialize(const rapidjson::Value &config) {
 			m_read_chunk_size = chunk_size["read"].GetInt() * MB;
 		}
 
+		MDS_LOG_INFO("Mediastorage-proxy starts: initialize csum migrator");
+		csum_migrator = generate_csum_migrator(config);
+		MDS_LOG_INFO("Mediastorage-proxy starts: done");
+
+		MDS_LOG_INFO("Mediastorage-proxy starts: initialize read repairer");
+		read_repairer = generate_read_repairer(config);
+		MDS_LOG_INFO("Mediastorage-proxy starts: done");
+
+		MDS_LOG_INFO("Mediastorage-proxy starts: initialize canary prober");
+		canary_prober = generate_canary_prober(config);
+		MDS_LOG_INFO("Mediastorage-proxy starts: done");
+
 		if (config.HasMember("handystats")) {
 			HANDY_CONFIG_JSON(config["handystats"]);
 
@@ -433,6 +959,27 @@ bool proxy::initialize(const rapidjson::Value &config) {
 			}
 		}
 
+		{
+			health_monitor_t::config_t health_config;
+
+			if (config.HasMember("health")) {
+				const auto &json = config["health"];
+
+				health_config.period = get_int(json, "period", 100);
+				health_config.overload_is_unhealthy = get_bool(json, "overload-is-unhealthy", false);
+			} else {
+				health_config.period = 100;
+				health_config.overload_is_unhealthy = false;
+			}
+
+			MDS_LOG_INFO("Mediastorage-proxy starts: initialize health monitor");
+			auto logger_ = ioremap::swarm::logger(logger(), blackhole::log::attributes_t({
+						blackhole::attribute::make("component", "health-monitor")}));
+			health_monitor = std::make_shared<health_monitor_t>(std::move(logger_)
+					, std::move(health_config), std::bind(&proxy::evaluate_health, this));
+			MDS_LOG_INFO("Mediastorage-proxy starts: done");
+		}
+
 	} catch(const std::exception &ex) {
 		MDS_LOG_ERROR("%s", ex.what());
 		return false;
@@ -443,14 +990,17 @@ bool proxy::initialize(const rapidjson::Value &config) {
 	register_handler<upload_t>("upload", false);
 	register_handler<req_get>("get", false);
 	register_handler<req_delete>("delete", false);
+	register_handler<req_bulk_delete>("bulk-delete", false);
 	register_handler<download_info_1_t>(download_info_1_t::handler_name, false);
 	register_handler<download_info_2_t>(download_info_2_t::handler_name, false);
+	register_handler<download_info_batch_t>(download_info_batch_t::handler_name, false);
 	register_handler<req_ping>("ping", true);
 	register_handler<req_ping>("stat", true);
 	register_handler<req_cache>("cache", true);
 	register_handler<req_cache_update>("cache-update", false);
 	register_handler<req_statistics>("statistics", false);
 	register_handler<req_stats>("stats", false);
+	register_handler<req_hot_keys>("hot-keys", true);
 
 	MDS_LOG_INFO("Mediastorage-proxy starts: done");
 	MDS_LOG_INFO("Mediastorage-proxy starts: initialization is done");
@@ -461,152 +1011,96 @@ bool proxy::initialize(const rapidjson::Value &config) {
 void proxy::req_ping::on_request(const ioremap::thevoid::http_request &req, const boost::asio::const_buffer &buffer) {
 	(void) buffer;
 
-	try {
-		if (!server()->mastermind()->is_valid()) {
-			MDS_LOG_ERROR("libmastermind has invalid state");
-			send_reply(500);
-			return;
-		}
-
-		auto begin_request = std::chrono::system_clock::now();
-		std::ostringstream ts_oss;
-
-		ts_oss << "start: " << std::chrono::duration_cast<std::chrono::microseconds>(
-				std::chrono::system_clock::now() - begin_request).count() << "us; ";
-
-		{
-			const auto &path = req.url().path();
-			ts_oss << "got url path: " << std::chrono::duration_cast<std::chrono::microseconds>(
-					std::chrono::system_clock::now() - begin_request).count() << "us; ";
-			MDS_LOG_INFO("Ping: handle request: %s", path.c_str());
-		}
-
-		ts_oss << "print greating log: " << std::chrono::duration_cast<std::chrono::microseconds>(
-				std::chrono::system_clock::now() - begin_request).count() << "us; ";
-
-		std::ostringstream oss;
+	// Probes are answered by the health which is evaluated in background,
+	// the deep probe runs the live check
+	if (req.url().query().has_item("deep")) {
+		MDS_LOG_INFO("Ping: handle deep request");
+		send_reply(server()->health_monitor->check());
+		return;
+	}
 
-		oss << "Stats: done; nodes alive: ";
-		int code = 200;
+	send_reply(server()->health_monitor->code());
+}
 
-		ts_oss << "init oss and code: " << std::chrono::duration_cast<std::chrono::microseconds>(
-				std::chrono::system_clock::now() - begin_request).count() << "us; ";
+void proxy::req_cache::on_request(const ioremap::thevoid::http_request &req, const boost::asio::const_buffer &buffer) {
+	(void) buffer;
 
-		auto session = server()->get_session();
+	try {
+		MDS_LOG_INFO("Cache: handle request: %s", req.url().path().c_str());
+		auto query_list = req.url().query();
 
-		if (!session) {
-			MDS_LOG_ERROR("cannot process ping request: session is uninitialized");
-			return;
+		static const std::vector<std::string> sections = {
+			  "group-weights"
+			, "symmetric-groups"
+			, "bad-groups"
+			, "cache-groups"
+			, "namespaces-settings"
+			, "metabalancer-info"
+		};
+
+		// Every combination of sections is a separate document
+		size_t mask = 0;
+
+		for (size_t index = 0; index != sections.size(); ++index) {
+			if (query_list.has_item(sections[index])) {
+				mask |= 1 << index;
+			}
 		}
 
-		session->set_trace_bit(req.trace_bit());
-		session->set_trace_id(req.request_id());
+		auto &mastermind = server()->mastermind();
+		auto render = [&mastermind, mask] () {
+			std::ostringstream oss;
+			oss << '{' << std::endl;
 
-		ts_oss << "session is copied: " << std::chrono::duration_cast<std::chrono::microseconds>(
-				std::chrono::system_clock::now() - begin_request).count() << "us; ";
+			bool g = false;
 
-		auto state_num = session->state_num();
+			for (size_t index = 0; index != sections.size(); ++index) {
+				if (!(mask & (1 << index))) {
+					continue;
+				}
 
-		ts_oss << "state_num was computed: " << std::chrono::duration_cast<std::chrono::microseconds>(
-				std::chrono::system_clock::now() - begin_request).count() << "us; ";
+				if (g) oss << ',' << std::endl;
+				oss << '"' << sections[index] << "\" : ";
+
+				switch (index) {
+				case 0:
+					oss << mastermind->json_group_weights();
+					break;
+				case 1:
+					oss << mastermind->json_symmetric_groups();
+					break;
+				case 2:
+					oss << mastermind->json_bad_groups();
+					break;
+				case 3:
+					oss << mastermind->json_cache_groups();
+					break;
+				case 4:
+					oss << mastermind->json_namespaces_settings();
+					break;
+				case 5:
+					oss << mastermind->json_metabalancer_info();
+					break;
+				}
 
-		auto die_limit = server()->die_limit();
+				g = true;
+			}
 
-		ts_oss << "got a die_limit: " << std::chrono::duration_cast<std::chrono::microseconds>(
-				std::chrono::system_clock::now() - begin_request).count() << "us; ";
+			if (g) oss << std::endl;
+			oss << '}' << std::endl;
+			return oss.str();
+		};
 
-		oss << state_num;
-		oss << "; die-limit: ";
+		auto document = server()->admin_documents->get("cache:" + std::to_string(mask), render);
+		auto reply = make_admin_document_reply(req, *document, "text/plain");
 
-		ts_oss << "check die_limit: " << std::chrono::duration_cast<std::chrono::microseconds>(
-				std::chrono::system_clock::now() - begin_request).count() << "us; ";
+		MDS_LOG_DEBUG("Cache: sending response");
 
-		if (state_num < die_limit) {
-			MDS_LOG_ERROR("Ping request error: state_num too small state_num=%d"
-					, static_cast<int>(state_num));
-			code = 500;
-			oss << "Bad";
+		if (std::get<1>(reply).empty()) {
+			send_reply(std::move(std::get<0>(reply)));
 		} else {
-			oss << "Ok";
-		}
-
-		ts_oss << "die_limit is checked: " << std::chrono::duration_cast<std::chrono::microseconds>(
-				std::chrono::system_clock::now() - begin_request).count() << "us; ";
-
-		send_reply(code);
-
-		ts_oss << "request was send: " << std::chrono::duration_cast<std::chrono::microseconds>(
-				std::chrono::system_clock::now() - begin_request).count() << "us; ";
-
-		{
-			const auto &msg = ts_oss.str();
-			MDS_LOG_INFO("%s", msg.c_str());
-		}
-
-		{
-			const auto &msg = oss.str();
-			MDS_LOG_INFO("%s", msg.c_str());
-		}
-	} catch (const std::exception &ex) {
-		MDS_LOG_ERROR("Ping request error: %s", ex.what());
-		send_reply(500);
-	} catch (...) {
-		MDS_LOG_ERROR("Ping request error: unknown");
-		send_reply(500);
-	}
-}
-
-void proxy::req_cache::on_request(const ioremap::thevoid::http_request &req, const boost::asio::const_buffer &buffer) {
-	(void) buffer;
-
-	try {
-		MDS_LOG_INFO("Cache: handle request: %s", req.url().path().c_str());
-		auto query_list = req.url().query();
-
-		bool g = false;
-
-		std::ostringstream oss;
-		oss << '{' << std::endl;
-		if (query_list.has_item("group-weights")) {
-			oss << "\"group-weights\" : " << server()->mastermind()->json_group_weights();
-			g = true;
-		}
-		if (query_list.has_item("symmetric-groups")) {
-			if (g) oss << ',' << std::endl;
-			oss << "\"symmetric-groups\" : " << server()->mastermind()->json_symmetric_groups();
-			g = true;
-		}
-		if (query_list.has_item("bad-groups")) {
-			if (g) oss << ',' << std::endl;
-			oss << "\"bad-groups\" : " << server()->mastermind()->json_bad_groups();
-			g = true;
+			send_reply(std::move(std::get<0>(reply)), std::move(std::get<1>(reply)));
 		}
-		if (query_list.has_item("cache-groups")) {
-			if (g) oss << ',' << std::endl;
-			oss << "\"cache-groups\" : " << server()->mastermind()->json_cache_groups();
-			g = true;
-		}
-		if (query_list.has_item("namespaces-settings")) {
-			if (g) oss << ',' << std::endl;
-			oss << "\"namespaces-settings\" : " << server()->mastermind()->json_namespaces_settings();
-			g = true;
-		}
-		if (query_list.has_item("metabalancer-info")) {
-			if (g) oss << ',' << std::endl;
-			oss << "\"metabalancer-info\" : " << server()->mastermind()->json_metabalancer_info();
-			g = true;
-		}
-		if (g) oss << std::endl;
-		oss << '}' << std::endl;
-		auto res_str = oss.str();
-		ioremap::thevoid::http_response reply;
-		ioremap::swarm::http_headers headers;
-		reply.set_code(200);
-		headers.set_content_length(res_str.size());
-		headers.set_content_type("text/plain");
-		reply.set_headers(headers);
-		MDS_LOG_DEBUG("Cache: sending response");
-		send_reply(std::move(reply), std::move(res_str));
 	} catch (const std::exception &ex) {
 		MDS_LOG_ERROR("Cache request error: %s", ex.what());
 		send_reply(500);
@@ -661,17 +1155,20 @@ void proxy::req_statistics::on_request(const ioremap::thevoid::http_request &req
 			return;
 		}
 
-		auto json = server()->mastermind()->json_namespace_statistics(ns_state.name());
-
-		ioremap::thevoid::http_response reply;
-		ioremap::swarm::http_headers headers;
+		auto &mastermind = server()->mastermind();
+		auto name = ns_state.name();
+		auto render = [&mastermind, &name] () {
+			return mastermind->json_namespace_statistics(name);
+		};
 
-		reply.set_code(200);
-		headers.set_content_length(json.size());
-		headers.set_content_type("application/json");
-		reply.set_headers(headers);
+		auto document = server()->admin_documents->get("statistics:" + name, render);
+		auto reply = make_admin_document_reply(req, *document, "application/json");
 
-		send_reply(std::move(reply), std::move(json));
+		if (std::get<1>(reply).empty()) {
+			send_reply(std::move(std::get<0>(reply)));
+		} else {
+			send_reply(std::move(std::get<0>(reply)), std::move(std::get<1>(reply)));
+		}
 	} catch (const std::exception &ex) {
 		MDS_LOG_ERROR("Statistics request error: %s", ex.what());
 		send_reply(500);
@@ -698,6 +1195,68 @@ void proxy::req_stats::on_request(const ioremap::thevoid::http_request &req, con
 	send_reply(std::move(reply), std::move(json));
 }
 
+void proxy::req_hot_keys::on_request(const ioremap::thevoid::http_request &req, const boost::asio::const_buffer &buffer) {
+	(void) buffer;
+
+	try {
+		MDS_LOG_INFO("Hot keys: handle request: %s", req.url().path().c_str());
+
+		const auto &query = req.url().query();
+
+		auto limit = get_arg<size_t>(query, "limit", 100);
+		auto ns = get_arg<std::string>(query, "namespace", "");
+		auto order = get_arg<std::string>(query, "order", "requests");
+
+		if (order != "requests" && order != "bytes") {
+			MDS_LOG_INFO("Hot keys: unknown order: %s", order.c_str());
+			send_reply(400);
+			return;
+		}
+
+		const auto &hot_keys = server()->hot_keys;
+		auto entries = hot_keys->top(limit, ns, order == "bytes");
+
+		kora::dynamic_t::array_t keys;
+
+		for (auto it = entries.begin(), end = entries.end(); it != end; ++it) {
+			auto dynamic = kora::dynamic_t::empty_object;
+			auto &object = dynamic.as_object();
+
+			object["namespace"] = it->ns;
+			object["couple"] = it->couple_id;
+			object["key"] = it->key;
+			object["requests"] = it->requests;
+			object["bytes"] = it->bytes;
+			object["writes"] = it->writes;
+			object["error"] = it->error;
+
+			keys.emplace_back(std::move(dynamic));
+		}
+
+		auto dynamic = kora::dynamic_t::empty_object;
+		auto &object = dynamic.as_object();
+
+		object["capacity"] = static_cast<unsigned long long>(hot_keys->get_config().capacity);
+		object["half-life"] = hot_keys->get_config().half_life;
+		object["keys"] = keys;
+
+		auto json = kora::to_pretty_json(dynamic);
+
+		ioremap::thevoid::http_response reply;
+		ioremap::swarm::http_headers headers;
+
+		reply.set_code(200);
+		headers.set_content_length(json.size());
+		headers.set_content_type("application/json");
+		reply.set_headers(headers);
+
+		send_reply(std::move(reply), std::move(json));
+	} catch (const std::exception &ex) {
+		MDS_LOG_ERROR("Hot keys request error: %s", ex.what());
+		send_reply(500);
+	}
+}
+
 boost::optional<ioremap::elliptics::session>
 proxy::get_session() {
 	std::lock_guard<std::mutex> lock(elliptics_session_mutex);
@@ -804,6 +1363,34 @@ int proxy::die_limit() const {
 	return m_die_limit;
 }
 
+storage_flow_t
+proxy::storage_flow(const mastermind::namespace_state_t &ns_state) {
+	return storage_flow_t(storage_scheduler, storage_scheduler_t::class_tag::foreground
+			, ns_state.name(), ns_settings(ns_state).scheduler_weight, storage_bulkheads);
+}
+
+storage_flow_t
+proxy::background_storage_flow(const std::string &name) {
+	return storage_flow_t(storage_scheduler, storage_scheduler_t::class_tag::background
+			, name, 1, storage_bulkheads);
+}
+
+health_monitor_t::health_t
+proxy::evaluate_health() {
+	health_monitor_t::health_t health;
+
+	health.mastermind_is_valid = mastermind()->is_valid();
+	health.die_limit = die_limit();
+	health.is_overloaded = memory_accountant->waiting() != 0;
+
+	auto session = get_session();
+
+	health.session_is_initialized = static_cast<bool>(session);
+	health.state_num = session ? session->state_num() : 0;
+
+	return health;
+}
+
 std::vector<int> proxy::groups_for_upload(const mastermind::namespace_state_t &ns_state, uint64_t size) {
 	if (!ns_settings(ns_state).static_couple.empty())
 		return ns_settings(ns_state).static_couple;
@@ -921,7 +1508,7 @@ file_location_t
 proxy::get_file_location(const ioremap::elliptics::sync_lookup_result &slr
 		, const mastermind::namespace_state_t &ns_state
 		, const std::string &x_regional_host) {
-	auto file_location = make_file_location(slr, ns_state);
+	auto file_location = make_file_location(slr, ns_state, *dns_cache);
 
 	bool use_regional_host = !x_regional_host.empty() && cdn_cache->check_host(x_regional_host);
 
@@ -960,6 +1547,11 @@ proxy::update_elliptics_remotes() {
 		auto remotes = mastermind()->get_elliptics_remotes();
 		std::vector<ioremap::elliptics::address> addresses;
 
+		// Hostnames of storage nodes are resolved in advance to keep DNS out of requests
+		if (dns_cache) {
+			dns_cache->prefetch(remotes);
+		}
+
 		for (auto it = remotes.begin(), end = remotes.end(); it != end; ++it) {
 			try {
 				addresses.emplace_back(*it);
@@ -984,6 +1576,93 @@ proxy::update_elliptics_remotes() {
 	MDS_LOG_INFO("update elliptics remotes is done");
 }
 
+bool
+proxy::delete_is_pending(const couple_t &couple, const std::string &key) {
+	if (!delete_journal) {
+		return false;
+	}
+
+	return delete_journal->is_pending(couple, key);
+}
+
+void
+proxy::key_is_uploading(const couple_t &couple, const std::string &key
+		, delete_journal_t::hold_callback_t next) {
+	invalidate_caches(couple, key);
+
+	if (!delete_journal) {
+		next(nullptr);
+		return;
+	}
+
+	delete_journal->hold(couple, key, std::move(next));
+}
+
+void
+proxy::key_is_uploaded(const couple_t &couple, const std::string &key
+		, delete_journal_t::hold_ptr_t hold, delete_journal_t::callback_t next) {
+	// Signatures and objects read while the key was written could be cached
+	// after the first invalidation
+	invalidate_caches(couple, key);
+
+	if (!delete_journal || !hold) {
+		next(true);
+		return;
+	}
+
+	delete_journal->cancel(hold, std::move(next));
+}
+
+void
+proxy::key_is_removing(const couple_t &couple, const std::string &key) {
+	invalidate_caches(couple, key);
+
+	// The repair must not bring the removed key back
+	if (read_repairer) {
+		read_repairer->cancel(couple, key);
+	}
+}
+
+void
+proxy::key_is_removed(const couple_t &couple, const std::string &key) {
+	invalidate_caches(couple, key);
+
+	// The repair could be queued while the key was removed
+	if (read_repairer) {
+		read_repairer->cancel(couple, key);
+	}
+}
+
+void
+proxy::invalidate_caches(const couple_t &couple, const std::string &key) {
+	signature_cache->invalidate(signature_cache_t::make_storage_key(couple, key));
+	hot_object_cache->invalidate(couple, key);
+	disk_cache->invalidate(couple, key);
+}
+
+parallel_lookuper_t::preference_t
+proxy::lookup_preference() {
+	parallel_lookuper_t::preference_t preference;
+	preference.deadline_queue = deadline_queue;
+	preference.timeout = std::chrono::milliseconds(timeout.lookup_preference);
+	return preference;
+}
+
+void
+proxy::replicas_diverged(const couple_t &couple, const std::string &key) {
+	if (read_repairer) {
+		read_repairer->enqueue(couple, key);
+	}
+}
+
+void
+proxy::record_without_chunked_csum_is_read(const couple_t &couple, const std::string &key
+		, size_t size, const dnet_time &timestamp) {
+	if (csum_migrator) {
+		csum_migrator->enqueue(couple, key, size, timestamp);
+	}
+}
+
 void proxy::cache_update_callback() {
 	auto &&m = mastermind();
 
@@ -992,6 +1671,9 @@ void proxy::cache_update_callback() {
 
 		update_elliptics_remotes();
 
+		// Admin documents are rendered from the mastermind cache
+		admin_documents->update();
+
 		MDS_LOG_INFO("cache updater is done");
 	}
 }
@@ -1061,6 +1743,24 @@ proxy::settings_factory(const std::string &name, const kora::config_t &config) {
 						settings->redirect_content_length_threshold)};
 		}
 
+		if (redirect_config.has("adaptive-content-length-threshold")) {
+			const auto &adaptive_config = redirect_config.at("adaptive-content-length-threshold");
+
+			settings->redirect_is_adaptive = true;
+			settings->redirect_min_content_length_threshold = adaptive_config.at<int>("min");
+			settings->redirect_max_content_length_threshold = adaptive_config.at<int>("max");
+
+			if (settings->redirect_min_content_length_threshold < 0
+					|| settings->redirect_max_content_length_threshold
+					< settings->redirect_min_content_length_threshold) {
+				throw std::runtime_error{"bad bounds of adaptive-content-length-threshold: min="
+					+ boost::lexical_cast<std::string>(
+							settings->redirect_min_content_length_threshold)
+					+ "; max=" + boost::lexical_cast<std::string>(
+							settings->redirect_max_content_length_threshold)};
+			}
+		}
+
 		if (redirect_config.has("query-args")) {
 			const auto &query_args_redirect_config
 				= redirect_config.at("query-args");
@@ -1102,6 +1802,84 @@ proxy::settings_factory(const std::string &name, const kora::config_t &config) {
 	}
 
 	settings->check_for_update = config.at<bool>("check-for-update", true);
+	settings->download_info_checks_consistency
+		= config.at<bool>("download-info-checks-consistency", false);
+	settings->scheduler_weight = config.at<double>("scheduler-weight", 1.);
+
+	if (settings->scheduler_weight <= 0) {
+		throw std::runtime_error{"scheduler-weight must be positive in \'" + name
+			+ "\' namespace"};
+	}
+
+	if (config.has("cache-control")) {
+		const auto &cache_control_config = config.at("cache-control");
+
+		settings->cache_control_immutable = cache_control_config.at<bool>("immutable", false);
+
+		if (cache_control_config.has("vary")) {
+			const auto &vary_config = cache_control_config.at("vary");
+
+			for (size_t index = 0, size = vary_config.size(); index != size; ++index) {
+				settings->cache_control_vary.emplace_back(vary_config.at<std::string>(index));
+			}
+		}
+
+		if (cache_control_config.has("rules")) {
+			const auto &rules_config = cache_control_config.at("rules");
+
+			for (size_t index = 0, size = rules_config.size(); index != size; ++index) {
+				const auto rule_config = rules_config.at(index);
+				cache_control_rule_t rule;
+
+				if (rule_config.has("extensions")) {
+					const auto &extensions_config = rule_config.at("extensions");
+
+					for (size_t index = 0, size = extensions_config.size(); index != size; ++index) {
+						rule.extensions.emplace_back(extensions_config.at<std::string>(index));
+					}
+				}
+
+				rule.min_size = rule_config.at<int64_t>("min-size", 0);
+				rule.max_size = rule_config.at<int64_t>("max-size", -1);
+				rule.max_age = rule_config.at<int>("max-age");
+				rule.s_maxage = rule_config.at<int>("s-maxage", -1);
+				rule.stale_while_revalidate = rule_config.at<int>("stale-while-revalidate", 0);
+
+				if (rule.max_age < 0 || rule.min_size < 0 || rule.max_size < -1) {
+					throw std::runtime_error{"bad cache-control rule in \'" + name
+						+ "\' namespace"};
+				}
+
+				settings->cache_control_rules.emplace_back(std::move(rule));
+			}
+		}
+	}
+
+	if (config.has("gzip")) {
+		const auto &gzip_config = config.at("gzip");
+
+		settings->gzip_is_enabled = gzip_config.at<bool>("enabled", true);
+		settings->gzip_min_size = gzip_config.at<int64_t>("min-size", 1024);
+		settings->gzip_max_size = gzip_config.at<int64_t>("max-size", 1024 * 1024);
+		settings->gzip_level = gzip_config.at<int>("level", 6);
+
+		if (gzip_config.has("content-types")) {
+			const auto &content_types_config = gzip_config.at("content-types");
+
+			for (size_t index = 0, size = content_types_config.size(); index != size; ++index) {
+				settings->gzip_content_types.emplace_back(
+						content_types_config.at<std::string>(index));
+			}
+		} else {
+			settings->gzip_content_types = {"text/", "application/json"
+				, "application/javascript", "application/xml", "image/svg+xml"};
+		}
+
+		if (settings->gzip_level < 1 || settings->gzip_level > 9) {
+			throw std::runtime_error{"gzip level must be in [1, 9] in \'" + name
+				+ "\' namespace"};
+		}
+	}
 
 	return mastermind::namespace_state_t::user_settings_ptr_t(std::move(settings));
 }
@@ -25,6 +25,24 @@
 #include "magic_provider.hpp"
 #include "utils.hpp"
 #include "cdn_cache.hpp"
+#include "dns_cache.hpp"
+#include "groups_health.hpp"
+#include "lookuper.hpp"
+#include "deadline_queue.hpp"
+#include "delete_journal.hpp"
+#include "csum_migrator.hpp"
+#include "read_repairer.hpp"
+#include "canary_prober.hpp"
+#include "egress_meter.hpp"
+#include "signature_cache.hpp"
+#include "hot_keys.hpp"
+#include "hot_object_cache.hpp"
+#include "disk_cache.hpp"
+#include "transfer_rate_guard.hpp"
+#include "health_monitor.hpp"
+#include "admin_documents.hpp"
+#include "storage_scheduler.hpp"
+#include "memory_accountant.hpp"
 #include "ns_settings.hpp"
 
 #include <elliptics/session.hpp>
@@ -102,6 +120,13 @@ public:
 		void on_request(const ioremap::thevoid::http_request &req, const boost::asio::const_buffer &buffer);
 	};
 
+	struct req_hot_keys
+		: public ioremap::thevoid::simple_request_stream<proxy>
+		, public std::enable_shared_from_this<req_hot_keys>
+	{
+		void on_request(const ioremap::thevoid::http_request &req, const boost::asio::const_buffer &buffer);
+	};
+
 protected:
 public:
 	template <typename T>
@@ -110,6 +135,15 @@ public:
 	ioremap::elliptics::node generate_node(const rapidjson::Value &config, int &timeout_def);
 	std::shared_ptr<mastermind::mastermind_t> generate_mastermind(const rapidjson::Value &config);
 	std::shared_ptr<cdn_cache_t> generate_cdn_cache(const rapidjson::Value &config);
+	std::shared_ptr<dns_cache_t> generate_dns_cache(const rapidjson::Value &config);
+	std::shared_ptr<delete_journal_t> generate_delete_journal(const rapidjson::Value &config);
+	std::shared_ptr<csum_migrator_t> generate_csum_migrator(const rapidjson::Value &config);
+	std::shared_ptr<read_repairer_t> generate_read_repairer(const rapidjson::Value &config);
+	std::shared_ptr<canary_prober_t> generate_canary_prober(const rapidjson::Value &config);
+
+	// Returns the function which clones the session for background jobs
+	std::function<boost::optional<ioremap::elliptics::session> ()>
+	background_session_function(const boost::optional<ioremap::elliptics::session> &session);
 
 	boost::optional<ioremap::elliptics::session>
 	get_session();
@@ -138,6 +172,17 @@ public:
 
 	int die_limit() const;
 
+	// Storage operations of the namespace are scheduled by its weight
+	storage_flow_t
+	storage_flow(const mastermind::namespace_state_t &ns_state);
+
+	storage_flow_t
+	background_storage_flow(const std::string &name);
+
+	// Evaluated by health_monitor in background
+	health_monitor_t::health_t
+	evaluate_health();
+
 	std::tuple<std::string, mastermind::namespace_state_t>
 	get_file_info(const ioremap::thevoid::http_request &req);
 
@@ -167,6 +212,48 @@ public:
 	void
 	update_elliptics_remotes();
 
+	// Returns true if the key was deleted asynchronously and the delete is not applied yet
+	bool
+	delete_is_pending(const couple_t &couple, const std::string &key);
+
+	// Called before the key is written: the pending delete of the key is held
+	// and next is called when the key can be written
+	void
+	key_is_uploading(const couple_t &couple, const std::string &key
+			, delete_journal_t::hold_callback_t next);
+
+	// Called after the key is committed: the held delete is cancelled
+	// and next is called after the cancel is durable
+	void
+	key_is_uploaded(const couple_t &couple, const std::string &key
+			, delete_journal_t::hold_ptr_t hold, delete_journal_t::callback_t next);
+
+	// Called before the key is removed, the repair of the key is cancelled
+	void
+	key_is_removing(const couple_t &couple, const std::string &key);
+
+	// Called after the remove is finished, whatever its result is: objects and signatures
+	// read while the key was removed could be cached after the first invalidation
+	void
+	key_is_removed(const couple_t &couple, const std::string &key);
+
+	// Drops the key from the signature, memory and disk caches
+	void
+	invalidate_caches(const couple_t &couple, const std::string &key);
+
+	// The first group of a lookup is preferred for lookup-preference milliseconds
+	parallel_lookuper_t::preference_t
+	lookup_preference();
+
+	// Keys with missing, broken or stale replicas are queued for read repair
+	void
+	replicas_diverged(const couple_t &couple, const std::string &key);
+
+	// Big records without chunked csum are queued for rewriting in background
+	void
+	record_without_chunked_csum_is_read(const couple_t &couple, const std::string &key
+			, size_t size, const dnet_time &timestamp);
+
 	void cache_update_callback();
 
 	mastermind::namespace_state_t::user_settings_ptr_t
@@ -189,6 +276,26 @@ public:
 	int m_read_chunk_size;
 	std::shared_ptr<mastermind::mastermind_t> m_mastermind;
 	std::shared_ptr<cdn_cache_t> cdn_cache;
+	std::shared_ptr<dns_cache_t> dns_cache;
+	std::shared_ptr<groups_health_t> groups_health;
+	std::shared_ptr<deadline_queue_t> deadline_queue;
+	std::shared_ptr<storage_scheduler_t> storage_scheduler;
+	std::shared_ptr<storage_bulkheads_t> storage_bulkheads;
+	std::shared_ptr<delete_journal_t> delete_journal;
+	std::shared_ptr<csum_migrator_t> csum_migrator;
+	std::shared_ptr<read_repairer_t> read_repairer;
+	std::shared_ptr<canary_prober_t> canary_prober;
+	std::shared_ptr<egress_meter_t> egress_meter;
+	std::shared_ptr<signature_cache_t> signature_cache;
+	std::shared_ptr<hot_keys_t> hot_keys;
+	std::shared_ptr<memory_accountant_t> memory_accountant;
+	std::shared_ptr<hot_object_cache_t> hot_object_cache;
+	std::shared_ptr<disk_cache_t> disk_cache;
+	std::shared_ptr<transfer_rate_guard_t> transfer_rate_guard;
+	std::shared_ptr<health_monitor_t> health_monitor;
+	std::shared_ptr<admin_documents_t> admin_documents;
+	// Spreads reads of hot keys over all their groups
+	std::atomic<size_t> hot_keys_round_robin;
 	boost::thread_specific_ptr<magic_provider> m_magic;
 
 	// write retries
@@ -201,12 +308,24 @@ public:
 		int write;
 		int lookup;
 		int remove;
+		// milliseconds
+		int lookup_preference;
 	} timeout;
 
 	struct {
 		int data_flow_rate;
 	} timeout_coef;
 
+	struct {
+		size_t in_flight_limit;
+		size_t chunk_size;
+	} bulk_delete;
+
+	struct {
+		size_t in_flight_limit;
+		size_t max_keys;
+	} download_info_batch;
+
 	struct {
 		std::string name;
 		std::string value;
@@ -0,0 +1,394 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "read_repairer.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <sstream>
+#include <algorithm>
+#include <tuple>
+
+namespace elliptics {
+
+read_repairer_t::read_repairer_t(ioremap::swarm::logger bh_logger_, config_t config_
+		, session_function_t read_session_function_
+		, session_function_t write_session_function_
+		, delete_is_pending_t delete_is_pending_
+		, storage_flow_t flow_)
+	: bh_logger(std::move(bh_logger_))
+	, config(std::move(config_))
+	, read_session_function(std::move(read_session_function_))
+	, write_session_function(std::move(write_session_function_))
+	, delete_is_pending(std::move(delete_is_pending_))
+	, flow(std::move(flow_))
+	, limiter(std::make_shared<bandwidth_limiter_t>(config.rate, config.copier.chunk_size))
+	, in_flight(0)
+	, work_is_done(false)
+{
+}
+
+read_repairer_t::~read_repairer_t() {
+	MDS_LOG_INFO("stopping read repairer");
+
+	lock_guard_t lock_guard(queue_mutex);
+
+	work_is_done = true;
+	queue.clear();
+
+	lock_guard.unlock();
+
+	// Copiers which wait for bandwidth are finished with failure
+	limiter->stop();
+
+	lock_guard.lock();
+
+	while (in_flight != 0) {
+		in_flight_cv.wait(lock_guard);
+	}
+
+	MDS_LOG_INFO("read repairer is stopped");
+}
+
+bool
+read_repairer_t::enqueue(couple_t couple, std::string key) {
+	if (couple.size() < 2 || delete_is_pending(couple, key)) {
+		return false;
+	}
+
+	auto index = index_key(couple, key);
+
+	lock_guard_t lock_guard(queue_mutex);
+
+	if (work_is_done || repairs.count(index) != 0) {
+		return false;
+	}
+
+	if (queue.size() >= config.queue_size) {
+		lock_guard.unlock();
+
+		MDS_LOG_INFO("cannot queue key for repair: queue is full: key=%s", key.c_str());
+		HANDY_COUNTER_INCREMENT("mds.read_repair.dropped");
+		return false;
+	}
+
+	auto repair = std::make_shared<repair_t>();
+	repair->couple = std::move(couple);
+	repair->key = std::move(key);
+	repair->is_cancelled = false;
+
+	repairs.insert(std::make_pair(std::move(index), repair));
+
+	MDS_LOG_INFO("key is queued for repair: key=%s", repair->key.c_str());
+
+	if (in_flight >= config.in_flight_limit) {
+		queue.emplace_back(std::move(repair));
+		update_stats();
+		return true;
+	}
+
+	in_flight += 1;
+	update_stats();
+
+	lock_guard.unlock();
+
+	start(std::move(repair));
+	return true;
+}
+
+void
+read_repairer_t::cancel(const couple_t &couple, const std::string &key) {
+	if (couple.empty()) {
+		return;
+	}
+
+	lock_guard_t lock_guard(queue_mutex);
+
+	auto it = repairs.find(index_key(couple, key));
+
+	if (it == repairs.end()) {
+		return;
+	}
+
+	// The queued repair is skipped when it is started
+	it->second->is_cancelled = true;
+}
+
+ioremap::swarm::logger &
+read_repairer_t::logger() {
+	return bh_logger;
+}
+
+std::string
+read_repairer_t::index_key(const couple_t &couple, const std::string &key) {
+	std::ostringstream oss;
+	oss << *std::min_element(couple.begin(), couple.end()) << '/' << key;
+	return oss.str();
+}
+
+bool
+read_repairer_t::is_cancelled(const repair_ptr_t &repair) {
+	{
+		lock_guard_t lock_guard(queue_mutex);
+
+		if (repair->is_cancelled) {
+			return true;
+		}
+	}
+
+	return delete_is_pending(repair->couple, repair->key);
+}
+
+void
+read_repairer_t::start(repair_ptr_t repair) {
+	if (is_cancelled(repair)) {
+		finish(std::move(repair), result_tag::skipped, "key is removed");
+		return;
+	}
+
+	auto session = read_session_function();
+
+	if (!session) {
+		finish(std::move(repair), result_tag::failed, "read-session is uninitialized");
+		return;
+	}
+
+	session->set_groups(repair->couple);
+	session->set_filter(ioremap::elliptics::filters::all);
+
+	flow.schedule([this, session, repair] (storage_scheduler_t::slot_ptr_t slot) mutable {
+		auto future = session->parallel_lookup(repair->key);
+
+		future.connect(hold_slot(std::move(slot), std::bind(&read_repairer_t::on_lookup, this, repair
+						, std::placeholders::_1, std::placeholders::_2)));
+	});
+}
+
+void
+read_repairer_t::on_lookup(repair_ptr_t repair
+		, const ioremap::elliptics::sync_lookup_result &entries
+		, const ioremap::elliptics::error_info &error_info) {
+	if (error_info && entries.empty()) {
+		finish(std::move(repair), result_tag::failed, error_info.message());
+		return;
+	}
+
+	const dnet_file_info *source = nullptr;
+	int source_group = 0;
+
+	for (auto it = entries.begin(), end = entries.end(); it != end; ++it) {
+		if (it->status() != 0) {
+			continue;
+		}
+
+		const auto *file_info = it->file_info();
+
+		if (!source || std::make_tuple(source->mtime.tsec, source->mtime.tnsec)
+				< std::make_tuple(file_info->mtime.tsec, file_info->mtime.tnsec)) {
+			source = file_info;
+			source_group = it->command()->id.group_id;
+		}
+	}
+
+	if (!source) {
+		finish(std::move(repair), result_tag::skipped, "there is no good replica");
+		return;
+	}
+
+	for (auto it = entries.begin(), end = entries.end(); it != end; ++it) {
+		const int group_id = it->command()->id.group_id;
+
+		switch (it->status()) {
+		case 0: {
+				const auto *file_info = it->file_info();
+
+				if (std::make_tuple(file_info->mtime.tsec, file_info->mtime.tnsec)
+						< std::make_tuple(source->mtime.tsec, source->mtime.tnsec)) {
+					repair->target_groups.push_back(group_id);
+				}
+			}
+			break;
+		case -ENOENT:
+		case -EBADFD:
+		case -EILSEQ:
+			repair->target_groups.push_back(group_id);
+			break;
+		}
+	}
+
+	if (repair->target_groups.empty()) {
+		finish(std::move(repair), result_tag::skipped, "there are no groups to repair");
+		return;
+	}
+
+	// The key could be removed while it was looked up
+	if (is_cancelled(repair)) {
+		finish(std::move(repair), result_tag::skipped, "key is removed");
+		return;
+	}
+
+	auto read_session = read_session_function();
+	auto write_session = write_session_function();
+
+	if (!read_session || !write_session) {
+		finish(std::move(repair), result_tag::failed, "session is uninitialized");
+		return;
+	}
+
+	{
+		std::ostringstream oss;
+		oss
+			<< "repair starts: key=" << repair->key
+			<< " source-group=" << source_group
+			<< " target-groups=" << repair->target_groups
+			<< " size=" << source->size;
+
+		auto msg = oss.str();
+		MDS_LOG_INFO("%s", msg.c_str());
+	}
+
+	auto copier = std::make_shared<record_copier_t>(
+			ioremap::swarm::logger(logger(), blackhole::log::attributes_t())
+			, config.copier, limiter
+			, *read_session, source_group
+			, *write_session, repair->target_groups
+			, repair->key, source->size, source->mtime
+			, source->record_flags & DNET_RECORD_FLAGS_CHUNKED_CSUM
+			, flow);
+
+	auto size = source->size;
+
+	copier->start([this, repair, size] (record_copier_t::result_tag result
+				, const std::string &description) {
+			if (result == record_copier_t::result_tag::copied) {
+				HANDY_COUNTER_INCREMENT("mds.read_repair.repaired_bytes"
+						, size * repair->target_groups.size());
+			}
+
+			on_copied(repair, result, description);
+		});
+}
+
+void
+read_repairer_t::on_copied(repair_ptr_t repair, record_copier_t::result_tag result
+		, const std::string &description) {
+	switch (result) {
+	case record_copier_t::result_tag::copied:
+		if (is_cancelled(repair)) {
+			revert(std::move(repair));
+			break;
+		}
+
+		finish(std::move(repair), result_tag::repaired, description);
+		break;
+	case record_copier_t::result_tag::updated:
+		finish(std::move(repair), result_tag::skipped, description);
+		break;
+	case record_copier_t::result_tag::failed:
+		finish(std::move(repair), result_tag::failed, description);
+		break;
+	}
+}
+
+void
+read_repairer_t::revert(repair_ptr_t repair) {
+	auto session = write_session_function();
+
+	if (!session) {
+		finish(std::move(repair), result_tag::failed
+				, "cannot remove copy of removed key: write-session is uninitialized");
+		return;
+	}
+
+	MDS_LOG_INFO("key is removed during repair, the copy is removed: key=%s"
+			, repair->key.c_str());
+	HANDY_COUNTER_INCREMENT("mds.read_repair.reverted");
+
+	session->set_groups(repair->target_groups);
+	session->set_filter(ioremap::elliptics::filters::all);
+
+	remove(make_shared_logger(logger()), *session, repair->key, flow
+			, [this, repair] (util::expected<remove_result_t> result) {
+				try {
+					if (result.get().is_failed()) {
+						finish(repair, result_tag::failed, "cannot remove copy of removed key");
+						return;
+					}
+
+					finish(repair, result_tag::skipped, "key is removed");
+				} catch (const std::exception &ex) {
+					finish(repair, result_tag::failed, ex.what());
+				}
+			});
+}
+
+void
+read_repairer_t::finish(repair_ptr_t repair, result_tag result
+		, const std::string &description) {
+	switch (result) {
+	case result_tag::repaired:
+		MDS_LOG_INFO("key is repaired: key=%s", repair->key.c_str());
+		HANDY_COUNTER_INCREMENT("mds.read_repair.repaired");
+		break;
+	case result_tag::skipped:
+		MDS_LOG_INFO("repair is skipped: key=%s; reason=%s"
+				, repair->key.c_str(), description.c_str());
+		HANDY_COUNTER_INCREMENT("mds.read_repair.skipped");
+		break;
+	case result_tag::failed:
+		MDS_LOG_ERROR("repair is failed: key=%s; error=%s"
+				, repair->key.c_str(), description.c_str());
+		HANDY_COUNTER_INCREMENT("mds.read_repair.failed");
+		break;
+	}
+
+	lock_guard_t lock_guard(queue_mutex);
+
+	{
+		auto it = repairs.find(index_key(repair->couple, repair->key));
+
+		if (it != repairs.end() && it->second == repair) {
+			repairs.erase(it);
+		}
+	}
+
+	if (work_is_done || queue.empty()) {
+		in_flight -= 1;
+		update_stats();
+		in_flight_cv.notify_all();
+		return;
+	}
+
+	auto next = std::move(queue.front());
+	queue.pop_front();
+	update_stats();
+
+	lock_guard.unlock();
+
+	start(std::move(next));
+}
+
+void
+read_repairer_t::update_stats() {
+	HANDY_GAUGE_SET("mds.read_repair.queue", queue.size());
+	HANDY_GAUGE_SET("mds.read_repair.in_flight", in_flight);
+}
+
+} // namespace elliptics
+
@@ -0,0 +1,154 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__READ_REPAIRER__HPP
+#define MDS_PROXY__SRC__READ_REPAIRER__HPP
+
+#include "loggers.hpp"
+#include "utils.hpp"
+#include "record_copier.hpp"
+#include "bandwidth_limiter.hpp"
+#include "remove.hpp"
+
+#include <elliptics/session.hpp>
+
+#include <boost/optional.hpp>
+
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <string>
+
+namespace elliptics {
+
+// Repairs replicas which GET handler found missing, broken or stale.
+// The key is looked up in all groups of the couple again, the replica with the latest
+// timestamp is chosen as the source and is copied by record_copier_t into groups where
+// the record is missing (-ENOENT), broken (-EBADFD, -EILSEQ) or older.
+// Groups which failed for any other reason are not touched.
+// All repairs share one bandwidth limiter.
+// Removed keys are never repaired: keys with pending deletes are skipped, the repair of
+// a removed key is dropped and the copy which was in flight is removed from target groups.
+class read_repairer_t {
+public:
+	struct config_t {
+		size_t queue_size;
+		size_t rate;
+		size_t in_flight_limit;
+		record_copier_t::config_t copier;
+	};
+
+	typedef std::function<boost::optional<ioremap::elliptics::session> ()> session_function_t;
+
+	// Returns true if the key is deleted but the delete is not applied yet
+	typedef std::function<bool (const couple_t &, const std::string &)> delete_is_pending_t;
+
+	read_repairer_t(ioremap::swarm::logger bh_logger_, config_t config_
+			, session_function_t read_session_function_
+			, session_function_t write_session_function_
+			, delete_is_pending_t delete_is_pending_
+			, storage_flow_t flow_ = storage_flow_t());
+	~read_repairer_t();
+
+	// Returns true if the key is queued for repair.
+	// The key is ignored if it is already queued or if the queue is full.
+	bool
+	enqueue(couple_t couple, std::string key);
+
+	// The key is removed, its repair is dropped
+	void
+	cancel(const couple_t &couple, const std::string &key);
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+
+	enum class result_tag {
+		  repaired
+		, skipped
+		, failed
+	};
+
+	struct repair_t {
+		couple_t couple;
+		std::string key;
+		couple_t target_groups;
+		bool is_cancelled;
+	};
+
+	typedef std::shared_ptr<repair_t> repair_ptr_t;
+
+	ioremap::swarm::logger &
+	logger();
+
+	static std::string
+	index_key(const couple_t &couple, const std::string &key);
+
+	bool
+	is_cancelled(const repair_ptr_t &repair);
+
+	void
+	start(repair_ptr_t repair);
+
+	void
+	on_lookup(repair_ptr_t repair, const ioremap::elliptics::sync_lookup_result &entries
+			, const ioremap::elliptics::error_info &error_info);
+
+	void
+	on_copied(repair_ptr_t repair, record_copier_t::result_tag result
+			, const std::string &description);
+
+	// Removes the copy which was written after the key was removed
+	void
+	revert(repair_ptr_t repair);
+
+	void
+	finish(repair_ptr_t repair, result_tag result, const std::string &description);
+
+	void
+	update_stats();
+
+	ioremap::swarm::logger bh_logger;
+
+	config_t config;
+	session_function_t read_session_function;
+	session_function_t write_session_function;
+	delete_is_pending_t delete_is_pending;
+	storage_flow_t flow;
+
+	std::shared_ptr<bandwidth_limiter_t> limiter;
+
+	mutex_t queue_mutex;
+	std::deque<repair_ptr_t> queue;
+	// Queued and in-flight repairs
+	std::unordered_map<std::string, repair_ptr_t> repairs;
+	size_t in_flight;
+
+	std::condition_variable in_flight_cv;
+
+	bool work_is_done;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__READ_REPAIRER__HPP */
+
@@ -0,0 +1,185 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "record_copier.hpp"
+
+#include <algorithm>
+#include <tuple>
+
+namespace elliptics {
+
+record_copier_t::record_copier_t(ioremap::swarm::logger bh_logger_, const config_t &config_
+		, std::shared_ptr<bandwidth_limiter_t> limiter_
+		, ioremap::elliptics::session read_session_, int source_group
+		, ioremap::elliptics::session write_session_, couple_t target_groups
+		, std::string key_, size_t size_, dnet_time timestamp_, bool with_chunked_csum_
+		, storage_flow_t flow_)
+	: bh_logger(std::move(bh_logger_))
+	, config(config_)
+	, limiter(std::move(limiter_))
+	, flow(std::move(flow_))
+	, read_session(read_session_.clone())
+	, key(std::move(key_))
+	, size(size_)
+	, timestamp(timestamp_)
+	, with_chunked_csum(with_chunked_csum_)
+	, offset(0)
+{
+	read_session.set_groups({source_group});
+
+	write_session_.set_groups(target_groups);
+	write_session_.set_timestamp(timestamp);
+	write_session_.set_ioflags(write_session_.get_ioflags() | DNET_IO_FLAGS_CAS_TIMESTAMP);
+
+	writer = std::make_shared<writer_t>(
+			ioremap::swarm::logger(logger(), blackhole::log::attributes_t())
+			, write_session_, key, size, 0
+			, config.commit_coef, target_groups.size()
+			, config.limit_of_attempts, config.scale_retry_timeout
+			, flow);
+}
+
+void
+record_copier_t::start(callback_t callback_) {
+	callback = std::move(callback_);
+
+	if (size == 0) {
+		finish(result_tag::failed, "empty record");
+		return;
+	}
+
+	acquire();
+}
+
+ioremap::swarm::logger &
+record_copier_t::logger() {
+	return bh_logger;
+}
+
+void
+record_copier_t::acquire() {
+	auto chunk_size = std::min(config.chunk_size, size - offset);
+
+	limiter->acquire(chunk_size, std::bind(&record_copier_t::read_chunk, shared_from_this()
+				, std::placeholders::_1));
+}
+
+void
+record_copier_t::read_chunk(bool is_active) {
+	if (!is_active) {
+		finish(result_tag::failed, "copying is stopped");
+		return;
+	}
+
+	auto session = read_session.clone();
+
+	// The record without chunked csum is checksummed as a whole on the first chunk,
+	// the rest of chunks are read without csum check as req_get does
+	if (with_chunked_csum || offset == 0) {
+		session.set_ioflags(session.get_ioflags() & ~DNET_IO_FLAGS_NOCSUM);
+
+		if (!with_chunked_csum && config.commit_coef) {
+			session.set_timeout(session.get_timeout() + size / config.commit_coef);
+		}
+	} else {
+		session.set_ioflags(session.get_ioflags() | DNET_IO_FLAGS_NOCSUM);
+	}
+
+	auto chunk_size = std::min(config.chunk_size, size - offset);
+	auto self = shared_from_this();
+
+	flow.schedule([this, self, session, chunk_size] (
+				storage_scheduler_t::slot_ptr_t slot) mutable {
+		auto permit = flow.acquire(session.get_groups());
+
+		// Copying is a background job, it does not wait for the group
+		if (permit->groups().empty()) {
+			finish(result_tag::failed, "bulkhead of source group is full");
+			return;
+		}
+
+		auto future = session.read_data(key, offset, chunk_size);
+
+		future.connect(hold_slot(std::move(slot), hold_slot(std::move(permit)
+						, std::bind(&record_copier_t::on_read, self
+							, std::placeholders::_1, std::placeholders::_2))));
+	});
+}
+
+void
+record_copier_t::on_read(const ioremap::elliptics::sync_read_result &entries
+		, const ioremap::elliptics::error_info &error_info) {
+	if (error_info || entries.empty()) {
+		finish(result_tag::failed, error_info ? error_info.message() : "empty read result");
+		return;
+	}
+
+	const auto &entry = entries.front();
+	const auto &entry_timestamp = entry.io_attribute()->timestamp;
+
+	if (std::make_tuple(entry_timestamp.tsec, entry_timestamp.tnsec)
+			!= std::make_tuple(timestamp.tsec, timestamp.tnsec)) {
+		finish(result_tag::updated, "record was updated");
+		return;
+	}
+
+	auto data_pointer = entry.file();
+
+	if (data_pointer.empty()) {
+		finish(result_tag::failed, "empty chunk");
+		return;
+	}
+
+	try {
+		writer->write(data_pointer, std::bind(&record_copier_t::on_written, shared_from_this()
+					, data_pointer.size(), std::placeholders::_1));
+	} catch (const std::exception &ex) {
+		finish(result_tag::failed, ex.what());
+	}
+}
+
+void
+record_copier_t::on_written(size_t chunk_size, const std::error_code &error_code) {
+	if (error_code) {
+		finish(result_tag::failed, error_code.message());
+		return;
+	}
+
+	offset += chunk_size;
+
+	if (writer->is_committed()) {
+		finish(result_tag::copied, "success");
+		return;
+	}
+
+	acquire();
+}
+
+void
+record_copier_t::finish(result_tag result, const std::string &description) {
+	auto callback_ = std::move(callback);
+	callback = nullptr;
+
+	if (callback_) {
+		callback_(result, description);
+	}
+}
+
+} // namespace elliptics
+
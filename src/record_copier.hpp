@@ -0,0 +1,111 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__RECORD_COPIER__HPP
+#define MDS_PROXY__SRC__RECORD_COPIER__HPP
+
+#include "loggers.hpp"
+#include "utils.hpp"
+#include "writer.hpp"
+#include "bandwidth_limiter.hpp"
+
+#include <elliptics/session.hpp>
+
+#include <memory>
+#include <functional>
+#include <string>
+
+namespace elliptics {
+
+// Copies the record from the source group into the target groups chunk by chunk.
+// The data is written through writer_t, hence the new version becomes visible on commit.
+// The original timestamp is kept and the write is done with CAS by timestamp,
+// thus the record which was updated in the meantime is not overwritten.
+// Every chunk is read only after the limiter allows it.
+// Reads and writes of chunks are scheduled by flow_.
+class record_copier_t : public std::enable_shared_from_this<record_copier_t> {
+public:
+	struct config_t {
+		size_t chunk_size;
+		size_t commit_coef;
+		size_t limit_of_attempts;
+		double scale_retry_timeout;
+	};
+
+	enum class result_tag {
+		  copied
+		  // The record was changed during copying
+		, updated
+		, failed
+	};
+
+	typedef std::function<void (result_tag, const std::string &)> callback_t;
+
+	record_copier_t(ioremap::swarm::logger bh_logger_, const config_t &config_
+			, std::shared_ptr<bandwidth_limiter_t> limiter_
+			, ioremap::elliptics::session read_session_, int source_group
+			, ioremap::elliptics::session write_session_, couple_t target_groups
+			, std::string key_, size_t size_, dnet_time timestamp_, bool with_chunked_csum_
+			, storage_flow_t flow_ = storage_flow_t());
+
+	void
+	start(callback_t callback_);
+
+private:
+	ioremap::swarm::logger &
+	logger();
+
+	void
+	acquire();
+
+	void
+	read_chunk(bool is_active);
+
+	void
+	on_read(const ioremap::elliptics::sync_read_result &entries
+			, const ioremap::elliptics::error_info &error_info);
+
+	void
+	on_written(size_t chunk_size, const std::error_code &error_code);
+
+	void
+	finish(result_tag result, const std::string &description);
+
+	ioremap::swarm::logger bh_logger;
+
+	config_t config;
+	std::shared_ptr<bandwidth_limiter_t> limiter;
+	storage_flow_t flow;
+
+	ioremap::elliptics::session read_session;
+	std::shared_ptr<writer_t> writer;
+
+	std::string key;
+	size_t size;
+	dnet_time timestamp;
+	bool with_chunked_csum;
+
+	size_t offset;
+	callback_t callback;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__RECORD_COPIER__HPP */
+
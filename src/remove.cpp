@@ -97,6 +97,7 @@ void
 elliptics::remove(shared_logger_t shared_logger
 		, ioremap::elliptics::session session
 		, std::string key
+		, const storage_flow_t &flow
 		, util::expected<remove_result_t>::callback_t next) {
 	{
 		std::ostringstream oss;
@@ -105,17 +106,20 @@ elliptics::remove(shared_logger_t shared_logger
 		MDS_LOG_INFO("%s", msg.c_str());
 	}
 
-	util::timer_t timer;
-
 	session = session.clone();
 	session.set_filter(ioremap::elliptics::filters::all_with_ack);
 
-	auto future = session.remove(key);
+	flow.schedule([shared_logger, session, key, next] (storage_scheduler_t::slot_ptr_t slot) mutable {
+		util::timer_t timer;
+
+		auto future = session.remove(key);
 
-	auto next_ = std::bind(remove_was_done, std::move(shared_logger)
-			, std::placeholders::_1, std::placeholders::_2
-			, key, timer, session.get_groups().size(), std::move(next));
+		auto next_ = std::bind(remove_was_done, shared_logger
+				, std::placeholders::_1, std::placeholders::_2
+				, key, timer, session.get_groups().size(), next);
 
-	future.connect(next_);
+		// The slot is held until the key is removed
+		future.connect(hold_slot(std::move(slot), std::move(next_)));
+	});
 }
 
@@ -22,6 +22,7 @@
 
 #include "loggers.hpp"
 #include "expected.hpp"
+#include "storage_scheduler.hpp"
 
 #include <elliptics/session.hpp>
 
@@ -52,6 +53,7 @@ void
 remove(shared_logger_t shared_logger
 		, ioremap::elliptics::session session
 		, std::string key
+		, const storage_flow_t &flow
 		, util::expected<remove_result_t>::callback_t next);
 
 } // namespace elliptics
@@ -0,0 +1,227 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "signature_cache.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace elliptics {
+
+namespace {
+
+const size_t max_invalidations = 65536;
+
+} // namespace
+
+signature_cache_t::signature_cache_t(config_t config_)
+	: config(std::move(config_))
+	, variants_count(0)
+	, last_version(0)
+	, forgotten_version(0)
+{
+}
+
+bool
+signature_cache_t::is_enabled() const {
+	return config.size != 0;
+}
+
+boost::optional<signature_cache_t::value_t>
+signature_cache_t::get(const std::string &storage_key, const std::string &variant_key) {
+	if (!is_enabled()) {
+		return boost::none;
+	}
+
+	std::lock_guard<std::mutex> lock_guard(mutex);
+	(void) lock_guard;
+
+	auto it = entries.find(storage_key);
+
+	if (it == entries.end()) {
+		return boost::none;
+	}
+
+	auto &variants = it->second.variants;
+	auto variant_it = std::find_if(variants.begin(), variants.end()
+			, [&variant_key] (const variant_t &variant) {
+				return variant.key == variant_key;
+			});
+
+	if (variant_it == variants.end()) {
+		return boost::none;
+	}
+
+	if (variant_it->valid_until <= clock_t::now()) {
+		variants.erase(variant_it);
+		variants_count -= 1;
+
+		if (variants.empty()) {
+			erase(it);
+		}
+
+		return boost::none;
+	}
+
+	lru.splice(lru.begin(), lru, it->second.lru_iterator);
+
+	return variant_it->value;
+}
+
+signature_cache_t::version_t
+signature_cache_t::version() {
+	std::lock_guard<std::mutex> lock_guard(mutex);
+	(void) lock_guard;
+
+	return last_version;
+}
+
+void
+signature_cache_t::set(const std::string &storage_key, const std::string &variant_key
+		, value_t value, std::chrono::seconds expiration_time, version_t version_) {
+	if (!is_enabled()) {
+		return;
+	}
+
+	auto lifetime = std::min(expiration_time - std::chrono::seconds(config.margin)
+			, std::chrono::seconds(config.max_lifetime));
+
+	// The signature expires too fast to be reused
+	if (lifetime <= std::chrono::seconds(0)) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock_guard(mutex);
+	(void) lock_guard;
+
+	// The key was invalidated while it was looked up
+	if (version_ < forgotten_version) {
+		return;
+	}
+
+	{
+		auto it = invalidations.find(storage_key);
+
+		if (it != invalidations.end() && version_ < it->second) {
+			return;
+		}
+	}
+
+	auto it = entries.find(storage_key);
+
+	if (it == entries.end()) {
+		lru.push_front(storage_key);
+
+		entry_t entry;
+		entry.lru_iterator = lru.begin();
+
+		it = entries.insert(std::make_pair(storage_key, std::move(entry))).first;
+	} else {
+		lru.splice(lru.begin(), lru, it->second.lru_iterator);
+	}
+
+	auto &variants = it->second.variants;
+	auto variant_it = std::find_if(variants.begin(), variants.end()
+			, [&variant_key] (const variant_t &variant) {
+				return variant.key == variant_key;
+			});
+
+	if (variant_it == variants.end()) {
+		variants.emplace_back();
+		variant_it = variants.end() - 1;
+		variant_it->key = variant_key;
+		variants_count += 1;
+	}
+
+	variant_it->value = std::move(value);
+	variant_it->valid_until = clock_t::now() + lifetime;
+
+	while (variants_count > config.size && !lru.empty()) {
+		erase(entries.find(lru.back()));
+	}
+}
+
+void
+signature_cache_t::invalidate(const std::string &storage_key) {
+	if (!is_enabled()) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock_guard(mutex);
+	(void) lock_guard;
+
+	if (invalidations.size() >= max_invalidations) {
+		invalidations.clear();
+		forgotten_version = last_version;
+	}
+
+	invalidations[storage_key] = ++last_version;
+
+	auto it = entries.find(storage_key);
+
+	if (it != entries.end()) {
+		erase(it);
+	}
+}
+
+size_t
+signature_cache_t::size() const {
+	std::lock_guard<std::mutex> lock_guard(mutex);
+	(void) lock_guard;
+
+	return variants_count;
+}
+
+std::string
+signature_cache_t::make_storage_key(const couple_t &couple, const std::string &key) {
+	std::ostringstream oss;
+
+	if (!couple.empty()) {
+		oss << *std::min_element(couple.begin(), couple.end());
+	}
+
+	oss << '/' << key;
+
+	return oss.str();
+}
+
+std::string
+signature_cache_t::make_variant_key(const std::string &x_regional_host
+		, std::chrono::seconds expiration_time
+		, const std::vector<std::tuple<std::string, std::string>> &args) {
+	std::ostringstream oss;
+
+	oss << x_regional_host << '\t' << expiration_time.count();
+
+	for (auto it = args.begin(), end = args.end(); it != end; ++it) {
+		oss << '&' << std::get<0>(*it) << '=' << std::get<1>(*it);
+	}
+
+	return oss.str();
+}
+
+void
+signature_cache_t::erase(std::unordered_map<std::string, entry_t>::iterator it) {
+	variants_count -= it->second.variants.size();
+	lru.erase(it->second.lru_iterator);
+	entries.erase(it);
+}
+
+} // namespace elliptics
+
@@ -0,0 +1,126 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__SIGNATURE_CACHE__HPP
+#define MDS_PROXY__SRC__SIGNATURE_CACHE__HPP
+
+#include "utils.hpp"
+
+#include <boost/optional.hpp>
+
+#include <unordered_map>
+#include <list>
+#include <vector>
+#include <tuple>
+#include <mutex>
+#include <chrono>
+#include <string>
+
+namespace elliptics {
+
+// Short-lived cache of signed file locations which are used for redirects and
+// download-info responses. Entries are grouped by storage key (couple and key)
+// to drop all variants of the key at once when the key is uploaded or removed.
+// The variant key distinguishes regional host, expiration time and signed query args.
+class signature_cache_t {
+public:
+	struct config_t {
+		size_t size;
+		// An entry is used until the signed timestamp minus margin, seconds
+		int margin;
+		// The upper bound of entry lifetime, seconds
+		int max_lifetime;
+	};
+
+	struct value_t {
+		std::string host;
+		std::string path;
+		std::string ts;
+		std::string sign;
+		uint64_t size;
+	};
+
+	// Is taken before the key is looked up and is passed to set
+	typedef uint64_t version_t;
+
+	signature_cache_t(config_t config_);
+
+	bool
+	is_enabled() const;
+
+	boost::optional<value_t>
+	get(const std::string &storage_key, const std::string &variant_key);
+
+	version_t
+	version();
+
+	// The value is dropped if the key was invalidated after version_ was taken
+	void
+	set(const std::string &storage_key, const std::string &variant_key
+			, value_t value, std::chrono::seconds expiration_time, version_t version_);
+
+	void
+	invalidate(const std::string &storage_key);
+
+	size_t
+	size() const;
+
+	static std::string
+	make_storage_key(const couple_t &couple, const std::string &key);
+
+	static std::string
+	make_variant_key(const std::string &x_regional_host, std::chrono::seconds expiration_time
+			, const std::vector<std::tuple<std::string, std::string>> &args
+				= std::vector<std::tuple<std::string, std::string>>{});
+
+private:
+	typedef std::chrono::steady_clock clock_t;
+
+	struct variant_t {
+		std::string key;
+		value_t value;
+		clock_t::time_point valid_until;
+	};
+
+	struct entry_t {
+		std::vector<variant_t> variants;
+		std::list<std::string>::iterator lru_iterator;
+	};
+
+	void
+	erase(std::unordered_map<std::string, entry_t>::iterator it);
+
+	config_t config;
+
+	mutable std::mutex mutex;
+	std::unordered_map<std::string, entry_t> entries;
+	std::list<std::string> lru;
+	size_t variants_count;
+
+	// Versions of the last invalidations of keys. Invalidations are forgotten when there are
+	// too many of them, signatures made before that are refused
+	std::unordered_map<std::string, version_t> invalidations;
+	version_t last_version;
+	version_t forgotten_version;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__SIGNATURE_CACHE__HPP */
+
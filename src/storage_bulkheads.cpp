@@ -0,0 +1,129 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "storage_bulkheads.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <utility>
+
+namespace elliptics {
+
+storage_bulkheads_t::permit_t::permit_t(groups_t groups_)
+	: accepted(std::move(groups_))
+{
+}
+
+storage_bulkheads_t::permit_t::permit_t(std::shared_ptr<storage_bulkheads_t> bulkheads_
+		, groups_t groups_, groups_t rejected_groups_)
+	: bulkheads(std::move(bulkheads_))
+	, accepted(std::move(groups_))
+	, rejected(std::move(rejected_groups_))
+{
+}
+
+storage_bulkheads_t::permit_t::~permit_t() {
+	if (bulkheads) {
+		bulkheads->release(accepted);
+	}
+}
+
+const groups_t &
+storage_bulkheads_t::permit_t::groups() const {
+	return accepted;
+}
+
+const groups_t &
+storage_bulkheads_t::permit_t::rejected_groups() const {
+	return rejected;
+}
+
+storage_bulkheads_t::storage_bulkheads_t(config_t config_)
+	: config(std::move(config_))
+{
+}
+
+bool
+storage_bulkheads_t::is_enabled() const {
+	return config.group_in_flight_limit != 0;
+}
+
+storage_bulkheads_t::permit_ptr_t
+storage_bulkheads_t::acquire(groups_t groups) {
+	if (!is_enabled()) {
+		return std::make_shared<permit_t>(std::move(groups));
+	}
+
+	groups_t accepted;
+	groups_t rejected;
+
+	{
+		lock_guard_t lock_guard(mutex);
+
+		for (auto it = groups.begin(), end = groups.end(); it != end; ++it) {
+			auto &in_flight = occupancy[*it];
+
+			if (in_flight >= config.group_in_flight_limit) {
+				rejected.push_back(*it);
+				continue;
+			}
+
+			in_flight += 1;
+			accepted.push_back(*it);
+
+			HANDY_GAUGE_SET(("mds.bulkheads.%d.in_flight", *it), in_flight);
+		}
+	}
+
+	for (auto it = rejected.begin(), end = rejected.end(); it != end; ++it) {
+		HANDY_COUNTER_INCREMENT(("mds.bulkheads.%d.rejected", *it));
+		HANDY_COUNTER_INCREMENT("mds.bulkheads.rejected");
+	}
+
+	return permit_ptr_t(new permit_t(shared_from_this(), std::move(accepted), std::move(rejected)));
+}
+
+size_t
+storage_bulkheads_t::in_flight(group_t group) const {
+	lock_guard_t lock_guard(mutex);
+
+	auto it = occupancy.find(group);
+
+	if (it == occupancy.end()) {
+		return 0;
+	}
+
+	return it->second;
+}
+
+void
+storage_bulkheads_t::release(const groups_t &groups) {
+	lock_guard_t lock_guard(mutex);
+
+	for (auto it = groups.begin(), end = groups.end(); it != end; ++it) {
+		auto &in_flight = occupancy[*it];
+
+		in_flight -= 1;
+
+		HANDY_GAUGE_SET(("mds.bulkheads.%d.in_flight", *it), in_flight);
+	}
+}
+
+} // namespace elliptics
+
@@ -0,0 +1,102 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MDS_PROXY__SRC__STORAGE_BULKHEADS__HPP
+#define MDS_PROXY__SRC__STORAGE_BULKHEADS__HPP
+
+#include "utils.hpp"
+
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+namespace elliptics {
+
+// Caps the number of operations which are in flight to every group.
+// A slow group cannot take all the capacity of the proxy this way: an operation over
+// the limit is not queued but rejected at once, hence the caller reroutes it to another
+// replica or fails fast.
+class storage_bulkheads_t
+	: public std::enable_shared_from_this<storage_bulkheads_t>
+{
+public:
+	struct config_t {
+		// Groups are not limited if it is 0
+		size_t group_in_flight_limit;
+	};
+
+	// Places of accepted groups are released when the permit is destroyed
+	class permit_t {
+	public:
+		// The permit which accepts all the groups
+		permit_t(groups_t groups_);
+
+		~permit_t();
+
+		const groups_t &
+		groups() const;
+
+		const groups_t &
+		rejected_groups() const;
+
+	private:
+		friend class storage_bulkheads_t;
+
+		permit_t(std::shared_ptr<storage_bulkheads_t> bulkheads_
+				, groups_t groups_, groups_t rejected_groups_);
+
+		permit_t(const permit_t &) = delete;
+		permit_t &operator = (const permit_t &) = delete;
+
+		std::shared_ptr<storage_bulkheads_t> bulkheads;
+		groups_t accepted;
+		groups_t rejected;
+	};
+
+	typedef std::shared_ptr<permit_t> permit_ptr_t;
+
+	storage_bulkheads_t(config_t config_);
+
+	bool
+	is_enabled() const;
+
+	// Takes a place in the bulkhead of every group which is not full
+	permit_ptr_t
+	acquire(groups_t groups);
+
+	size_t
+	in_flight(group_t group) const;
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::lock_guard<mutex_t> lock_guard_t;
+
+	void
+	release(const groups_t &groups);
+
+	config_t config;
+
+	mutable mutex_t mutex;
+	std::unordered_map<group_t, size_t> occupancy;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__STORAGE_BULKHEADS__HPP */
+
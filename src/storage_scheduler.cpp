@@ -0,0 +1,244 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "storage_scheduler.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <algorithm>
+#include <vector>
+#include <utility>
+
+namespace elliptics {
+
+storage_scheduler_t::slot_t::slot_t(std::shared_ptr<storage_scheduler_t> scheduler_
+		, class_tag class_)
+	: scheduler(std::move(scheduler_))
+	, slot_class(class_)
+{
+}
+
+storage_scheduler_t::slot_t::~slot_t() {
+	scheduler->release(slot_class);
+}
+
+storage_scheduler_t::storage_scheduler_t(config_t config_)
+	: config(std::move(config_))
+	, foreground{0, 0, 0, {}}
+	, background{0, 0, 0, {}}
+{
+	if (config.background_in_flight_limit == 0
+			|| config.background_in_flight_limit > config.in_flight_limit) {
+		config.background_in_flight_limit = config.in_flight_limit;
+	}
+}
+
+bool
+storage_scheduler_t::is_enabled() const {
+	return config.in_flight_limit != 0;
+}
+
+void
+storage_scheduler_t::schedule(class_tag flow_class, const std::string &flow_name, double weight
+		, callback_t callback) {
+	if (!is_enabled()) {
+		callback(nullptr);
+		return;
+	}
+
+	auto &state = (flow_class == class_tag::foreground ? foreground : background);
+
+	lock_guard_t lock_guard(mutex);
+
+	auto key = std::make_pair(flow_class, flow_name);
+	auto it = flows.find(key);
+
+	if (it == flows.end()) {
+		flow_t flow;
+		flow.flow_class = flow_class;
+		flow.name = flow_name;
+		flow.finish_tag = 0;
+
+		it = flows.emplace(std::move(key), std::move(flow)).first;
+	}
+
+	auto &flow = it->second;
+	auto start_tag = std::max(state.virtual_time, flow.finish_tag);
+
+	flow.finish_tag = start_tag + 1 / std::max(weight, 0.001);
+
+	// Waiting operations go first, the new one would overtake them otherwise
+	if (foreground.waiting == 0 && state.waiting == 0 && has_free_slot(flow_class)) {
+		state.virtual_time = start_tag;
+		state.in_flight += 1;
+		operation_is_started(flow, util::timer_t{});
+		update_stats();
+
+		lock_guard.unlock();
+
+		callback(slot_ptr_t(new slot_t(shared_from_this(), flow_class)));
+		return;
+	}
+
+	if (flow.queue.empty()) {
+		state.index.emplace(start_tag, &flow);
+	}
+
+	flow.queue.push_back(waiter_t{start_tag, std::move(callback), util::timer_t{}});
+	state.waiting += 1;
+	update_stats();
+}
+
+std::string
+storage_scheduler_t::class_name(class_tag flow_class) {
+	switch (flow_class) {
+	case class_tag::foreground:
+		return "foreground";
+	case class_tag::background:
+		return "background";
+	}
+
+	return "unknown";
+}
+
+bool
+storage_scheduler_t::has_free_slot(class_tag flow_class) const {
+	if (foreground.in_flight + background.in_flight >= config.in_flight_limit) {
+		return false;
+	}
+
+	if (flow_class == class_tag::background
+			&& background.in_flight >= config.background_in_flight_limit) {
+		return false;
+	}
+
+	return true;
+}
+
+void
+storage_scheduler_t::release(class_tag flow_class) {
+	std::vector<std::pair<callback_t, slot_ptr_t>> granted;
+
+	lock_guard_t lock_guard(mutex);
+
+	(flow_class == class_tag::foreground ? foreground : background).in_flight -= 1;
+
+	while (true) {
+		class_tag next_class;
+
+		if (!foreground.index.empty() && has_free_slot(class_tag::foreground)) {
+			next_class = class_tag::foreground;
+		} else if (foreground.index.empty() && !background.index.empty()
+				&& has_free_slot(class_tag::background)) {
+			next_class = class_tag::background;
+		} else {
+			break;
+		}
+
+		auto &state = (next_class == class_tag::foreground ? foreground : background);
+		auto &flow = *state.index.begin()->second;
+
+		state.index.erase(state.index.begin());
+
+		auto waiter = std::move(flow.queue.front());
+		flow.queue.pop_front();
+
+		if (!flow.queue.empty()) {
+			state.index.emplace(flow.queue.front().start_tag, &flow);
+		}
+
+		state.virtual_time = waiter.start_tag;
+		state.waiting -= 1;
+		state.in_flight += 1;
+		operation_is_started(flow, waiter.timer);
+
+		granted.emplace_back(std::move(waiter.callback)
+				, slot_ptr_t(new slot_t(shared_from_this(), next_class)));
+	}
+
+	update_stats();
+
+	lock_guard.unlock();
+
+	for (auto it = granted.begin(), end = granted.end(); it != end; ++it) {
+		it->first(std::move(it->second));
+	}
+}
+
+void
+storage_scheduler_t::operation_is_started(flow_t &flow, util::timer_t timer) {
+	auto name = class_name(flow.flow_class);
+
+	HANDY_COUNTER_INCREMENT(("mds.scheduler.%s.operations", name.c_str()));
+	HANDY_COUNTER_INCREMENT(("mds.scheduler.%s.wait_us", name.c_str()), timer.get_us());
+	HANDY_COUNTER_INCREMENT(("mds.scheduler.%s.%s.operations", name.c_str(), flow.name.c_str()));
+}
+
+void
+storage_scheduler_t::update_stats() {
+	HANDY_GAUGE_SET("mds.scheduler.foreground.in_flight", foreground.in_flight);
+	HANDY_GAUGE_SET("mds.scheduler.foreground.waiting", foreground.waiting);
+	HANDY_GAUGE_SET("mds.scheduler.background.in_flight", background.in_flight);
+	HANDY_GAUGE_SET("mds.scheduler.background.waiting", background.waiting);
+}
+
+storage_flow_t::storage_flow_t()
+	: flow_class(storage_scheduler_t::class_tag::foreground)
+	, weight(1)
+{
+}
+
+storage_flow_t::storage_flow_t(std::shared_ptr<storage_scheduler_t> scheduler_
+		, storage_scheduler_t::class_tag flow_class_, std::string name_, double weight_
+		, std::shared_ptr<storage_bulkheads_t> bulkheads_)
+	: scheduler(std::move(scheduler_))
+	, bulkheads(std::move(bulkheads_))
+	, flow_class(flow_class_)
+	, name(std::move(name_))
+	, weight(weight_)
+{
+}
+
+void
+storage_flow_t::schedule(storage_scheduler_t::callback_t callback) const {
+	if (!scheduler) {
+		callback(nullptr);
+		return;
+	}
+
+	scheduler->schedule(flow_class, name, weight, std::move(callback));
+}
+
+storage_bulkheads_t::permit_ptr_t
+storage_flow_t::acquire(groups_t groups) const {
+	if (!bulkheads) {
+		return std::make_shared<storage_bulkheads_t::permit_t>(std::move(groups));
+	}
+
+	return bulkheads->acquire(std::move(groups));
+}
+
+bool
+storage_flow_t::limits_groups() const {
+	return bulkheads && bulkheads->is_enabled();
+}
+
+} // namespace elliptics
+
@@ -0,0 +1,203 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef MDS_PROXY__SRC__STORAGE_SCHEDULER__HPP
+#define MDS_PROXY__SRC__STORAGE_SCHEDULER__HPP
+
+#include "timer.hpp"
+#include "storage_bulkheads.hpp"
+
+#include <map>
+#include <set>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <string>
+#include <utility>
+
+namespace elliptics {
+
+// Orders storage operations of the proxy before they are issued to elliptics.
+// At most in_flight_limit operations are issued at once, the rest wait in queues of flows.
+// Foreground flows (one per namespace) share the capacity by their weights with start-time
+// fair queueing: an operation gets the start tag max(virtual time, finish tag of the previous
+// operation of the flow) and the operation with the least start tag goes first.
+// Background flows (repair, migration) are served the same way only when no foreground
+// operation waits, and never take more than background_in_flight_limit slots.
+// The slot is released when the operation's callback drops it.
+class storage_scheduler_t
+	: public std::enable_shared_from_this<storage_scheduler_t>
+{
+public:
+	struct config_t {
+		// Operations are not scheduled if it is 0
+		size_t in_flight_limit;
+		size_t background_in_flight_limit;
+	};
+
+	enum class class_tag {
+		  foreground
+		, background
+	};
+
+	class slot_t {
+	public:
+		~slot_t();
+
+	private:
+		friend class storage_scheduler_t;
+
+		slot_t(std::shared_ptr<storage_scheduler_t> scheduler_, class_tag class_);
+
+		slot_t(const slot_t &) = delete;
+		slot_t &operator = (const slot_t &) = delete;
+
+		std::shared_ptr<storage_scheduler_t> scheduler;
+		class_tag slot_class;
+	};
+
+	typedef std::shared_ptr<slot_t> slot_ptr_t;
+	typedef std::function<void (slot_ptr_t)> callback_t;
+
+	storage_scheduler_t(config_t config_);
+
+	bool
+	is_enabled() const;
+
+	// The callback is called immediately if there is a free slot,
+	// otherwise it is called by the thread which releases the slot
+	void
+	schedule(class_tag flow_class, const std::string &flow_name, double weight
+			, callback_t callback);
+
+	static std::string
+	class_name(class_tag flow_class);
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+
+	struct waiter_t {
+		double start_tag;
+		callback_t callback;
+		util::timer_t timer;
+	};
+
+	struct flow_t {
+		class_tag flow_class;
+		std::string name;
+		double finish_tag;
+		std::deque<waiter_t> queue;
+	};
+
+	// Flows with waiting operations ordered by the start tag of their first operation
+	typedef std::set<std::pair<double, flow_t *>> index_t;
+
+	struct class_state_t {
+		double virtual_time;
+		size_t in_flight;
+		size_t waiting;
+		index_t index;
+	};
+
+	bool
+	has_free_slot(class_tag flow_class) const;
+
+	void
+	release(class_tag flow_class);
+
+	void
+	operation_is_started(flow_t &flow, util::timer_t timer);
+
+	void
+	update_stats();
+
+	config_t config;
+
+	mutex_t mutex;
+	std::map<std::pair<class_tag, std::string>, flow_t> flows;
+	class_state_t foreground;
+	class_state_t background;
+};
+
+// The queue of the scheduler which operations of a handler or a background job are put into.
+// Operations of the default constructed flow are issued immediately to any group.
+class storage_flow_t {
+public:
+	storage_flow_t();
+
+	storage_flow_t(std::shared_ptr<storage_scheduler_t> scheduler_
+			, storage_scheduler_t::class_tag flow_class_, std::string name_, double weight_
+			, std::shared_ptr<storage_bulkheads_t> bulkheads_ = nullptr);
+
+	// The slot is nullptr if the operation is not scheduled
+	void
+	schedule(storage_scheduler_t::callback_t callback) const;
+
+	// Must be called right before the operation is issued to groups,
+	// the operation is sent only to groups accepted by the permit
+	storage_bulkheads_t::permit_ptr_t
+	acquire(groups_t groups) const;
+
+	// Returns false if every group is always accepted
+	bool
+	limits_groups() const;
+
+private:
+	std::shared_ptr<storage_scheduler_t> scheduler;
+	std::shared_ptr<storage_bulkheads_t> bulkheads;
+	storage_scheduler_t::class_tag flow_class;
+	std::string name;
+	double weight;
+};
+
+// Holds the slot (of the scheduler or of bulkheads) until the handler of the operation
+// is called, the future may keep the handler long after the operation is finished
+template <typename Slot, typename Handler>
+class slot_holder_t {
+public:
+	slot_holder_t(Slot slot_, Handler handler_)
+		: slot(std::move(slot_))
+		, handler(std::move(handler_))
+	{}
+
+	template <typename... Args>
+	void
+	operator () (Args &&...args) {
+		handler(std::forward<Args>(args)...);
+		slot.reset();
+	}
+
+private:
+	Slot slot;
+	Handler handler;
+};
+
+template <typename Slot, typename Handler>
+slot_holder_t<Slot, Handler>
+hold_slot(Slot slot, Handler handler) {
+	return slot_holder_t<Slot, Handler>(std::move(slot), std::move(handler));
+}
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__STORAGE_SCHEDULER__HPP */
+
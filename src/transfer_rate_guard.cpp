@@ -0,0 +1,227 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "transfer_rate_guard.hpp"
+
+#include <handystats/measuring_points.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace elliptics {
+
+transfer_rate_guard_t::transfer_t::transfer_t(direction_tag direction_
+		, std::function<void ()> on_slow_)
+	: direction(direction_)
+	, on_slow(std::move(on_slow_))
+	, bytes(0)
+	, waits_for_client(false)
+	, age(0)
+	, is_cut(false)
+{
+}
+
+void
+transfer_rate_guard_t::transfer_t::bytes_are_transferred(size_t size) {
+	bytes += size;
+}
+
+void
+transfer_rate_guard_t::transfer_t::wait_for_client(bool value) {
+	waits_for_client = value;
+}
+
+transfer_rate_guard_t::transfer_rate_guard_t(ioremap::swarm::logger bh_logger_
+		, config_t download_config_, config_t upload_config_)
+	: bh_logger(std::move(bh_logger_))
+	, download_config(std::move(download_config_))
+	, upload_config(std::move(upload_config_))
+	, work_is_done(false)
+{
+	download_config.window = std::max(download_config.window, 1);
+	upload_config.window = std::max(upload_config.window, 1);
+
+	if (download_config.min_rate == 0 && upload_config.min_rate == 0) {
+		return;
+	}
+
+	MDS_LOG_INFO("starting background thread");
+	background_checker = std::thread(std::bind(&transfer_rate_guard_t::background_loop, this));
+}
+
+transfer_rate_guard_t::~transfer_rate_guard_t() {
+	if (!background_checker.joinable()) {
+		return;
+	}
+
+	MDS_LOG_INFO("stopping transfer rate guard");
+
+	{
+		lock_guard_t lock_guard(mutex);
+		work_is_done = true;
+		background_checker_cv.notify_one();
+	}
+
+	background_checker.join();
+	MDS_LOG_INFO("transfer rate guard is stopped");
+}
+
+transfer_rate_guard_t::transfer_ptr_t
+transfer_rate_guard_t::watch(direction_tag direction, std::function<void ()> on_slow) {
+	if (get_config(direction).min_rate == 0) {
+		return nullptr;
+	}
+
+	auto transfer = std::make_shared<transfer_t>(direction, std::move(on_slow));
+
+	lock_guard_t lock_guard(mutex);
+	transfers.emplace_back(transfer);
+
+	return transfer;
+}
+
+transfer_rate_guard_t::transfer_ptr_t
+transfer_rate_guard_t::watch(direction_tag direction, std::weak_ptr<void> owner
+		, std::function<void (const boost::system::error_code &)> close) {
+	return watch(direction, [owner, close] {
+		if (auto alive_owner = owner.lock()) {
+			close(boost::system::errc::make_error_code(boost::system::errc::timed_out));
+		}
+	});
+}
+
+ioremap::swarm::logger &
+transfer_rate_guard_t::logger() {
+	return bh_logger;
+}
+
+const transfer_rate_guard_t::config_t &
+transfer_rate_guard_t::get_config(direction_tag direction) const {
+	switch (direction) {
+	case direction_tag::download:
+		return download_config;
+	case direction_tag::upload:
+		return upload_config;
+	}
+
+	throw std::logic_error("unknown direction");
+}
+
+const char *
+transfer_rate_guard_t::direction_name(direction_tag direction) {
+	switch (direction) {
+	case direction_tag::download:
+		return "download";
+	case direction_tag::upload:
+		return "upload";
+	}
+
+	return "unknown";
+}
+
+bool
+transfer_rate_guard_t::check(transfer_t &transfer) {
+	const auto &config = get_config(transfer.direction);
+
+	transfer.age += 1;
+
+	if (transfer.is_cut || transfer.age <= config.grace_period) {
+		return false;
+	}
+
+	// Seconds in which the proxy waits for storage are skipped, hence the rate is
+	// overestimated rather than underestimated for transfers which wait for both
+	if (!transfer.waits_for_client) {
+		return false;
+	}
+
+	auto &samples = transfer.samples;
+	samples.push_back(transfer.bytes);
+
+	if (samples.size() > static_cast<size_t>(config.window) + 1) {
+		samples.pop_front();
+	}
+
+	if (samples.size() <= static_cast<size_t>(config.window)) {
+		return false;
+	}
+
+	auto rate = (samples.back() - samples.front()) / config.window;
+
+	if (rate >= config.min_rate) {
+		return false;
+	}
+
+	MDS_LOG_INFO("transfer is too slow: direction=%s; rate=%llu B/s; min-rate=%llu B/s"
+			, direction_name(transfer.direction)
+			, static_cast<unsigned long long>(rate)
+			, static_cast<unsigned long long>(config.min_rate));
+
+	transfer.is_cut = true;
+	return true;
+}
+
+void
+transfer_rate_guard_t::background_loop() {
+	lock_guard_t lock_guard(mutex);
+
+	while (!work_is_done) {
+		background_checker_cv.wait_for(lock_guard, std::chrono::seconds(1));
+
+		if (work_is_done) {
+			break;
+		}
+
+		std::vector<transfer_ptr_t> alive_transfers;
+		alive_transfers.reserve(transfers.size());
+
+		for (auto it = transfers.begin(), end = transfers.end(); it != end; ++it) {
+			if (auto transfer = it->lock()) {
+				alive_transfers.emplace_back(std::move(transfer));
+			}
+		}
+
+		transfers.assign(alive_transfers.begin(), alive_transfers.end());
+		HANDY_GAUGE_SET("mds.transfer_rate_guard.transfers", transfers.size());
+
+		lock_guard.unlock();
+
+		for (auto it = alive_transfers.begin(), end = alive_transfers.end(); it != end; ++it) {
+			auto &transfer = **it;
+
+			if (!check(transfer)) {
+				continue;
+			}
+
+			HANDY_COUNTER_INCREMENT(("mds.transfer_rate_guard.%s.cut"
+						, direction_name(transfer.direction)));
+			transfer.on_slow();
+		}
+
+		// The last owners of transfers must not be released under the lock
+		alive_transfers.clear();
+
+		lock_guard.lock();
+	}
+}
+
+} // namespace elliptics
+
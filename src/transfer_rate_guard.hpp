@@ -0,0 +1,141 @@
+/*
+	Mediastorage-proxy is a HTTP proxy for mediastorage based on elliptics
+	Copyright (C) 2013-2015 Yandex
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation; either version 2
+	of the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#ifndef MDS_PROXY__SRC__TRANSFER_RATE_GUARD__HPP
+#define MDS_PROXY__SRC__TRANSFER_RATE_GUARD__HPP
+
+#include "loggers.hpp"
+
+#include <boost/system/error_code.hpp>
+
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+
+namespace elliptics {
+
+// Cuts clients which transfer data slower than the configured floor.
+// A slow client holds read buffers of GET or a prepared record of upload as long as it likes,
+// so the guard samples bytes of every watched transfer once a second and cuts the transfer
+// if its rate over the last window seconds is less than min_rate.
+// Only seconds in which the proxy waits for the client are sampled: time spent
+// on storage requests is not the client's fault. The first grace_period seconds of
+// the transfer are never sampled to let the client speed up.
+class transfer_rate_guard_t {
+public:
+	struct config_t {
+		// Bytes per second, transfers are not watched if it is 0
+		size_t min_rate;
+		// seconds
+		int window;
+		int grace_period;
+	};
+
+	enum class direction_tag {
+		  download
+		, upload
+	};
+
+	class transfer_t {
+	public:
+		transfer_t(direction_tag direction_, std::function<void ()> on_slow_);
+
+		void
+		bytes_are_transferred(size_t size);
+
+		void
+		wait_for_client(bool value);
+
+	private:
+		friend class transfer_rate_guard_t;
+
+		const direction_tag direction;
+		const std::function<void ()> on_slow;
+
+		std::atomic<size_t> bytes;
+		std::atomic<bool> waits_for_client;
+
+		// Fields below are used only by the background thread
+		int age;
+		std::deque<size_t> samples;
+		bool is_cut;
+	};
+
+	typedef std::shared_ptr<transfer_t> transfer_ptr_t;
+
+	transfer_rate_guard_t(ioremap::swarm::logger bh_logger_
+			, config_t download_config_, config_t upload_config_);
+	~transfer_rate_guard_t();
+
+	// The transfer is watched while the returned pointer is alive.
+	// on_slow is called from the background thread at most once, it must not own the transfer.
+	// Returns nullptr if the direction is not watched.
+	transfer_ptr_t
+	watch(direction_tag direction, std::function<void ()> on_slow);
+
+	// Watches the transfer of a request handler, close is called with timed_out to cut
+	// the connection of a too slow client. The owner is held weakly, the guard must not prolong
+	// the handler's life, and close is called only while the owner is alive
+	transfer_ptr_t
+	watch(direction_tag direction, std::weak_ptr<void> owner
+			, std::function<void (const boost::system::error_code &)> close);
+
+private:
+	typedef std::mutex mutex_t;
+	typedef std::unique_lock<mutex_t> lock_guard_t;
+
+	ioremap::swarm::logger &
+	logger();
+
+	const config_t &
+	get_config(direction_tag direction) const;
+
+	static const char *
+	direction_name(direction_tag direction);
+
+	// Returns true if the transfer is too slow
+	bool
+	check(transfer_t &transfer);
+
+	void
+	background_loop();
+
+	ioremap::swarm::logger bh_logger;
+
+	config_t download_config;
+	config_t upload_config;
+
+	mutex_t mutex;
+	std::vector<std::weak_ptr<transfer_t>> transfers;
+
+	std::thread background_checker;
+	std::condition_variable background_checker_cv;
+	bool work_is_done;
+};
+
+} // namespace elliptics
+
+#endif /* MDS_PROXY__SRC__TRANSFER_RATE_GUARD__HPP */
+
@@ -88,10 +88,13 @@ upload_multipart_t::upload_multipart_t(mastermind::namespace_state_t ns_state_,
 	: interrupt_writers_once([this] { interrupt_writers(); })
 	, join_upload_tasks([this] { on_writers_are_finished(); })
 	, join_remove_tasks([this] { send_error(); })
+	, join_cancel_tasks([this] { on_pending_deletes_are_cancelled(); })
 	, error_type(error_type_tag::none)
 	, ns_state(std::move(ns_state_))
 	, couple(std::move(couple_))
 	, couple_id(*std::min_element(couple.begin(), couple.end()))
+	, appended_size(0)
+	, part_size(0)
 {
 }
 
@@ -115,6 +118,16 @@ upload_multipart_t::on_headers(ioremap::thevoid::http_request &&http_request_) {
 		return;
 	}
 
+	// The connection error is handled by on_close which interrupts writers
+	transfer = server()->transfer_rate_guard->watch(
+			transfer_rate_guard_t::direction_tag::upload, shared_from_this()
+			, [this] (const boost::system::error_code &error_code) {
+				reply()->close(error_code);
+			});
+
+	if (transfer) {
+		transfer->wait_for_client(true);
+	}
 }
 
 size_t
@@ -122,8 +135,31 @@ upload_multipart_t::on_data(const boost::asio::const_buffer &buffer) {
 	const char *buffer_data = boost::asio::buffer_cast<const char *>(buffer);
 	const size_t buffer_size = boost::asio::buffer_size(buffer);
 
+	if (!memory_reservation) {
+		memory_reservation = server()->memory_accountant->try_reserve(
+				memory_accountant_t::subsystem_tag::multipart, buffer_size);
+	} else if (!memory_reservation->try_grow(buffer_size)) {
+		memory_reservation.reset();
+	}
+
+	// If multipart_context.state is equal to end, the join was already called
+	if (!memory_reservation && multipart_state_tag::end != multipart_context.state) {
+		MDS_LOG_ERROR("cannot buffer request: memory budget is exhausted");
+		interrupt_writers(error_type_tag::out_of_memory);
+		buffered_writer.reset();
+		join_upload_tasks();
+		return 0;
+	}
+
+	auto buffered_size = multipart_context.size() + buffer_size;
+	appended_size = 0;
+
 	multipart_context.append(buffer_data, buffer_size);
 
+	if (transfer) {
+		transfer->bytes_are_transferred(buffer_size);
+	}
+
 	do {
 		switch (multipart_context.state) {
 		case multipart_state_tag::init:
@@ -160,6 +196,15 @@ upload_multipart_t::on_data(const boost::asio::const_buffer &buffer) {
 
 	multipart_context.trim();
 
+	// Boundaries and headers are freed, bodies stay accounted until their parts are written
+	if (memory_reservation) {
+		memory_reservation->shrink(buffered_size - multipart_context.size() - appended_size);
+	}
+
+	if (transfer) {
+		transfer->wait_for_client(multipart_state_tag::end != multipart_context.state);
+	}
+
 	return buffer_size;
 }
 
@@ -258,6 +303,7 @@ upload_multipart_t::sm_headers() {
 	buffered_writer = std::make_shared<buffered_writer_t>(
 			ioremap::swarm::logger(logger(), blackhole::log::attributes_t())
 			, ns_state.name() + '.' + name, server()->m_write_chunk_size);
+	part_size = 0;
 
 	multipart_context.state = multipart_state_tag::body;
 }
@@ -288,6 +334,9 @@ upload_multipart_t::sm_body() {
 	buffered_writer->append(&*multipart_context.begin(), size);
 	multipart_context.skip(size);
 
+	appended_size += size;
+	part_size += size;
+
 	if (boundary_found) {
 		multipart_context.skip(RN_BOUNDARY_STRING.size());
 		multipart_context.state = multipart_state_tag::after_body;
@@ -350,21 +399,48 @@ upload_multipart_t::start_writing() {
 		buffered_writers.insert(std::make_pair(current_filename, buffered_writer));
 	}
 
-	auto self = shared_from_this();
-	auto next = [this, self] (const std::error_code &error_code) {
-		on_writer_is_finished(error_code);
-	};
+	auto key = ns_state.name() + '.' + current_filename;
+
+	server()->hot_keys->written(couple, key);
 
 	// The method runs in thevoid's io-loop, therefore proxy's dtor cannot run in this moment
 	// Hence write_session can be safely used without any check
-	buffered_writer->write(*server()->write_session(http_request, couple)
-			, server()->timeout_coef.data_flow_rate
-			, ns_settings(ns_state).success_copies_num
-			, server()->limit_of_middle_chunk_attempts
-			, server()->scale_retry_timeout
-			, std::move(next));
+	auto session = *server()->write_session(http_request, couple);
+
+	auto self = shared_from_this();
+	auto filename = current_filename;
+	auto writer = std::move(buffered_writer);
+	// The reservation is copied as on_data may reset it while the part is written
+	auto reservation = memory_reservation;
+	auto written_size = part_size;
+
+	// The pending delete of the key must not be applied over the upload
+	auto next = [this, self, filename, writer, session, reservation, written_size] (
+			delete_journal_t::hold_ptr_t hold) {
+		{
+			std::lock_guard<std::mutex> lock(buffered_writers_mutex);
+			(void) lock;
+
+			delete_holds[filename] = std::move(hold);
+		}
+
+		auto next = [this, self, reservation, written_size] (const std::error_code &error_code) {
+			// The writer frees its buffers whatever the result is
+			reservation->shrink(written_size);
+			on_writer_is_finished(error_code);
+		};
+
+		// The writer is interrupted if an error occurred while the delete was held
+		writer->write(session
+				, server()->timeout_coef.data_flow_rate
+				, ns_settings(ns_state).success_copies_num
+				, server()->limit_of_middle_chunk_attempts
+				, server()->scale_retry_timeout
+				, server()->storage_flow(ns_state)
+				, std::move(next));
+	};
 
-	buffered_writer.reset();
+	server()->key_is_uploading(couple, key, std::move(next));
 }
 
 void
@@ -396,8 +472,9 @@ upload_multipart_t::set_error(error_type_tag e) {
 	// Errors have priorities:
 	// 1. Client error means there is no reason to send response
 	// 2. Insufficient Storage error means we should send 507
-	// 3. Internal error means we should send 500
-	// 4. Multipart error means we should send 400
+	// 3. Out of memory error means we should send 503
+	// 4. Internal error means we should send 500
+	// 5. Multipart error means we should send 400
 	switch (error_type) {
 	case error_type_tag::none:
 		error_type = e;
@@ -407,11 +484,17 @@ upload_multipart_t::set_error(error_type_tag e) {
 			error_type = e;
 		}
 		break;
-	case error_type_tag::internal:
+	case error_type_tag::out_of_memory:
 		if (error_type_tag::client == e || error_type_tag::insufficient_storage == e) {
 			error_type = e;
 		}
 		break;
+	case error_type_tag::internal:
+		if (error_type_tag::client == e || error_type_tag::insufficient_storage == e
+				|| error_type_tag::out_of_memory == e) {
+			error_type = e;
+		}
+		break;
 	case error_type_tag::multipart:
 		error_type = e;
 		break;
@@ -460,10 +543,46 @@ upload_multipart_t::on_writers_are_finished() {
 	buffered_writers.clear();
 
 	if (is_error()) {
+		delete_holds.clear();
 		remove_files();
 		return;
 	}
 
+	cancel_pending_deletes();
+}
+
+void
+upload_multipart_t::cancel_pending_deletes() {
+	auto self = shared_from_this();
+	auto next = [this, self] (bool is_cancelled) {
+		if (!is_cancelled) {
+			MDS_LOG_ERROR("cannot cancel pending delete of the key");
+			set_error(error_type_tag::internal);
+		}
+
+		join_cancel_tasks();
+	};
+
+	std::map<std::string, delete_journal_t::hold_ptr_t> holds;
+	holds.swap(delete_holds);
+
+	join_cancel_tasks.defer(results.size());
+
+	for (auto it = results.begin(), end = results.end(); it != end; ++it) {
+		server()->key_is_uploaded(couple, ns_state.name() + '.' + it->first
+				, std::move(holds[it->first]), next);
+	}
+
+	join_cancel_tasks();
+}
+
+void
+upload_multipart_t::on_pending_deletes_are_cancelled() {
+	if (is_error()) {
+		send_error();
+		return;
+	}
+
 	send_result();
 }
 
@@ -564,12 +683,13 @@ upload_multipart_t::remove_files() {
 		MDS_LOG_INFO("removing uploaded files");
 
 		auto shared_logger = make_shared_logger(logger());
+		auto flow = server()->storage_flow(ns_state);
 		auto next = std::bind(&upload_multipart_t::on_removed, shared_from_this()
 				, std::placeholders::_1);
 
 		for (auto it = results.begin(), end = results.end(); it != end; ++it) {
 			join_remove_tasks.defer();
-			elliptics::remove(shared_logger, *session, it->second.key, next);
+			elliptics::remove(shared_logger, *session, it->second.key, flow, next);
 		}
 
 		join_remove_tasks();
@@ -598,6 +718,9 @@ upload_multipart_t::send_error() {
 	case error_type_tag::insufficient_storage:
 		reply()->send_error(ioremap::swarm::http_response::insufficient_storage);
 		break;
+	case error_type_tag::out_of_memory:
+		reply()->send_error(ioremap::swarm::http_response::service_unavailable);
+		break;
 	case error_type_tag::internal:
 		reply()->send_error(ioremap::swarm::http_response::internal_server_error);
 		break;
@@ -109,6 +109,7 @@ private:
 	enum class error_type_tag {
 		  none
 		, insufficient_storage
+		, out_of_memory
 		, internal
 		, multipart
 		, client
@@ -143,6 +144,12 @@ private:
 	void
 	on_writers_are_finished();
 
+	void
+	cancel_pending_deletes();
+
+	void
+	on_pending_deletes_are_cancelled();
+
 	void
 	send_result();
 
@@ -164,6 +171,7 @@ private:
 	deferred_function_t interrupt_writers_once;
 	deferred_function_t join_upload_tasks;
 	deferred_function_t join_remove_tasks;
+	deferred_function_t join_cancel_tasks;
 
 	error_type_tag error_type;
 	std::mutex error_type_mutex;
@@ -181,6 +189,18 @@ private:
 	std::mutex buffered_writers_mutex;
 	std::map<std::string, std::shared_ptr<buffered_writer_t>> buffered_writers;
 	std::map<std::string, writer_t::result_t> results;
+	std::map<std::string, delete_journal_t::hold_ptr_t> delete_holds;
+
+	// Accounts the unparsed data and parts which are buffered or being written.
+	// The reservation is shrunk when the context is trimmed and when a part is written
+	memory_accountant_t::reservation_ptr_t memory_reservation;
+	// Bytes of parts appended to writers by the current on_data call
+	size_t appended_size;
+	// Bytes of the current part
+	size_t part_size;
+
+	// The client is waited for until the whole body is parsed
+	transfer_rate_guard_t::transfer_ptr_t transfer;
 };
 
 } // namespace elliptics
@@ -45,11 +45,18 @@ upload_simple_t::on_request(const ioremap::thevoid::http_request &http_request)
 
 	offset = get_arg<uint64_t>(http_request.url().query(), "offset", 0);
 
+	// The connection error is handled by on_error which removes the written part
+	transfer = server()->transfer_rate_guard->watch(
+			transfer_rate_guard_t::direction_tag::upload, shared_from_this()
+			, [this] (const boost::system::error_code &error_code) {
+				reply()->close(error_code);
+			});
+
 	auto self = shared_from_this();
 	auto next = [this, self] (util::expected<mastermind::couple_info_t> result) {
 		try {
 			process_couple_info(std::move(result.get()));
-			try_next_chunk();
+			read_next_chunk();
 		} catch (const std::exception &ex) {
 			MDS_LOG_INFO("cannot obtain couple: %s", ex.what());
 			send_error(internal_error_errc::general_error);
@@ -66,6 +73,11 @@ upload_simple_t::on_chunk(const boost::asio::const_buffer &buffer, unsigned int
 	const char *buffer_data = boost::asio::buffer_cast<const char *>(buffer);
 	const size_t buffer_size = boost::asio::buffer_size(buffer);
 
+	if (transfer) {
+		transfer->wait_for_client(false);
+		transfer->bytes_are_transferred(buffer_size);
+	}
+
 	ioremap::elliptics::data_pointer chunk;
 
 	chunk = ioremap::elliptics::data_pointer::copy(buffer_data, buffer_size);
@@ -103,14 +115,48 @@ upload_simple_t::on_write_is_done(const std::error_code &error_code) {
 	}
 
 	if (!writer->is_committed()) {
-		try_next_chunk();
+		read_next_chunk();
 		return;
 	}
 
-	send_result();
+	auto self = shared_from_this();
+	auto next = [this, self] (bool is_cancelled) {
+		if (!is_cancelled) {
+			MDS_LOG_ERROR("cannot cancel pending delete of the key");
+			send_error(internal_error_errc::general_error);
+		} else {
+			send_result();
+		}
 
-	// Release writer to break cyclic links
-	writer.reset();
+		// Release writer to break cyclic links
+		writer.reset();
+	};
+
+	server()->key_is_uploaded(couple_info.groups, key, std::move(delete_hold), std::move(next));
+}
+
+void
+upload_simple_t::read_next_chunk() {
+	// The previous chunk is written, its memory can be reused
+	chunk_reservation.reset();
+
+	auto self = shared_from_this();
+	auto next = [this, self] (memory_accountant_t::reservation_ptr_t reservation) {
+		chunk_reservation = std::move(reservation);
+
+		if (transfer) {
+			transfer->wait_for_client(true);
+		}
+
+		try_next_chunk();
+	};
+
+	// The socket is not read until the chunk fits the memory budget
+	auto size = std::min(static_cast<size_t>(server()->m_write_chunk_size)
+			, static_cast<size_t>(*request().headers().content_length()));
+
+	server()->memory_accountant->reserve(memory_accountant_t::subsystem_tag::upload
+			, size, std::move(next));
 }
 
 void
@@ -200,7 +246,8 @@ upload_simple_t::fallback() {
 void
 upload_simple_t::remove(const util::expected<remove_result_t>::callback_t next) {
 	if (auto session = server()->remove_session(request(), couple_info.groups)) {
-		elliptics::remove(make_shared_logger(logger()), *session, key, std::move(next));
+		elliptics::remove(make_shared_logger(logger()), *session, key
+				, server()->storage_flow(ns_state), std::move(next));
 		return;
 	}
 
@@ -234,7 +281,14 @@ elliptics::upload_simple_t::get_next_couple_info(
 		try {
 			if (result.get()) {
 				MDS_LOG_INFO("key can be written");
-				next(couple_info);
+
+				// The pending delete of the key must not be applied over the upload
+				auto next_ = [this, self, couple_info, next] (delete_journal_t::hold_ptr_t hold) {
+					delete_hold = std::move(hold);
+					next(couple_info);
+				};
+
+				server()->key_is_uploading(couple_info.groups, key, std::move(next_));
 				return;
 			}
 
@@ -274,6 +328,7 @@ elliptics::upload_simple_t::get_next_couple_info(
 	can_be_written(
 			make_shared_logger(logger())
 			, std::move(session), key, ns_state
+			, server()->storage_flow(ns_state)
 			, std::move(next_));
 }
 
@@ -289,6 +344,7 @@ elliptics::upload_simple_t::make_writer(const groups_t &groups) {
 			, server()->timeout_coef.data_flow_rate , ns_settings(ns_state).success_copies_num
 			, server()->limit_of_middle_chunk_attempts
 			, server()->scale_retry_timeout
+			, server()->storage_flow(ns_state)
 			);
 }
 
@@ -299,6 +355,8 @@ elliptics::upload_simple_t::process_couple_info(mastermind::couple_info_t couple
 	lookup_session->set_groups(couple_info.groups);
 	write_session->set_groups(couple_info.groups);
 
+	server()->hot_keys->written(couple_info.groups, key);
+
 	writer = make_writer(couple_info.groups);
 }
 
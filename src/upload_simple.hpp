@@ -56,6 +56,9 @@ struct upload_simple_t
 	void
 	on_write_is_done(const std::error_code &error_code);
 
+	void
+	read_next_chunk();
+
 	void
 	send_result();
 
@@ -109,6 +112,9 @@ private:
 
 	std::shared_ptr<writer_t> writer;
 	ioremap::elliptics::data_pointer data_pointer;
+	memory_accountant_t::reservation_ptr_t chunk_reservation;
+	transfer_rate_guard_t::transfer_ptr_t transfer;
+	delete_journal_t::hold_ptr_t delete_hold;
 
 	deferred_function_t deferred_fallback;
 
@@ -20,12 +20,17 @@
 #include "utils.hpp"
 #include "ns_settings.hpp"
 #include "lookup_result.hpp"
+#include "dns_cache.hpp"
 #include "hex.hpp"
 
 #include <crypto++/hmac.h>
 #include <crypto++/sha.h>
 
+#include <zlib.h>
+
+#include <algorithm>
 #include <cctype>
+#include <cstdlib>
 #include <iterator>
 
 std::ostream &
@@ -97,7 +102,7 @@ elliptics::url_encode(const std::string &string) {
 
 elliptics::file_location_t
 elliptics::make_file_location(const ioremap::elliptics::sync_lookup_result &slr
-		, const mastermind::namespace_state_t &ns_state) {
+		, const mastermind::namespace_state_t &ns_state, dns_cache_t &dns_cache) {
 	const auto &path_prefix = ns_settings(ns_state).sign_path_prefix;
 
 	for (auto it = slr.begin(); it != slr.end(); ++it) {
@@ -114,7 +119,7 @@ elliptics::make_file_location(const ioremap::elliptics::sync_lookup_result &slr
 
 		file_location_t file_location;
 
-		file_location.host = entry.host();
+		file_location.host = entry.host(dns_cache);
 		file_location.path = '/' + ns_state.name() + '/' + entry.path().substr(path_prefix.size());
 
 		return file_location;
@@ -164,3 +169,115 @@ elliptics::make_signature(const std::string &message, const std::string &token)
 	return hex<std::string>(res);
 }
 
+bool
+elliptics::encoding_is_accepted(const std::string &accept_encoding, const std::string &encoding) {
+	bool wildcard_is_accepted = false;
+
+	std::string::size_type pos = 0;
+
+	while (pos < accept_encoding.size()) {
+		auto end = accept_encoding.find(',', pos);
+
+		if (end == std::string::npos) {
+			end = accept_encoding.size();
+		}
+
+		auto item = accept_encoding.substr(pos, end - pos);
+		pos = end + 1;
+
+		double quality = 1;
+		auto params_pos = item.find(';');
+
+		if (params_pos != std::string::npos) {
+			auto q_pos = item.find("q=", params_pos);
+
+			if (q_pos != std::string::npos) {
+				quality = std::strtod(item.c_str() + q_pos + 2, nullptr);
+			}
+
+			item.resize(params_pos);
+		}
+
+		auto first = item.find_first_not_of(" \t");
+
+		if (first == std::string::npos) {
+			continue;
+		}
+
+		auto last = item.find_last_not_of(" \t");
+		auto coding = item.substr(first, last - first + 1);
+
+		std::transform(coding.begin(), coding.end(), coding.begin()
+				, [] (char c) { return std::tolower(c); });
+
+		if (coding == encoding) {
+			return quality > 0;
+		}
+
+		if (coding == "*") {
+			wildcard_is_accepted = quality > 0;
+		}
+	}
+
+	return wildcard_is_accepted;
+}
+
+ioremap::elliptics::data_pointer
+elliptics::gzip_compress(const ioremap::elliptics::data_pointer &data, int level) {
+	z_stream stream;
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+
+	// 16 + MAX_WBITS makes zlib write gzip header and trailer instead of zlib ones
+	if (deflateInit2(&stream, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		throw std::runtime_error("cannot initialize gzip stream");
+	}
+
+	auto bound = deflateBound(&stream, data.size());
+	auto result = ioremap::elliptics::data_pointer::allocate(bound);
+
+	stream.next_in = reinterpret_cast<Bytef *>(data.data());
+	stream.avail_in = data.size();
+	stream.next_out = reinterpret_cast<Bytef *>(result.data());
+	stream.avail_out = bound;
+
+	auto status = deflate(&stream, Z_FINISH);
+	auto total_out = stream.total_out;
+
+	deflateEnd(&stream);
+
+	if (status != Z_STREAM_END) {
+		throw std::runtime_error("cannot compress data: status=" + std::to_string(status));
+	}
+
+	return result.slice(0, total_out);
+}
+
+struct elliptics::signer_t::impl_t {
+	impl_t(const std::string &token)
+		: hmac((const unsigned char *)token.data(), token.size())
+	{}
+
+	CryptoPP::HMAC<CryptoPP::SHA256> hmac;
+};
+
+elliptics::signer_t::signer_t(const std::string &token)
+	: impl(new impl_t(token))
+{}
+
+elliptics::signer_t::~signer_t() {
+}
+
+std::string
+elliptics::signer_t::sign(const std::string &message) {
+	using namespace CryptoPP;
+
+	// HMAC restarts with the same key after Final
+	impl->hmac.Update((const byte *)message.data(), message.size());
+	std::vector<byte> res(impl->hmac.DigestSize());
+	impl->hmac.Final(res.data());
+
+	return hex<std::string>(res);
+}
+
@@ -28,6 +28,7 @@
 #include <libmastermind/mastermind.hpp>
 
 #include <list>
+#include <memory>
 #include <vector>
 #include <mutex>
 #include <algorithm>
@@ -46,6 +47,8 @@ typedef std::vector<group_t> groups_t;
 
 typedef std::vector<int> couple_t;
 
+class dns_cache_t;
+
 template <typename T>
 std::ostream &
 operator << (std::ostream &stream, const std::vector<T> &vector) {
@@ -98,7 +101,7 @@ struct file_location_t {
 
 file_location_t
 make_file_location(const ioremap::elliptics::sync_lookup_result &slr
-		, const mastermind::namespace_state_t &ns_state);
+		, const mastermind::namespace_state_t &ns_state, dns_cache_t &dns_cache);
 
 std::string
 make_signature_ts(boost::optional<std::chrono::seconds> optional_expiration_time
@@ -112,6 +115,30 @@ make_signature_message(const file_location_t &file_location, const std::string &
 std::string
 make_signature(const std::string &message, const std::string &token);
 
+// Returns true if Accept-Encoding allows the encoding (explicitly or via '*')
+bool
+encoding_is_accepted(const std::string &accept_encoding, const std::string &encoding);
+
+// Throws std::runtime_error if the data cannot be compressed
+ioremap::elliptics::data_pointer
+gzip_compress(const ioremap::elliptics::data_pointer &data, int level);
+
+// Keeps keyed HMAC state to sign many messages with the same token.
+// The object is not thread-safe.
+class signer_t {
+public:
+	signer_t(const std::string &token);
+	~signer_t();
+
+	std::string
+	sign(const std::string &message);
+
+private:
+	struct impl_t;
+
+	std::unique_ptr<impl_t> impl;
+};
+
 } // namespace elliptics
 
 #endif /* MDS_PROXY__SRC__UTILS__HPP */
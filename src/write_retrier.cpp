@@ -53,55 +53,91 @@ elliptics::write_retrier::start() {
 		group_session.set_groups({*it});
 
 		complete_once.defer();
-		try_group(std::move(group_session), 0);
+		write_group(std::make_shared<group_state_t>(std::move(group_session))
+				, ioremap::elliptics::sync_write_result(), ioremap::elliptics::error_info());
 	}
 
 	complete_once();
 }
 
+elliptics::write_retrier::group_state_t::group_state_t(ioremap::elliptics::session session_)
+	: session(std::move(session_))
+	, number_of_attempts(0)
+{
+}
+
 ioremap::swarm::logger &
 elliptics::write_retrier::logger() {
 	return bh_logger;
 }
 
-void
-elliptics::write_retrier::try_group(ioremap::elliptics::session group_session
-		, size_t number_of_attempts) {
-	auto self = shared_from_this();
-
-	auto callback = [this, self, group_session, number_of_attempts] (
-			const ioremap::elliptics::sync_write_result &entries
-			, const ioremap::elliptics::error_info &error_info) {
-		on_finished(std::move(group_session), number_of_attempts, entries, error_info);
-	};
-
-	std::ostringstream oss;
-	oss << "write session: group=" << group_session.get_groups()[0]
-		<< "; attempt=" << number_of_attempts + 1 << ";";
-	auto msg = oss.str();
-	MDS_LOG_INFO("%s", msg.c_str());
-
-	command(group_session).connect(callback);
-}
+#include <boost/asio/yield.hpp>
 
 void
-elliptics::write_retrier::on_finished(ioremap::elliptics::session group_session, size_t number_of_attempts
+elliptics::write_retrier::write_group(group_state_ptr_t group_state
 		, const ioremap::elliptics::sync_write_result &entries
 		, const ioremap::elliptics::error_info &error_info) {
-	std::ostringstream oss;
-	oss << "write session is finished: group=" << group_session.get_groups()[0]
-		<< "; attempt=" << number_of_attempts + 1 << "; status=";
+	auto &group_session = group_state->session;
+	auto &number_of_attempts = group_state->number_of_attempts;
+
+	reenter (*group_state) {
+		while (true) {
+			{
+				std::ostringstream oss;
+				oss << "write session: group=" << group_session.get_groups()[0]
+					<< "; attempt=" << number_of_attempts + 1 << ";";
+				auto msg = oss.str();
+				MDS_LOG_INFO("%s", msg.c_str());
+			}
+
+			yield command(group_session).connect(std::bind(&write_retrier::write_group
+						, shared_from_this(), group_state
+						, std::placeholders::_1, std::placeholders::_2));
+
+			number_of_attempts += 1;
+
+			{
+				std::ostringstream oss;
+				oss << "write session is finished: group=" << group_session.get_groups()[0]
+					<< "; attempt=" << number_of_attempts << "; status=";
+
+				if (!error_info) {
+					oss << "\"ok\"; description=\"success\"";
+				} else {
+					oss << "\"bad\"; description=\"" << error_info.message() << "\"";
+				}
+
+				bool process_entries = !is_temporary_error(group_session, error_info)
+					|| number_of_attempts == limit_of_attempts;
+
+				oss << (process_entries ? "; decision=\"process result\""
+						: "; decision=\"try again\"");
+				auto msg = oss.str();
+				MDS_LOG_INFO("%s", msg.c_str());
+
+				if (process_entries) {
+					break;
+				}
+			}
+		}
 
-	if (!error_info) {
-		oss << "\"ok\"; description=\"success\"";
-	} else {
-		oss << "\"bad\"; description=\"" << error_info.message() << "\"";
-	}
+		for (auto it = entries.begin(), end = entries.end(); it != end; ++it) {
+			promise.process(*it);
+		}
 
-	number_of_attempts += 1;
+		if (error_info) {
+			init_error(error_info);
+		}
 
-	bool process_entries = true;
+		complete_once();
+	}
+}
 
+#include <boost/asio/unyield.hpp>
+
+bool
+elliptics::write_retrier::is_temporary_error(ioremap::elliptics::session &group_session
+		, const ioremap::elliptics::error_info &error_info) {
 	switch (error_info.code()) {
 	case -ETIMEDOUT:
 		group_session.set_timeout(scale_retry_timeout * group_session.get_timeout());
@@ -111,35 +147,10 @@ elliptics::write_retrier::on_finished(ioremap::elliptics::session group_session,
 	case -EBUSY:
 	case -EINVAL:
 	case -EMFILE:
-		process_entries = false;
-		break;
-	}
-
-	if (number_of_attempts == limit_of_attempts) {
-		process_entries = true;
-	}
-
-	if (process_entries) {
-		oss << "; decision=\"process result\"";
-		auto msg = oss.str();
-		MDS_LOG_INFO(msg.c_str());
-
-		for (auto it = entries.begin(), end = entries.end(); it != end; ++it) {
-			promise.process(*it);
-		}
-
-		if (error_info) {
-			init_error(error_info);
-		}
-
-		complete_once();
-		return;
+		return true;
 	}
 
-	oss << "; decision=\"try again\"";
-	auto msg = oss.str();
-	MDS_LOG_INFO(msg.c_str());
-	try_group(std::move(group_session), number_of_attempts);
+	return false;
 }
 
 void
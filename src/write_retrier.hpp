@@ -26,12 +26,16 @@
 
 #include <swarm/logger.hpp>
 
+#include <boost/asio/coroutine.hpp>
+
 #include <functional>
 #include <memory>
 #include <mutex>
 
 namespace elliptics {
 
+// Writes into every group of the session independently, writes are retried on temporary errors.
+// The retry loop of a group is a stackless coroutine which is resumed by the write result.
 class write_retrier
 	: public std::enable_shared_from_this<write_retrier>
 {
@@ -55,17 +59,28 @@ public:
 	start();
 
 private:
+	struct group_state_t : public boost::asio::coroutine {
+		group_state_t(ioremap::elliptics::session session_);
+
+		ioremap::elliptics::session session;
+		size_t number_of_attempts;
+	};
+
+	typedef std::shared_ptr<group_state_t> group_state_ptr_t;
+
 	ioremap::swarm::logger &
 	logger();
 
 	void
-	try_group(ioremap::elliptics::session group_session, size_t number_of_attempts);
-
-	void
-	on_finished(ioremap::elliptics::session group_session, size_t number_of_attempts
+	write_group(group_state_ptr_t group_state
 			, const ioremap::elliptics::sync_write_result &entries
 			, const ioremap::elliptics::error_info &error_info);
 
+	// Returns true if the write should be retried, the timeout is scaled on -ETIMEDOUT
+	bool
+	is_temporary_error(ioremap::elliptics::session &group_session
+			, const ioremap::elliptics::error_info &error_info);
+
 	void
 	init_error(const ioremap::elliptics::error_info &error_info_);
 
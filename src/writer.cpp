@@ -47,6 +47,8 @@ public:
 			return "internal error";
 		case elliptics::writer_errc::insufficient_storage:
 			return "insufficient storage";
+		case elliptics::writer_errc::storage_is_busy:
+			return "storage is busy";
 		default:
 			return "unknown error";
 		}
@@ -78,6 +80,7 @@ elliptics::writer_t::writer_t(ioremap::swarm::logger bh_logger_
 		, const ioremap::elliptics::session &session_, std::string key_
 		, size_t total_size_, size_t offset_, size_t commit_coef_, size_t success_copies_num_
 		, size_t limit_of_attempts_, double scale_retry_timeout_
+		, storage_flow_t flow_
 		)
 	: state(state_tag::waiting)
 	, errc_for_client(writer_errc::success)
@@ -90,6 +93,7 @@ elliptics::writer_t::writer_t(ioremap::swarm::logger bh_logger_
 	, success_copies_num(success_copies_num_)
 	, limit_of_attempts(limit_of_attempts_)
 	, scale_retry_timeout(scale_retry_timeout_)
+	, flow(std::move(flow_))
 	, written_size(0)
 	, start_time(std::chrono::system_clock::now())
 {
@@ -121,6 +125,38 @@ elliptics::writer_t::writer_t(ioremap::swarm::logger bh_logger_
 void
 elliptics::writer_t::write(const ioremap::elliptics::data_pointer &data_pointer
 		, callback_t next) {
+	{
+		lock_guard_t lock_guard(state_mutex);
+
+		if (state != state_tag::waiting) {
+			throw writer_error(writer_errc::unexpected_event);
+		}
+
+		if (data_pointer.size() + written_size > total_size) {
+			throw writer_error(writer_errc::incorrect_size);
+		}
+	}
+
+	auto self = shared_from_this();
+
+	flow.schedule([this, self, data_pointer, next] (storage_scheduler_t::slot_ptr_t slot) {
+		// The slot is held until the chunk is written
+		callback_t next_ = hold_slot(std::move(slot), next);
+
+		// The chunk can be written by the thread which released the slot,
+		// hence errors are reported only through the callback
+		try {
+			write_chunk(data_pointer, std::move(next_));
+		} catch (const std::exception &ex) {
+			MDS_LOG_ERROR("cannot write chunk: %s", ex.what());
+			next(make_error_code(writer_errc::internal));
+		}
+	});
+}
+
+void
+elliptics::writer_t::write_chunk(const ioremap::elliptics::data_pointer &data_pointer
+		, callback_t next) {
 	// We need to prolong the lifetime of the shared state here to be sure it is alive
 	// till the end of the function.
 	// The reason of being uncertain is calling async_result.connect(next_) in this function below.
@@ -139,6 +175,17 @@ elliptics::writer_t::write(const ioremap::elliptics::data_pointer &data_pointer
 			throw writer_error(writer_errc::incorrect_size);
 		}
 
+		auto permit = flow.acquire(session.get_groups());
+
+		if (groups_are_busy(*permit)) {
+			state = state_tag::failed;
+
+			lock_guard.unlock();
+			next(make_error_code(writer_errc::storage_is_busy));
+			lock_guard.lock();
+			return;
+		}
+
 		if (written_size == 0 && data_pointer.size() == total_size) {
 			log_chunk("simple", data_pointer.size());
 			auto async_result = session.write_data(key, data_pointer, offset);
@@ -148,8 +195,10 @@ elliptics::writer_t::write(const ioremap::elliptics::data_pointer &data_pointer
 			// But connect can call callback synchronously
 			state = state_tag::committing;
 
-			auto next_ = std::bind(&writer_t::on_data_wrote, shared_from_this()
-					, std::placeholders::_1, std::placeholders::_2, std::move(next));
+			// The places in bulkheads are held until the chunk is written
+			auto next_ = hold_slot(std::move(permit), std::bind(&writer_t::on_data_wrote
+						, shared_from_this(), std::placeholders::_1, std::placeholders::_2
+						, std::move(next)));
 
 			lock_guard.unlock();
 			async_result.connect(next_);
@@ -161,8 +210,9 @@ elliptics::writer_t::write(const ioremap::elliptics::data_pointer &data_pointer
 		written_size += data_pointer.size();
 		offset += data_pointer.size();
 
-		auto next_ = std::bind(&writer_t::on_data_wrote, shared_from_this()
-				, std::placeholders::_1, std::placeholders::_2, std::move(next));
+		auto next_ = hold_slot(std::move(permit), std::bind(&writer_t::on_data_wrote
+					, shared_from_this(), std::placeholders::_1, std::placeholders::_2
+					, std::move(next)));
 
 		lock_guard.unlock();
 		async_result.connect(next_);
@@ -271,6 +321,29 @@ elliptics::writer_t::log_chunk(
 	MDS_LOG_INFO("%s", msg.c_str());
 }
 
+bool
+elliptics::writer_t::groups_are_busy(const storage_bulkheads_t::permit_t &permit) {
+	const auto &busy_groups = permit.rejected_groups();
+
+	if (busy_groups.empty()) {
+		return false;
+	}
+
+	// Busy groups are not excluded: a momentary overload must not leave the key
+	// with fewer replicas, hence the write fails and the caller may try another couple
+	std::ostringstream oss;
+	oss
+		<< "bulkheads of groups are full:"
+		<< " key=" << key.remote()
+		<< " busy-groups=" << busy_groups
+		<< " groups=" << permit.groups();
+
+	auto msg = oss.str();
+	MDS_LOG_ERROR("%s", msg.c_str());
+
+	return true;
+}
+
 void
 elliptics::writer_t::update_groups(
 		const ioremap::elliptics::sync_write_result &entries) {
@@ -494,6 +567,7 @@ elliptics::can_be_written(shared_logger_t shared_logger
 		, ioremap::elliptics::session session
 		, std::string key
 		, mastermind::namespace_state_t ns_state
+		, storage_flow_t flow
 		, util::expected<bool>::callback_t next) {
 
 	{
@@ -513,12 +587,25 @@ elliptics::can_be_written(shared_logger_t shared_logger
 	session.set_cflags(session.get_cflags() | DNET_FLAGS_NOLOCK);
 	session.set_filter(ioremap::elliptics::filters::all);
 
-	auto future = session.parallel_lookup(key);
+	flow.schedule([shared_logger, session, key, flow, next] (
+				storage_scheduler_t::slot_ptr_t slot) mutable {
+		auto permit = flow.acquire(session.get_groups());
+
+		// The key cannot be checked in a busy group, hence another couple is used
+		if (!permit->rejected_groups().empty()) {
+			MDS_LOG_ERROR("cannot check for update: bulkheads of groups are full");
+			next(util::expected_from_exception<std::runtime_error>("cannot check some group"));
+			return;
+		}
+
+		auto future = session.parallel_lookup(key);
 
-	auto next_ = std::bind(&detail::can_be_written_on_lookup, shared_logger
-			, std::placeholders::_1, std::placeholders::_2
-			, std::move(next));
+		auto next_ = std::bind(&detail::can_be_written_on_lookup, shared_logger
+				, std::placeholders::_1, std::placeholders::_2
+				, std::move(next));
 
-	future.connect(next_);
+		// The slot and places in bulkheads are held until all groups reply
+		future.connect(hold_slot(std::move(slot), hold_slot(std::move(permit), std::move(next_))));
+	});
 }
 
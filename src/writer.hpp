@@ -22,6 +22,7 @@
 
 #include "loggers.hpp"
 #include "expected.hpp"
+#include "storage_scheduler.hpp"
 
 #include <elliptics/session.hpp>
 
@@ -42,6 +43,7 @@ enum class writer_errc {
 	, incorrect_size
 	, internal
 	, insufficient_storage
+	, storage_is_busy
 };
 
 const std::error_category &
@@ -83,6 +85,7 @@ public:
 			, const ioremap::elliptics::session &session_, std::string key_
 			, size_t total_size_, size_t offset_, size_t commit_coef_, size_t success_copies_num_
 			, size_t limit_of_attempts_ = 1, double scale_retry_timeout_ = 1
+			, storage_flow_t flow_ = storage_flow_t()
 			);
 
 	void
@@ -127,9 +130,15 @@ private:
 	ioremap::swarm::logger &
 	logger();
 
+	void
+	write_chunk(const ioremap::elliptics::data_pointer &data_pointer, callback_t next);
+
 	void
 	log_chunk(const std::string &write_type, size_t chunk_size);
 
+	bool
+	groups_are_busy(const storage_bulkheads_t::permit_t &permit);
+
 	void
 	update_groups(const ioremap::elliptics::sync_write_result &entries);
 
@@ -167,6 +176,8 @@ private:
 	size_t limit_of_attempts;
 	double scale_retry_timeout;
 
+	storage_flow_t flow;
+
 	size_t written_size;
 	std::vector<int> bad_groups;
 
@@ -175,11 +186,13 @@ private:
 	entries_info_t entries_info;
 };
 
+// The lookup is scheduled by flow, the check fails if a bulkhead of any group is full
 void
 can_be_written(shared_logger_t shared_logger
 		, ioremap::elliptics::session session
 		, std::string key
 		, mastermind::namespace_state_t ns_state
+		, storage_flow_t flow
 		, util::expected<bool>::callback_t next);
 
 } // namespace elliptics